@@ -0,0 +1,115 @@
+#include "AlarmController.h"
+#include <CommandChannel.h>
+
+AlarmController::AlarmController() {
+  this->clear();
+}
+
+/*
+ *This method is used to take the levels of a new reading.
+ *The siren is turned off when it is on and both enclosures are ideal, this does not require the user to press the stop button.
+ *It is turned on when it is off and one of the enclosures is critical.
+ */
+alarmChange AlarmController::update(enclosureLevels levels) {
+  this->levels = levels;
+  this->has_levels = true;
+  if (this->siren) {
+    if (levels.avian == LEVEL_IDEAL && levels.reptilian == LEVEL_IDEAL) {
+      this->siren = false;
+      return ALARM_RESET;
+    }
+    return ALARM_UNCHANGED;
+  }
+  if (this->critical()) {
+    this->siren = true;
+    return ALARM_RAISED;
+  }
+  return ALARM_UNCHANGED;
+}
+
+/*
+ *This method is used to take a command from the siren topics.
+ *"siren on" turns the siren on and "siren off" turns it off unless one of the enclosures is critical.
+ *It returns false if the payload is neither or the siren was kept on, siren_on() gives the state to drive the pin to.
+ */
+bool AlarmController::siren_command(const uint8_t *payload, unsigned int length) {
+  if (payload_equals(payload, length, "siren on")) {
+    this->sound();
+    return true;
+  }
+  if (payload_equals(payload, length, "siren off")) {
+    return this->silence();
+  }
+  return false;
+}
+
+/*
+ *This method is used to take a press of the stop button.
+ *It returns ALARM_RESET if the siren was on and is now off, the server is told on the siren off topic.
+ *The siren stays on while one of the enclosures is critical.
+ */
+alarmChange AlarmController::stop_pressed() {
+  if (this->siren && this->silence()) {
+    return ALARM_RESET;
+  }
+  return ALARM_UNCHANGED;
+}
+
+/*
+ *This method is used to turn the siren on from a command, it stays on until it is silenced or the next reading is ideal.
+ */
+void AlarmController::sound() {
+  this->siren = true;
+}
+
+/*
+ *This method is used to turn the siren off from the stop button or a command.
+ *It returns false and leaves the siren on while one of the enclosures is critical.
+ */
+bool AlarmController::silence() {
+  if (this->critical()) {
+    return false;
+  }
+  this->siren = false;
+  return true;
+}
+
+/*
+ *This method is used to forget the siren and the levels when every output has been driven low e.g before the WiFi is set up again.
+ */
+void AlarmController::clear() {
+  this->siren = false;
+  this->has_levels = false;
+  this->levels.avian = LEVEL_IDEAL;
+  this->levels.reptilian = LEVEL_IDEAL;
+}
+
+bool AlarmController::siren_on() {
+  return this->siren;
+}
+
+/*
+ *This method is used to check if the last reading of either enclosure was critical.
+ */
+bool AlarmController::critical() {
+  return this->has_levels && (this->levels.avian == LEVEL_CRITICAL || this->levels.reptilian == LEVEL_CRITICAL);
+}
+
+bool AlarmController::levels_known() {
+  return this->has_levels;
+}
+
+enclosureLevels AlarmController::get_levels() {
+  return this->levels;
+}
+
+const char *alarm_change_name(alarmChange change) {
+  switch (change) {
+  case ALARM_RAISED:
+    return "raised";
+  case ALARM_RESET:
+    return "reset";
+  default:
+    return "unchanged";
+  }
+}
@@ -0,0 +1,46 @@
+#ifndef AlarmController_h
+#define AlarmController_h
+#include <Classifier.h>
+#include <ReadingController.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * What a new reading did to the siren
+ * ALARM_RESET means the siren was turned off because both enclosures are ideal again, the server is told on the siren off topic
+ */
+enum alarmChange {
+  ALARM_UNCHANGED = 0,
+  ALARM_RAISED,
+  ALARM_RESET
+};
+
+/*
+ * The state of the siren and of the enclosure LEDs
+ * The loop hands it the levels of each reading, the siren commands and the stop button and drives the pins from the result,
+ * so the decisions can also be replayed off the device
+ * Until the first reading every LED is off, the enclosures are neither ideal nor critical
+ */
+class AlarmController {
+  private:
+  bool siren;
+  bool has_levels;
+  enclosureLevels levels;
+
+  public:
+  AlarmController();
+  alarmChange update(enclosureLevels levels);
+  bool siren_command(const uint8_t *payload, unsigned int length);
+  alarmChange stop_pressed();
+  void sound();
+  bool silence();
+  void clear();
+  bool siren_on();
+  bool critical();
+  bool levels_known();
+  enclosureLevels get_levels();
+};
+
+const char *alarm_change_name(alarmChange change);
+
+#endif
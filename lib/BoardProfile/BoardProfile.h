@@ -0,0 +1,223 @@
+#ifndef BoardProfile_h
+#define BoardProfile_h
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Board profiles
+ * Each revision of the PCB is a struct of constexpr pin numbers. The firmware is built for the profile named by BOARD_PROFILE,
+ * set with a build flag in the PlatformIO environment of the revision e.g -DBOARD_PROFILE=BoardRev2.
+ * The pin table, the masks and the checks below are generated from the profile by the compiler, nothing is looked up at run time.
+ * Everything here is C++11 so it builds with the flags of the Arduino core.
+ */
+
+/*
+ * The sensor fitted to an enclosure
+ * The DHT is on its own pin, the SHT3x and the BME280 share the I2C bus
+ */
+enum sensorKind {
+  SENSOR_KIND_DHT = 0,
+  SENSOR_KIND_SHT3X,
+  SENSOR_KIND_BME280
+};
+
+/*
+ * The first revision, the pins the firmware has always used
+ * GPIO 16 and 17 are kept for the I2C bus, 21 and 22 where the ESP32 usually has it are taken by an LED and a button
+ */
+struct BoardRev1 {
+  static constexpr const char *name = "rev1";
+  static constexpr uint8_t dht_type = 11; // DHT11
+  static constexpr uint8_t dht_avian = 4;
+  static constexpr uint8_t dht_reptile = 13;
+  static constexpr sensorKind avian_sensor = SENSOR_KIND_DHT;
+  static constexpr sensorKind reptile_sensor = SENSOR_KIND_DHT;
+  static constexpr uint8_t i2c_sda = 16;
+  static constexpr uint8_t i2c_scl = 17;
+  static constexpr uint8_t siren = 2;
+  static constexpr uint8_t avian_ideal = 21;
+  static constexpr uint8_t avian_warning = 19;
+  static constexpr uint8_t avian_critical = 18;
+  static constexpr uint8_t reptile_ideal = 27;
+  static constexpr uint8_t reptile_warning = 26;
+  static constexpr uint8_t reptile_critical = 25;
+  static constexpr uint8_t reset_wifi = 15;
+  static constexpr uint8_t set_limits = 23;
+  static constexpr uint8_t stop_siren = 22;
+};
+
+/*
+ * The second revision moves the siren off the strapping pin GPIO2 and the reptile sensor off GPIO13, which is shared with the JTAG header.
+ * The sensor goes to GPIO33 and not to a neighbour, GPIO12 to 15 are all JTAG pins
+ */
+struct BoardRev2 : BoardRev1 {
+  static constexpr const char *name = "rev2";
+  static constexpr uint8_t dht_reptile = 33;
+  static constexpr uint8_t siren = 32;
+};
+
+/*
+ * The second revision fitted with I2C sensors, an SHT3x in the avian enclosure and a BME280 in the reptile enclosure
+ */
+struct BoardRev2I2c : BoardRev2 {
+  static constexpr const char *name = "rev2-i2c";
+  static constexpr sensorKind avian_sensor = SENSOR_KIND_SHT3X;
+  static constexpr sensorKind reptile_sensor = SENSOR_KIND_BME280;
+};
+
+/*
+ * The native build has no pins, the host tools use the layout of the first revision
+ */
+struct BoardNative : BoardRev1 {
+  static constexpr const char *name = "native";
+};
+
+#ifndef BOARD_PROFILE
+#define BOARD_PROFILE BoardRev1
+#endif
+
+/*
+ * How a pin is set up at boot
+ */
+enum pinUse {
+  PIN_USE_OUTPUT = 0,
+  PIN_USE_INPUT_PULLUP,
+  PIN_USE_SENSOR // the sensor drivers and Wire set up the pin themselves
+};
+
+struct boardPin {
+  uint8_t pin;
+  pinUse use;
+};
+
+#define BOARD_PIN_COUNT 14
+
+/*
+ * Every pin of a profile with its use, in the order they are set up
+ * The siren comes first so it is driven low as early as possible
+ */
+template <typename B>
+struct BoardPins {
+  static constexpr boardPin table[BOARD_PIN_COUNT] = {
+      {B::siren, PIN_USE_OUTPUT},
+      {B::avian_ideal, PIN_USE_OUTPUT},
+      {B::avian_warning, PIN_USE_OUTPUT},
+      {B::avian_critical, PIN_USE_OUTPUT},
+      {B::reptile_ideal, PIN_USE_OUTPUT},
+      {B::reptile_warning, PIN_USE_OUTPUT},
+      {B::reptile_critical, PIN_USE_OUTPUT},
+      {B::set_limits, PIN_USE_INPUT_PULLUP},
+      {B::reset_wifi, PIN_USE_INPUT_PULLUP},
+      {B::stop_siren, PIN_USE_INPUT_PULLUP},
+      {B::dht_avian, PIN_USE_SENSOR},
+      {B::dht_reptile, PIN_USE_SENSOR},
+      {B::i2c_sda, PIN_USE_SENSOR},
+      {B::i2c_scl, PIN_USE_SENSOR},
+  };
+};
+
+template <typename B>
+constexpr boardPin BoardPins<B>::table[BOARD_PIN_COUNT];
+
+/*
+ * The enclosures and the LEDs that show the level of each one
+ */
+enum enclosure {
+  ENCLOSURE_AVIAN = 0,
+  ENCLOSURE_REPTILE
+};
+
+template <typename B, enclosure E>
+struct EnclosureLeds;
+
+template <typename B>
+struct EnclosureLeds<B, ENCLOSURE_AVIAN> {
+  static constexpr uint8_t ideal = B::avian_ideal;
+  static constexpr uint8_t warning = B::avian_warning;
+  static constexpr uint8_t critical = B::avian_critical;
+};
+
+template <typename B>
+struct EnclosureLeds<B, ENCLOSURE_REPTILE> {
+  static constexpr uint8_t ideal = B::reptile_ideal;
+  static constexpr uint8_t warning = B::reptile_warning;
+  static constexpr uint8_t critical = B::reptile_critical;
+};
+
+/*
+ * The sensor fitted to each enclosure and the pin of its DHT if it has one
+ */
+template <typename B, enclosure E>
+struct EnclosureSensor;
+
+template <typename B>
+struct EnclosureSensor<B, ENCLOSURE_AVIAN> {
+  static constexpr sensorKind kind = B::avian_sensor;
+  static constexpr uint8_t dht_pin = B::dht_avian;
+};
+
+template <typename B>
+struct EnclosureSensor<B, ENCLOSURE_REPTILE> {
+  static constexpr sensorKind kind = B::reptile_sensor;
+  static constexpr uint8_t dht_pin = B::dht_reptile;
+};
+
+/*
+ * True when one of the enclosures has an I2C sensor, the bus is only started then
+ */
+template <typename B>
+constexpr bool uses_i2c() {
+  return B::avian_sensor != SENSOR_KIND_DHT || B::reptile_sensor != SENSOR_KIND_DHT;
+}
+
+/*
+ * Compile time checks of the pins of the ESP32
+ * GPIO 6 to 11 are wired to the flash and 20, 24 and 28 to 31 do not exist. 34 to 39 are inputs without pull-ups,
+ * so they can neither drive an LED, hold a button high nor talk to a DHT which needs the pin both ways.
+ */
+constexpr bool gpio_usable(uint8_t pin) {
+  return pin < 34 && !(pin >= 6 && pin <= 11) && pin != 20 && pin != 24 && !(pin >= 28 && pin <= 31);
+}
+
+constexpr bool pins_usable(const boardPin *pins, size_t count) {
+  return count == 0 || (gpio_usable(pins[0].pin) && pins_usable(pins + 1, count - 1));
+}
+
+constexpr bool pin_used_by(const boardPin *pins, size_t count, uint8_t pin) {
+  return count > 0 && (pins[0].pin == pin || pin_used_by(pins + 1, count - 1, pin));
+}
+
+/*
+ * Two entries of the table on the same pin are a conflict
+ */
+constexpr bool pins_conflict(const boardPin *pins, size_t count) {
+  return count > 1 && (pin_used_by(pins + 1, count - 1, pins[0].pin) || pins_conflict(pins + 1, count - 1));
+}
+
+constexpr uint64_t pins_mask(const boardPin *pins, size_t count, pinUse use) {
+  return count == 0 ? 0 : ((pins[0].use == use ? 1ULL << pins[0].pin : 0) | pins_mask(pins + 1, count - 1, use));
+}
+
+/*
+ * The bits of the outputs of a profile, bit n is GPIOn
+ */
+template <typename B>
+constexpr uint64_t output_mask() {
+  return pins_mask(BoardPins<B>::table, BOARD_PIN_COUNT, PIN_USE_OUTPUT);
+}
+
+/*
+ * Instantiated for a profile to reject it at compile time
+ */
+template <typename B>
+struct BoardCheck {
+  static_assert(!pins_conflict(BoardPins<B>::table, BOARD_PIN_COUNT), "two functions of the board profile share a pin");
+  static_assert(pins_usable(BoardPins<B>::table, BOARD_PIN_COUNT), "a pin of the board profile cannot be used for its function on the ESP32");
+  static_assert(B::dht_type == 11 || B::dht_type == 22, "the DHT type must be 11 or 22");
+  static constexpr bool checked = true;
+};
+
+typedef BOARD_PROFILE Board;
+static_assert(BoardCheck<Board>::checked, "board profile check");
+
+#endif
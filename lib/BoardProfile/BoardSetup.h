@@ -0,0 +1,147 @@
+#ifndef BoardSetup_h
+#define BoardSetup_h
+#include "BoardProfile.h"
+#include <Arduino.h>
+#include <Bme280Driver.h>
+#include <Classifier.h>
+#include <DhtDriver.h>
+#include <Sht3xDriver.h>
+#ifdef ESP32
+#include <soc/gpio_struct.h>
+#endif
+
+/*
+ * Pin set up and output helpers generated from a board profile
+ * Each pin of the table becomes its own pinMode() call with constant arguments, there is no loop over the table at run time
+ */
+
+template <typename B, size_t I>
+struct PinSetup {
+  static void run() {
+    PinSetup<B, I - 1>::run();
+    const boardPin pin = BoardPins<B>::table[I - 1];
+    if (pin.use == PIN_USE_OUTPUT) {
+      pinMode(pin.pin, OUTPUT);
+    } else if (pin.use == PIN_USE_INPUT_PULLUP) {
+      pinMode(pin.pin, INPUT_PULLUP);
+    }
+  }
+};
+
+template <typename B>
+struct PinSetup<B, 0> {
+  static void run() {}
+};
+
+template <typename B, size_t I>
+struct PinClear {
+  static void run() {
+    PinClear<B, I - 1>::run();
+    const boardPin pin = BoardPins<B>::table[I - 1];
+    if (pin.use == PIN_USE_OUTPUT) {
+      digitalWrite(pin.pin, LOW);
+    }
+  }
+};
+
+template <typename B>
+struct PinClear<B, 0> {
+  static void run() {}
+};
+
+template <typename B, size_t I>
+struct ButtonInterrupts {
+  static void attach(void (*handler)()) {
+    ButtonInterrupts<B, I - 1>::attach(handler);
+    const boardPin pin = BoardPins<B>::table[I - 1];
+    if (pin.use == PIN_USE_INPUT_PULLUP) {
+      attachInterrupt(digitalPinToInterrupt(pin.pin), handler, FALLING);
+    }
+  }
+};
+
+template <typename B>
+struct ButtonInterrupts<B, 0> {
+  static void attach(void (*handler)()) {}
+};
+
+/*
+ * A function to set up every pin of the profile except the sensor pins
+ */
+template <typename B>
+inline void init_board_pins() {
+  PinSetup<B, BOARD_PIN_COUNT>::run();
+}
+
+/*
+ * A function to call handler when any button of the profile is pressed, the buttons pull their pin low
+ */
+template <typename B>
+inline void attach_button_interrupts(void (*handler)()) {
+  ButtonInterrupts<B, BOARD_PIN_COUNT>::attach(handler);
+}
+
+/*
+ * A function to drive every output of the profile low, the LEDs and the siren
+ * On the ESP32 this is one write to each of the two output clear registers
+ */
+template <typename B>
+inline void clear_board_outputs() {
+#ifdef ESP32
+  const uint32_t low_pins = static_cast<uint32_t>(output_mask<B>());
+  const uint32_t high_pins = static_cast<uint32_t>(output_mask<B>() >> 32);
+  if (low_pins != 0) {
+    GPIO.out_w1tc = low_pins;
+  }
+  if (high_pins != 0) {
+    GPIO.out1_w1tc.val = high_pins;
+  }
+#else
+  PinClear<B, BOARD_PIN_COUNT>::run();
+#endif
+}
+
+/*
+ * A function to light the LED of an enclosure that matches its level and turn off the other two
+ */
+template <typename B, enclosure E>
+inline void show_level(readingLevel level) {
+  typedef EnclosureLeds<B, E> Leds;
+  digitalWrite(Leds::ideal, level == LEVEL_IDEAL ? HIGH : LOW);
+  digitalWrite(Leds::warning, level == LEVEL_WARNING ? HIGH : LOW);
+  digitalWrite(Leds::critical, level == LEVEL_CRITICAL ? HIGH : LOW);
+}
+
+/*
+ * The driver of the sensor fitted to an enclosure, only that one is built into the firmware
+ * The avian sensors are on the default I2C address and the reptile sensors on the alternate one so both can share the bus
+ * e.g SensorFor<Board, ENCLOSURE_AVIAN>::type avian = SensorFor<Board, ENCLOSURE_AVIAN>::make(&bus);
+ */
+template <typename B, enclosure E, sensorKind K = EnclosureSensor<B, E>::kind>
+struct SensorFor;
+
+template <typename B, enclosure E>
+struct SensorFor<B, E, SENSOR_KIND_DHT> {
+  typedef DhtDriver type;
+  static type make(SensorBus *bus) {
+    return type(EnclosureSensor<B, E>::dht_pin, B::dht_type);
+  }
+};
+
+template <typename B, enclosure E>
+struct SensorFor<B, E, SENSOR_KIND_SHT3X> {
+  typedef Sht3xDriver type;
+  static type make(SensorBus *bus) {
+    return type(bus, E == ENCLOSURE_AVIAN ? SHT3X_ADDRESS : SHT3X_ADDRESS_ALT);
+  }
+};
+
+template <typename B, enclosure E>
+struct SensorFor<B, E, SENSOR_KIND_BME280> {
+  typedef Bme280Driver type;
+  static type make(SensorBus *bus) {
+    return type(bus, E == ENCLOSURE_AVIAN ? BME280_ADDRESS : BME280_ADDRESS_ALT);
+  }
+};
+
+#endif
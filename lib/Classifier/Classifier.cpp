@@ -0,0 +1,32 @@
+#include "Classifier.h"
+
+/*
+ *A function to check a reading against one set of limits
+ *The limits are the lowest, ideal lowest, ideal highest and highest value
+ *A reading outside the lowest and highest value is critical,
+ *a reading between them but outside the ideal values is a warning and anything else is ideal
+ */
+readingLevel classify_reading(centi_t reading, const centi_t *limits) {
+  centi_t lowest = limits[0];
+  centi_t ideal_lowest = limits[1];
+  centi_t ideal_highest = limits[2];
+  centi_t highest = limits[3];
+  if (reading < lowest || reading > highest) {
+    return LEVEL_CRITICAL;
+  }
+  if (reading < ideal_lowest || reading > ideal_highest) {
+    return LEVEL_WARNING;
+  }
+  return LEVEL_IDEAL;
+}
+
+const char *level_name(readingLevel level) {
+  switch (level) {
+  case LEVEL_CRITICAL:
+    return "critical";
+  case LEVEL_WARNING:
+    return "warning";
+  default:
+    return "ideal";
+  }
+}
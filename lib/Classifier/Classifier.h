@@ -0,0 +1,29 @@
+#ifndef Classifier_h
+#define Classifier_h
+#include <FixedPoint.h>
+#include <stdint.h>
+
+/*
+ * Limits are in hundredths of a unit so that e.g 37.5 degrees can be set
+ * Each array holds the lowest, ideal lowest, ideal highest and highest value
+ */
+struct Limits {
+  centi_t avian_temp_limits[4];
+  centi_t avian_humid_limits[4];
+  centi_t reptile_temp_limits[4];
+  centi_t reptile_humid_limits[4];
+};
+
+/*
+ * The level of a reading, a higher value is more severe
+ */
+enum readingLevel {
+  LEVEL_IDEAL = 0,
+  LEVEL_WARNING = 1,
+  LEVEL_CRITICAL = 2
+};
+
+readingLevel classify_reading(centi_t reading, const centi_t *limits);
+const char *level_name(readingLevel level);
+
+#endif
@@ -0,0 +1,92 @@
+#include "CommandChannel.h"
+#include <stdio.h>
+#include <string.h>
+
+/*
+ *A function to find the handler for a topic and run it
+ *The routes are a static table so finding the handler is a walk over a handful of string compares
+ *It returns COMMAND_UNKNOWN if no route matches the topic
+ */
+commandResult dispatch_command(const CommandRoute *routes, size_t count, const char *topic, const uint8_t *payload, unsigned int length) {
+  for (size_t i = 0; i < count; i++) {
+    if (strcmp(routes[i].topic, topic) == 0) {
+      return routes[i].handler(payload, length) ? COMMAND_ACCEPTED : COMMAND_REJECTED;
+    }
+  }
+  return COMMAND_UNKNOWN;
+}
+
+const char *command_result_name(commandResult result) {
+  switch (result) {
+  case COMMAND_ACCEPTED:
+    return "ok";
+  case COMMAND_REJECTED:
+    return "rejected";
+  default:
+    return "unknown";
+  }
+}
+
+/*
+ *A function to write the acknowledgement of a command, "<topic> <ok|rejected|unknown>"
+ *It returns the length of the acknowledgement or 0 if it did not fit in size
+ */
+size_t format_command_ack(char *ack, size_t size, const char *topic, commandResult result) {
+  int length = snprintf(ack, size, "%s %s", topic, command_result_name(result));
+  return length < 0 || static_cast<size_t>(length) >= size ? 0 : static_cast<size_t>(length);
+}
+
+/*
+ *A function to check if a topic matches an MQTT topic filter
+ *"+" matches one level and "#" matches the rest of the topic including its parent level, so "command/#" also matches "command"
+ */
+bool topic_matches(const char *filter, const char *topic) {
+  while (*filter != '\0') {
+    if (*filter == '#') {
+      return true;
+    }
+    if (*filter == '+') {
+      while (*topic != '\0' && *topic != '/') {
+        topic++;
+      }
+      filter++;
+    } else if (*filter == *topic) {
+      filter++;
+      topic++;
+    } else {
+      return *topic == '\0' && strcmp(filter, "/#") == 0;
+    }
+  }
+  return *topic == '\0';
+}
+
+/*
+ *A function to compare a payload that is not null terminated with a string
+ */
+bool payload_equals(const uint8_t *payload, unsigned int length, const char *text) {
+  size_t text_length = strlen(text);
+  return text_length == length && memcmp(payload, text, length) == 0;
+}
+
+/*
+ *A function to parse a payload made up of only decimal digits
+ *It returns false if the payload is empty, has any other character or does not fit in 32 bits
+ */
+bool payload_to_uint(const uint8_t *payload, unsigned int length, uint32_t *value) {
+  if (length == 0) {
+    return false;
+  }
+  uint32_t result = 0;
+  for (unsigned int i = 0; i < length; i++) {
+    if (payload[i] < '0' || payload[i] > '9') {
+      return false;
+    }
+    uint32_t digit = payload[i] - '0';
+    if (result > (UINT32_MAX - digit) / 10) {
+      return false;
+    }
+    result = result * 10 + digit;
+  }
+  *value = result;
+  return true;
+}
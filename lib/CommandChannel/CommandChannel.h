@@ -0,0 +1,31 @@
+#ifndef CommandChannel_h
+#define CommandChannel_h
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * A command handler gets the payload straight from the MQTT client buffer
+ * The payload is not null terminated and is only valid until the handler returns
+ * so a handler must not publish, it should parse what it needs and return true if the command was accepted
+ */
+typedef bool (*commandHandler)(const uint8_t *payload, unsigned int length);
+
+struct CommandRoute {
+  const char *topic;
+  commandHandler handler;
+};
+
+enum commandResult {
+  COMMAND_ACCEPTED,
+  COMMAND_REJECTED,
+  COMMAND_UNKNOWN
+};
+
+commandResult dispatch_command(const CommandRoute *routes, size_t count, const char *topic, const uint8_t *payload, unsigned int length);
+const char *command_result_name(commandResult result);
+size_t format_command_ack(char *ack, size_t size, const char *topic, commandResult result);
+bool topic_matches(const char *filter, const char *topic);
+bool payload_equals(const uint8_t *payload, unsigned int length, const char *text);
+bool payload_to_uint(const uint8_t *payload, unsigned int length, uint32_t *value);
+
+#endif
@@ -0,0 +1,81 @@
+#include "DeviceIdentity.h"
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * The last part of each topic, in the order of deviceTopic
+ */
+static const char *const topic_names[TOPIC_COUNT] = {
+    "readings",
+    "siren",
+    "/siren/off",
+    "command/siren",
+    "command/sample",
+    "command/interval",
+    "command/stats",
+    "command/limits/reload",
+    "command/#",
+    "ack/command",
+    "limits/set",
+    "stats",
+    "logs",
+    "diagnostics",
+};
+
+const deviceTopic subscribed_topics[SUBSCRIBED_TOPIC_COUNT] = {TOPIC_SIREN, TOPIC_COMMANDS, TOPIC_LIMITS_SET};
+
+DeviceIdentity::DeviceIdentity() {
+  this->id[0] = '\0';
+  this->client_id[0] = '\0';
+  for (uint8_t i = 0; i < TOPIC_COUNT; i++) {
+    this->topics[i][0] = '\0';
+  }
+}
+
+/*
+ *This method is used to build the device id, the MQTT client id and the topics.
+ *mac is the MAC address as returned by ESP.getEfuseMac(), the first byte of the address is the lowest byte.
+ *root is the topic namespace, an empty root keeps the topics the server already uses.
+ *The method returns false if a topic did not fit in TOPIC_SIZE.
+ */
+bool DeviceIdentity::begin(uint64_t mac, const char *root) {
+  snprintf(this->id, sizeof(this->id), "%02x%02x%02x%02x%02x%02x",
+           static_cast<unsigned>(mac & 0xff),
+           static_cast<unsigned>((mac >> 8) & 0xff),
+           static_cast<unsigned>((mac >> 16) & 0xff),
+           static_cast<unsigned>((mac >> 24) & 0xff),
+           static_cast<unsigned>((mac >> 32) & 0xff),
+           static_cast<unsigned>((mac >> 40) & 0xff));
+  snprintf(this->client_id, sizeof(this->client_id), "esp_client_%s", this->id);
+
+  bool fits = true;
+  for (uint8_t i = 0; i < TOPIC_COUNT; i++) {
+    const char *name = topic_names[i];
+    int length;
+    if (root[0] == '\0') {
+      length = snprintf(this->topics[i], TOPIC_SIZE, "%s", name);
+    } else {
+      // A namespaced topic never starts with a slash, /siren/off becomes <root>/<id>/siren/off
+      if (name[0] == '/') {
+        name++;
+      }
+      length = snprintf(this->topics[i], TOPIC_SIZE, "%s/%s/%s", root, this->id, name);
+    }
+    if (length < 0 || length >= TOPIC_SIZE) {
+      fits = false;
+    }
+  }
+  return fits;
+}
+
+const char *DeviceIdentity::device_id() {
+  return this->id;
+}
+
+const char *DeviceIdentity::mqtt_client_id() {
+  return this->client_id;
+}
+
+const char *DeviceIdentity::topic(deviceTopic topic) {
+  return this->topics[topic];
+}
@@ -0,0 +1,62 @@
+#ifndef DeviceIdentity_h
+#define DeviceIdentity_h
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Topics are namespaced as <MQTT_TOPIC_ROOT>/<device id>/<topic> when MQTT_TOPIC_ROOT is set with a build flag
+ * e.g -DMQTT_TOPIC_ROOT=\"hatchery\" gives hatchery/a4cf12b3c5d8/readings
+ * When it is empty the topics are the ones the server already uses e.g readings and /siren/off
+ */
+#ifndef MQTT_TOPIC_ROOT
+#define MQTT_TOPIC_ROOT ""
+#endif
+
+#define DEVICE_ID_SIZE 13 // 12 hex digits of the MAC address and the null terminator
+#define CLIENT_ID_SIZE 24
+#define TOPIC_SIZE 64
+
+enum deviceTopic {
+  TOPIC_READINGS = 0,
+  TOPIC_SIREN,
+  TOPIC_SIREN_OFF,
+  TOPIC_COMMAND_SIREN,
+  TOPIC_COMMAND_SAMPLE,
+  TOPIC_COMMAND_INTERVAL,
+  TOPIC_COMMAND_STATS,
+  TOPIC_COMMAND_LIMITS_RELOAD,
+  TOPIC_COMMANDS, // wildcard that covers all the command topics
+  TOPIC_COMMAND_ACK,
+  TOPIC_LIMITS_SET,
+  TOPIC_STATS,
+  TOPIC_LOGS,
+  TOPIC_DIAGNOSTICS,
+  TOPIC_COUNT
+};
+
+/*
+ * The topic filters the device subscribes to, the topics it publishes on must not match any of them
+ */
+#define SUBSCRIBED_TOPIC_COUNT 3
+extern const deviceTopic subscribed_topics[SUBSCRIBED_TOPIC_COUNT];
+
+/*
+ * The identity of a device and the topics it uses
+ * The strings are built once by begin() so nothing is formatted when publishing
+ * The addresses of the strings do not change, so they can be put in static tables before begin() is called
+ */
+class DeviceIdentity {
+  private:
+  char id[DEVICE_ID_SIZE];
+  char client_id[CLIENT_ID_SIZE];
+  char topics[TOPIC_COUNT][TOPIC_SIZE];
+
+  public:
+  DeviceIdentity();
+  bool begin(uint64_t mac, const char *root);
+  const char *device_id();
+  const char *mqtt_client_id();
+  const char *topic(deviceTopic topic);
+};
+
+#endif
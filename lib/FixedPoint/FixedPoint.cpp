@@ -0,0 +1,68 @@
+#include "FixedPoint.h"
+#include <math.h>
+
+/*
+ *A function to convert a float to hundredths of a unit
+ *The value is rounded to the nearest hundredth and clamped to the range of centi_t
+ *NaN is converted to CENTI_INVALID
+ */
+centi_t centi_from_float(float value) {
+  if (isnan(value)) {
+    return CENTI_INVALID;
+  }
+  float scaled = roundf(value * CENTI_SCALE);
+  if (scaled > CENTI_MAX) {
+    return CENTI_MAX;
+  }
+  if (scaled < CENTI_MIN) {
+    return CENTI_MIN;
+  }
+  return static_cast<centi_t>(scaled);
+}
+
+float centi_to_float(centi_t value) {
+  return static_cast<float>(value) / CENTI_SCALE;
+}
+
+/*
+ *A function to write a centi_t as a decimal number without going through a float
+ *Trailing zeros of the fraction are dropped so 2450 is written as "24.5" and 2400 as "24",
+ *which is the same text the JSON library produced for the float readings.
+ *It returns the number of characters written excluding the null terminator or 0 if the buffer is too small.
+ */
+size_t format_centi(centi_t value, char *buffer, size_t size) {
+  char digits[CENTI_STRING_SIZE];
+  size_t length = 0;
+  int32_t magnitude = value < 0 ? -static_cast<int32_t>(value) : value;
+  int32_t whole = magnitude / CENTI_SCALE;
+  int32_t fraction = magnitude % CENTI_SCALE;
+
+  if (value < 0) {
+    digits[length++] = '-';
+  }
+  char reversed[6];
+  size_t count = 0;
+  do {
+    reversed[count++] = '0' + whole % 10;
+    whole /= 10;
+  } while (whole > 0);
+  while (count > 0) {
+    digits[length++] = reversed[--count];
+  }
+  if (fraction != 0) {
+    digits[length++] = '.';
+    digits[length++] = '0' + fraction / 10;
+    if (fraction % 10 != 0) {
+      digits[length++] = '0' + fraction % 10;
+    }
+  }
+
+  if (length + 1 > size) {
+    return 0;
+  }
+  for (size_t i = 0; i < length; i++) {
+    buffer[i] = digits[i];
+  }
+  buffer[length] = '\0';
+  return length;
+}
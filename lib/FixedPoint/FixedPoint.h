@@ -0,0 +1,30 @@
+#ifndef FixedPoint_h
+#define FixedPoint_h
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Readings and limits are carried as hundredths of a unit in a 16 bit integer
+ * e.g 37.5 degrees is stored as 3750 and 65% humidity as 6500
+ * This covers -327.68 to 327.67 which is more than the sensors can measure
+ */
+typedef int16_t centi_t;
+
+#define CENTI_SCALE 100
+#define CENTI_MAX INT16_MAX
+#define CENTI_MIN (INT16_MIN + 1)
+/*
+ * Marks a value that could not be converted e.g a failed sensor read
+ */
+#define CENTI_INVALID INT16_MIN
+
+/*
+ * Longest string produced by format_centi including the null terminator e.g "-327.68"
+ */
+#define CENTI_STRING_SIZE 8
+
+centi_t centi_from_float(float value);
+float centi_to_float(centi_t value);
+size_t format_centi(centi_t value, char *buffer, size_t size);
+
+#endif
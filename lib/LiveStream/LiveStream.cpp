@@ -0,0 +1,139 @@
+#ifdef ARDUINO
+#include "LiveStream.h"
+#include <Logger.h>
+
+LiveStream::LiveStream() : server(LIVE_STREAM_PORT), socket("/live") {
+  this->last_reading[0] = '\0';
+  this->last_alarm[0] = '\0';
+  for (uint8_t i = 0; i < STREAM_BUFFER_COUNT; i++) {
+    this->buffers[i] = NULL;
+  }
+}
+
+/*
+ *This method is used to start the live stream server, it should be called once WiFi is up.
+ */
+void LiveStream::begin() {
+  this->socket.onEvent([this](AsyncWebSocket *socket, AsyncWebSocketClient *client, AwsEventType type, void *arg, uint8_t *data, size_t length) {
+    this->on_event(client, type);
+  });
+  // A locked buffer is never deleted by the socket, so the pool lives as long as the server
+  for (uint8_t i = 0; i < STREAM_BUFFER_COUNT; i++) {
+    this->buffers[i] = this->socket.makeBuffer(STREAM_FRAME_SIZE);
+    if (this->buffers[i] != NULL) {
+      this->buffers[i]->lock();
+    }
+  }
+  this->server.addHandler(&this->socket);
+  this->server.begin();
+  LOG_INFO("Live stream on port %u", LIVE_STREAM_PORT);
+}
+
+/*
+ *This method is used to track the clients as they connect and disconnect.
+ *It runs on the network task.
+ */
+void LiveStream::on_event(AsyncWebSocketClient *client, AwsEventType type) {
+  std::lock_guard<std::mutex> guard(this->lock);
+  if (type == WS_EVT_CONNECT) {
+    if (!this->policy.add(client->id())) {
+      LOG_WARN("Live stream full, client %lu refused", static_cast<unsigned long>(client->id()));
+      client->close();
+      return;
+    }
+    if (this->last_alarm[0] != '\0') {
+      client->text(this->last_alarm);
+    }
+    if (this->last_reading[0] != '\0') {
+      client->text(this->last_reading);
+    }
+  } else if (type == WS_EVT_DISCONNECT) {
+    this->policy.remove(client->id());
+  }
+}
+
+/*
+ *This method is used to pick a buffer of the pool that no client queue holds any more.
+ *The count of a buffer drops as the network task sends and frees the queued messages, canDelete() would be true but for the lock.
+ *It returns NULL if every buffer is still queued.
+ */
+AsyncWebSocketMessageBuffer *LiveStream::free_buffer() {
+  uint32_t references[STREAM_BUFFER_COUNT];
+  for (uint8_t i = 0; i < STREAM_BUFFER_COUNT; i++) {
+    references[i] = this->buffers[i] == NULL ? UINT32_MAX : this->buffers[i]->count();
+  }
+  int index = free_stream_buffer(references, STREAM_BUFFER_COUNT);
+  return index < 0 ? NULL : this->buffers[index];
+}
+
+/*
+ *This method is used to push an event to all the clients.
+ *json is the event as it is published over MQTT, it is copied once into a buffer of the pool the clients share.
+ *Clients whose queue is full skip the event or are closed, see StreamPolicy, so does every client when no buffer is free.
+ */
+void LiveStream::publish(streamEvent event, const char *json) {
+  uint32_t client_ids[STREAM_MAX_CLIENTS];
+  uint32_t send_ids[STREAM_MAX_CLIENTS];
+  uint32_t close_ids[STREAM_MAX_CLIENTS];
+  size_t send_count = 0;
+  size_t close_count = 0;
+  size_t count;
+  size_t length;
+  AsyncWebSocketMessageBuffer *buffer = NULL;
+  {
+    std::lock_guard<std::mutex> guard(this->lock);
+    char *frame = event == STREAM_ALARM ? this->last_alarm : this->last_reading;
+    length = format_stream_frame(frame, STREAM_FRAME_SIZE, event, json);
+    if (length == 0) {
+      frame[0] = '\0';
+      LOG_WARN("Live stream event too large");
+      return;
+    }
+    count = this->policy.clients(client_ids);
+    if (count == 0) {
+      return;
+    }
+    buffer = this->free_buffer();
+    if (buffer != NULL) {
+      fill_stream_buffer(buffer->get(), buffer->length(), frame, length);
+    }
+    this->policy.count_frame();
+    for (size_t i = 0; i < count; i++) {
+      AsyncWebSocketClient *client = this->socket.client(client_ids[i]);
+      if (client == NULL) {
+        this->policy.remove(client_ids[i]);
+        continue;
+      }
+      streamAction action = this->policy.admit(client_ids[i], event, buffer == NULL || client->queueIsFull());
+      if (action == STREAM_SEND) {
+        send_ids[send_count++] = client_ids[i];
+      } else if (action == STREAM_CLOSE) {
+        close_ids[close_count++] = client_ids[i];
+      }
+    }
+  }
+
+  // Closing a client can call on_event, so the lock is not held from here
+  for (size_t i = 0; i < close_count; i++) {
+    AsyncWebSocketClient *client = this->socket.client(close_ids[i]);
+    if (client != NULL) {
+      LOG_WARN("Live stream client %lu is too slow, closing it", static_cast<unsigned long>(close_ids[i]));
+      client->close();
+    }
+  }
+  // Every client queue takes a reference to the same buffer
+  // textAll is not used, it unlocks the buffer when it is done and the socket would then delete it
+  for (size_t i = 0; i < send_count; i++) {
+    AsyncWebSocketClient *client = this->socket.client(send_ids[i]);
+    if (client != NULL && client->status() == WS_CONNECTED) {
+      client->text(buffer);
+    }
+  }
+  this->socket.cleanupClients(STREAM_MAX_CLIENTS);
+}
+
+streamCounters LiveStream::get_counters() {
+  std::lock_guard<std::mutex> guard(this->lock);
+  return this->policy.get_counters();
+}
+#endif
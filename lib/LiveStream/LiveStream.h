@@ -0,0 +1,42 @@
+#ifndef LiveStream_h
+#define LiveStream_h
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include <StreamPolicy.h>
+#include <mutex>
+
+/*
+ * The live stream has its own server so it keeps running while the configuration server is started and stopped
+ * Clients connect to ws://<device ip>:LIVE_STREAM_PORT/live
+ */
+#ifndef LIVE_STREAM_PORT
+#define LIVE_STREAM_PORT 81
+#endif
+
+/*
+ * Pushes readings and alarm transitions to the browsers on the local network over a WebSocket
+ * Each event is formatted once into a buffer that the queues of all the clients share
+ * The buffers come from a pool of STREAM_BUFFER_COUNT that are allocated in begin() and locked so the WebSocket never deletes them,
+ * only the queue entry of each client is still allocated by the WebSocket for every event sent
+ * A client that connects is sent the last alarm and the last reading so it does not wait for the next event
+ */
+class LiveStream {
+  private:
+  AsyncWebServer server;
+  AsyncWebSocket socket;
+  StreamPolicy policy;
+  std::mutex lock; // the events come from the network task while the loop publishes
+  char last_reading[STREAM_FRAME_SIZE];
+  char last_alarm[STREAM_FRAME_SIZE];
+  AsyncWebSocketMessageBuffer *buffers[STREAM_BUFFER_COUNT];
+  AsyncWebSocketMessageBuffer *free_buffer();
+  void on_event(AsyncWebSocketClient *client, AwsEventType type);
+
+  public:
+  LiveStream();
+  void begin();
+  void publish(streamEvent event, const char *json);
+  streamCounters get_counters();
+};
+
+#endif
@@ -0,0 +1,150 @@
+#include "StreamPolicy.h"
+#include <stdio.h>
+#include <string.h>
+
+StreamPolicy::StreamPolicy(uint8_t max_drops) {
+  this->max_drops = max_drops == 0 ? 1 : max_drops;
+  memset(&this->counters, 0, sizeof(this->counters));
+  for (uint8_t i = 0; i < STREAM_MAX_CLIENTS; i++) {
+    this->used[i] = false;
+    this->client_ids[i] = 0;
+    this->drops[i] = 0;
+  }
+}
+
+int StreamPolicy::find(uint32_t client_id) {
+  for (uint8_t i = 0; i < STREAM_MAX_CLIENTS; i++) {
+    if (this->used[i] && this->client_ids[i] == client_id) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+/*
+ *This method is used to start tracking a client that just connected.
+ *It returns false if STREAM_MAX_CLIENTS clients are already tracked, the caller should close the connection.
+ */
+bool StreamPolicy::add(uint32_t client_id) {
+  if (this->find(client_id) >= 0) {
+    return true;
+  }
+  for (uint8_t i = 0; i < STREAM_MAX_CLIENTS; i++) {
+    if (!this->used[i]) {
+      this->used[i] = true;
+      this->client_ids[i] = client_id;
+      this->drops[i] = 0;
+      return true;
+    }
+  }
+  this->counters.refused++;
+  return false;
+}
+
+void StreamPolicy::remove(uint32_t client_id) {
+  int index = this->find(client_id);
+  if (index >= 0) {
+    this->used[index] = false;
+  }
+}
+
+/*
+ *This method is used to copy the ids of the tracked clients, client_ids must hold STREAM_MAX_CLIENTS ids.
+ *It returns the number of ids copied.
+ */
+size_t StreamPolicy::clients(uint32_t *client_ids) {
+  size_t count = 0;
+  for (uint8_t i = 0; i < STREAM_MAX_CLIENTS; i++) {
+    if (this->used[i]) {
+      client_ids[count++] = this->client_ids[i];
+    }
+  }
+  return count;
+}
+
+void StreamPolicy::count_frame() {
+  this->counters.frames++;
+}
+
+/*
+ *This method is used to decide what to do with an event for one client.
+ *queue_full is true when the client cannot take another message right now.
+ *A client that is closed is no longer tracked.
+ */
+streamAction StreamPolicy::admit(uint32_t client_id, streamEvent event, bool queue_full) {
+  int index = this->find(client_id);
+  if (index < 0) {
+    return STREAM_SKIP;
+  }
+  if (!queue_full) {
+    this->drops[index] = 0;
+    this->counters.deliveries++;
+    return STREAM_SEND;
+  }
+  this->counters.drops++;
+  this->drops[index]++;
+  if (event == STREAM_ALARM || this->drops[index] >= this->max_drops) {
+    this->used[index] = false;
+    this->counters.closed++;
+    return STREAM_CLOSE;
+  }
+  return STREAM_SKIP;
+}
+
+streamCounters StreamPolicy::get_counters() {
+  return this->counters;
+}
+
+/*
+ *A function to put the event type around the JSON of an event so the browser can tell the events apart
+ *It returns the length of the frame or 0 if it did not fit in output
+ */
+size_t format_stream_frame(char *output, size_t size, streamEvent event, const char *json) {
+  const char *type = event == STREAM_ALARM ? "alarm" : "reading";
+  int length = snprintf(output, size, "{\"type\":\"%s\",\"data\":%s}", type, json);
+  if (length < 0 || static_cast<size_t>(length) >= size) {
+    return 0;
+  }
+  return length;
+}
+
+/*
+ *A function to copy a frame into a buffer of the pool, the buffers have a fixed length so the rest is padded with spaces
+ *Whitespace after the JSON is still valid JSON, the browser parses the frame as it is
+ *It returns size or 0 if the frame does not fit
+ */
+size_t fill_stream_buffer(uint8_t *buffer, size_t size, const char *frame, size_t length) {
+  if (length > size) {
+    return 0;
+  }
+  memcpy(buffer, frame, length);
+  memset(buffer + length, ' ', size - length);
+  return size;
+}
+
+/*
+ *A function to pick a buffer of the pool that no client queue references any more
+ *references holds the number of queued messages that point at each buffer
+ *It returns the index of the buffer or -1 if they are all in use
+ */
+int free_stream_buffer(const uint32_t *references, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    if (references[i] == 0) {
+      return static_cast<int>(i);
+    }
+  }
+  return -1;
+}
+
+/*
+ *A function to write the state of the siren and the level of each enclosure as JSON
+ *e.g {"siren":"on","avian":"critical","reptilian":"ideal"}
+ */
+size_t format_alarm(char *output, size_t size, bool siren, enclosureLevels levels) {
+  int length = snprintf(output, size, "{\"siren\":\"%s\",\"avian\":\"%s\",\"reptilian\":\"%s\"}",
+                        siren ? "on" : "off", level_name(levels.avian), level_name(levels.reptilian));
+  if (length < 0 || static_cast<size_t>(length) >= size) {
+    return 0;
+  }
+  return length;
+}
@@ -0,0 +1,84 @@
+#ifndef StreamPolicy_h
+#define StreamPolicy_h
+#include <ReadingController.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Number of live stream clients that are tracked, more connections than this are refused
+ * AsyncWebSocket keeps at most 8 clients on the ESP32 by default
+ */
+#ifndef STREAM_MAX_CLIENTS
+#define STREAM_MAX_CLIENTS 8
+#endif
+
+/*
+ * Readings a client may miss in a row because its queue is full before it is closed
+ */
+#ifndef STREAM_MAX_DROPS
+#define STREAM_MAX_DROPS 8
+#endif
+
+/*
+ * A frame is the event type around the JSON of the event e.g {"type":"reading","data":{...}}
+ */
+#define STREAM_FRAME_SIZE (READING_JSON_SIZE + 32)
+
+/*
+ * Number of frame buffers the live stream keeps for the lifetime of the server
+ * A buffer is reused once no client queue holds it any more, an event that finds none free is a full queue for every client
+ */
+#ifndef STREAM_BUFFER_COUNT
+#define STREAM_BUFFER_COUNT 4
+#endif
+
+enum streamEvent {
+  STREAM_READING,
+  STREAM_ALARM
+};
+
+enum streamAction {
+  STREAM_SEND,
+  STREAM_SKIP,
+  STREAM_CLOSE
+};
+
+struct streamCounters {
+  uint32_t frames;
+  uint32_t deliveries;
+  uint32_t drops;
+  uint32_t closed;
+  uint32_t refused;
+};
+
+/*
+ * Decides for each client whether an event is queued, skipped or the client is closed
+ * A slow client misses readings, the next reading replaces the one it missed.
+ * It is closed if it misses STREAM_MAX_DROPS readings in a row or any alarm,
+ * a client never silently misses an alarm, it reconnects and gets the current state instead.
+ */
+class StreamPolicy {
+  private:
+  uint32_t client_ids[STREAM_MAX_CLIENTS];
+  uint8_t drops[STREAM_MAX_CLIENTS];
+  bool used[STREAM_MAX_CLIENTS];
+  uint8_t max_drops;
+  streamCounters counters;
+  int find(uint32_t client_id);
+
+  public:
+  StreamPolicy(uint8_t max_drops = STREAM_MAX_DROPS);
+  bool add(uint32_t client_id);
+  void remove(uint32_t client_id);
+  size_t clients(uint32_t *client_ids);
+  void count_frame();
+  streamAction admit(uint32_t client_id, streamEvent event, bool queue_full);
+  streamCounters get_counters();
+};
+
+size_t format_stream_frame(char *output, size_t size, streamEvent event, const char *json);
+size_t fill_stream_buffer(uint8_t *buffer, size_t size, const char *frame, size_t length);
+int free_stream_buffer(const uint32_t *references, size_t count);
+size_t format_alarm(char *output, size_t size, bool siren, enclosureLevels levels);
+
+#endif
@@ -0,0 +1,240 @@
+#include "Logger.h"
+#include <stdio.h>
+#include <string.h>
+#ifdef ARDUINO
+#include <Arduino.h>
+#else
+#include <chrono>
+#endif
+
+static_assert((LOG_QUEUE_SIZE & (LOG_QUEUE_SIZE - 1)) == 0, "LOG_QUEUE_SIZE must be a power of two");
+
+/*
+ * Messages written by the application and drained to Serial by the log task
+ */
+static LogQueue log_queue;
+/*
+ * Messages copied by the log task to be published by the loop, the MQTT client is not safe to use from another task
+ */
+static LogQueue mqtt_queue;
+static bool forward_to_mqtt = false;
+static uint32_t reported_drops = 0;
+
+static const char level_names[] = {'-', 'E', 'W', 'I', 'D'};
+
+/*
+ * The time a message was written and where drained messages go
+ * On the native build the time is taken from the start of the program and the messages go to stdout
+ */
+#ifdef ARDUINO
+static uint32_t log_clock() {
+  return millis();
+}
+
+static void log_output(const char *line) {
+  Serial.print(line);
+}
+#else
+static uint32_t log_clock() {
+  static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count());
+}
+
+static void log_output(const char *line) {
+  fputs(line, stdout);
+}
+#endif
+
+LogQueue::LogQueue() {
+  for (uint32_t i = 0; i < LOG_QUEUE_SIZE; i++) {
+    this->entries[i].sequence.store(i, std::memory_order_relaxed);
+  }
+  this->write_position.store(0, std::memory_order_relaxed);
+  this->read_position.store(0, std::memory_order_relaxed);
+  this->dropped.store(0, std::memory_order_relaxed);
+}
+
+/*
+ *This method is used to claim the next free slot.
+ *A slot is free when its sequence number equals the write position,
+ *writers race for it with a compare and swap on the write position so no lock is taken.
+ *It returns NULL and counts a dropped message if the queue is full.
+ */
+logEntry *LogQueue::reserve(uint32_t *position) {
+  uint32_t current = this->write_position.load(std::memory_order_relaxed);
+  while (true) {
+    logEntry *entry = &this->entries[current & (LOG_QUEUE_SIZE - 1)];
+    uint32_t sequence = entry->sequence.load(std::memory_order_acquire);
+    int32_t difference = static_cast<int32_t>(sequence - current);
+    if (difference == 0) {
+      if (this->write_position.compare_exchange_weak(current, current + 1, std::memory_order_relaxed)) {
+        *position = current;
+        return entry;
+      }
+    } else if (difference < 0) {
+      this->dropped.fetch_add(1, std::memory_order_relaxed);
+      return NULL;
+    } else {
+      current = this->write_position.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+/*
+ *This method is used to format a message straight into a slot of the queue.
+ *It returns false if the message was dropped.
+ */
+bool LogQueue::push(uint8_t level, uint32_t timestamp, const char *format, va_list args) {
+  uint32_t position;
+  logEntry *entry = this->reserve(&position);
+  if (entry == NULL) {
+    return false;
+  }
+  entry->level = level;
+  entry->timestamp = timestamp;
+  vsnprintf(entry->text, LOG_LINE_SIZE, format, args);
+  entry->sequence.store(position + 1, std::memory_order_release);
+  return true;
+}
+
+bool LogQueue::push_text(uint8_t level, uint32_t timestamp, const char *text) {
+  uint32_t position;
+  logEntry *entry = this->reserve(&position);
+  if (entry == NULL) {
+    return false;
+  }
+  entry->level = level;
+  entry->timestamp = timestamp;
+  strncpy(entry->text, text, LOG_LINE_SIZE - 1);
+  entry->text[LOG_LINE_SIZE - 1] = '\0';
+  entry->sequence.store(position + 1, std::memory_order_release);
+  return true;
+}
+
+/*
+ *This method is used to take the oldest message out of the queue.
+ *text must hold LOG_LINE_SIZE characters.
+ *It returns false if the queue is empty or the oldest message is still being written.
+ */
+bool LogQueue::pop(uint8_t *level, uint32_t *timestamp, char *text) {
+  uint32_t current = this->read_position.load(std::memory_order_relaxed);
+  logEntry *entry;
+  while (true) {
+    entry = &this->entries[current & (LOG_QUEUE_SIZE - 1)];
+    uint32_t sequence = entry->sequence.load(std::memory_order_acquire);
+    int32_t difference = static_cast<int32_t>(sequence - (current + 1));
+    if (difference == 0) {
+      if (this->read_position.compare_exchange_weak(current, current + 1, std::memory_order_relaxed)) {
+        break;
+      }
+    } else if (difference < 0) {
+      return false;
+    } else {
+      current = this->read_position.load(std::memory_order_relaxed);
+    }
+  }
+  *level = entry->level;
+  *timestamp = entry->timestamp;
+  memcpy(text, entry->text, LOG_LINE_SIZE);
+  entry->sequence.store(current + LOG_QUEUE_SIZE, std::memory_order_release);
+  return true;
+}
+
+uint32_t LogQueue::dropped_count() {
+  return this->dropped.load(std::memory_order_relaxed);
+}
+
+#ifdef ESP32
+/*
+ * The log task drains the queue to Serial so the tasks that log never wait for the UART
+ * It runs at a low priority on the core the loop does not use
+ */
+static void log_task(void *parameter) {
+  while (true) {
+    log_drain();
+    vTaskDelay(pdMS_TO_TICKS(20));
+  }
+}
+#endif
+
+/*
+ *A function to start draining the log queue
+ *Messages written before this are kept in the queue until the task starts
+ *If forward is true, messages at or below LOG_MQTT_LEVEL are also kept for log_publish()
+ */
+void log_begin(bool forward) {
+  forward_to_mqtt = forward;
+#ifdef ESP32
+  xTaskCreatePinnedToCore(log_task, "log", 3072, NULL, tskIDLE_PRIORITY + 1, NULL, 0);
+#endif
+}
+
+/*
+ *A function to format a message into the log queue
+ *It does not block, if the queue is full the message is dropped and counted
+ *Use the LOG_ERROR, LOG_WARN, LOG_INFO and LOG_DEBUG macros so that disabled levels are not compiled in
+ */
+void log_write(uint8_t level, const char *format, ...) {
+  va_list args;
+  va_start(args, format);
+  log_queue.push(level, log_clock(), format, args);
+  va_end(args);
+}
+
+/*
+ *A function to write the queued messages to Serial, or stdout on the native build
+ *It reports how many messages were dropped since the last report
+ *It returns the number of messages written
+ */
+size_t log_drain() {
+  char text[LOG_LINE_SIZE];
+  char line[LOG_OUTPUT_SIZE];
+  uint8_t level;
+  uint32_t timestamp;
+  size_t count = 0;
+
+  uint32_t drops = log_queue.dropped_count();
+  if (drops != reported_drops) {
+    snprintf(line, sizeof(line), "[%lu][W] %lu log messages dropped\r\n", static_cast<unsigned long>(log_clock()), static_cast<unsigned long>(drops - reported_drops));
+    log_output(line);
+    reported_drops = drops;
+  }
+
+  while (log_queue.pop(&level, &timestamp, text)) {
+    snprintf(line, sizeof(line), "[%lu][%c] %s\r\n", static_cast<unsigned long>(timestamp), level_names[level], text);
+    log_output(line);
+    if (forward_to_mqtt && level <= LOG_MQTT_LEVEL) {
+      mqtt_queue.push_text(level, timestamp, text);
+    }
+    count++;
+  }
+  return count;
+}
+
+/*
+ *A function to publish the forwarded messages, it must be called from the task that owns the MQTT client
+ *It stops at the first message the publisher fails to send, that message is lost
+ *It returns the number of messages published
+ */
+size_t log_publish(logPublisher publisher) {
+  char text[LOG_LINE_SIZE];
+  char line[LOG_OUTPUT_SIZE];
+  uint8_t level;
+  uint32_t timestamp;
+  size_t count = 0;
+  while (mqtt_queue.pop(&level, &timestamp, text)) {
+    snprintf(line, sizeof(line), "[%lu][%c] %s", static_cast<unsigned long>(timestamp), level_names[level], text);
+    if (!publisher(line)) {
+      break;
+    }
+    count++;
+  }
+  return count;
+}
+
+/*
+ *A function to get the number of messages dropped because the queue was full
+ */
+uint32_t log_dropped() {
+  return log_queue.dropped_count() + mqtt_queue.dropped_count();
+}
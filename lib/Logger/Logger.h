@@ -0,0 +1,126 @@
+#ifndef Logger_h
+#define Logger_h
+#include <atomic>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Log levels, a message is only compiled in if its level is at or below LOG_LEVEL
+ * Set LOG_LEVEL with a build flag e.g -DLOG_LEVEL=LOG_LEVEL_DEBUG
+ */
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+/*
+ * Messages at or below this level are also published on the "logs" topic when forwarding is enabled
+ */
+#ifndef LOG_MQTT_LEVEL
+#define LOG_MQTT_LEVEL LOG_LEVEL_WARN
+#endif
+
+/*
+ * Size of one formatted message including the null terminator, longer messages are truncated
+ */
+#ifndef LOG_LINE_SIZE
+#define LOG_LINE_SIZE 96
+#endif
+
+/*
+ * Size of a message with its "[<10 digit timestamp>][<level>] " prefix and the line ending, so the line ending is never cut off
+ */
+#define LOG_OUTPUT_SIZE (LOG_LINE_SIZE + 19)
+
+/*
+ * Number of messages the queue can hold, it must be a power of two
+ * Messages written while the queue is full are dropped and counted
+ */
+#ifndef LOG_QUEUE_SIZE
+#define LOG_QUEUE_SIZE 32
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR(...) log_write(LOG_LEVEL_ERROR, __VA_ARGS__)
+#else
+#define LOG_ERROR(...) \
+  do {                 \
+  } while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_WARN(...) log_write(LOG_LEVEL_WARN, __VA_ARGS__)
+#else
+#define LOG_WARN(...) \
+  do {                \
+  } while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(...) log_write(LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define LOG_INFO(...) \
+  do {                \
+  } while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) log_write(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) \
+  do {                 \
+  } while (0)
+#endif
+
+/*
+ * Wrap passwords and other secrets that are passed to a log message
+ * They are replaced unless the firmware is built with -DLOG_SHOW_SECRETS
+ */
+#ifdef LOG_SHOW_SECRETS
+#define LOG_SECRET(value) (value)
+#else
+#define LOG_SECRET(value) "<redacted>"
+#endif
+
+struct logEntry {
+  std::atomic<uint32_t> sequence;
+  uint32_t timestamp;
+  uint8_t level;
+  char text[LOG_LINE_SIZE];
+};
+
+/*
+ * A fixed-size lock-free queue of formatted messages
+ * Any task can write to it, each slot has a sequence number that tells writers and the reader whether it is free or filled
+ */
+class LogQueue {
+  private:
+  logEntry entries[LOG_QUEUE_SIZE];
+  std::atomic<uint32_t> write_position;
+  std::atomic<uint32_t> read_position;
+  std::atomic<uint32_t> dropped;
+  logEntry *reserve(uint32_t *position);
+
+  public:
+  LogQueue();
+  bool push(uint8_t level, uint32_t timestamp, const char *format, va_list args);
+  bool push_text(uint8_t level, uint32_t timestamp, const char *text);
+  bool pop(uint8_t *level, uint32_t *timestamp, char *text);
+  uint32_t dropped_count();
+};
+
+typedef bool (*logPublisher)(const char *text);
+
+void log_begin(bool forward_to_mqtt);
+void log_write(uint8_t level, const char *format, ...);
+size_t log_drain();
+size_t log_publish(logPublisher publisher);
+uint32_t log_dropped();
+
+#endif
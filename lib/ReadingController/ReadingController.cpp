@@ -1,17 +1,24 @@
 #include "ReadingController.h"
-#include <Arduino.h>
 #include <ArduinoJson.h>
+#include <Logger.h>
+#include <stdio.h>
+#include <string.h>
 
 ApplicationReading::ApplicationReading() {
-  char ideal[] = "ideal";
-  char empty[] = "";
-  this->status.decision = ideal;
-  this->status.enclosure[0] = empty;
-  this->status.enclosure[1] = empty;
-  this->avian.temperature = 0.0;
-  this->avian.humidity = 0.0;
-  this->reptilian.temperature = 0.0;
-  this->reptilian.humidity = 0.0;
+  this->status.decision = "ideal";
+  this->status.enclosure[0] = "";
+  this->status.enclosure[1] = "";
+  this->avian.temperature = 0;
+  this->avian.humidity = 0;
+  this->reptilian.temperature = 0;
+  this->reptilian.humidity = 0;
+  this->raw_avian = this->avian;
+  this->raw_reptilian = this->reptilian;
+  this->include_raw = false;
+  this->stamp.time_ms = 0;
+  this->stamp.sequence = 0;
+  this->stamp.boot_id = 0;
+  this->stamp.quality = CLOCK_UNSYNCED;
 }
 
 /*
@@ -20,11 +27,8 @@ ApplicationReading::ApplicationReading() {
  *The method copies the data from the struct into the private variable of the class.
  */
 void ApplicationReading::set_status(readingStatus *status) {
-  Serial.print("Setting status,decision: ");
-  Serial.println(status->decision);
   memcpy(&this->status, status, sizeof(readingStatus));
-  Serial.print("Status.decision set to: ");
-  Serial.println(this->status.decision);
+  LOG_DEBUG("Status.decision set to: %s", this->status.decision);
 }
 
 /*
@@ -37,61 +41,300 @@ void ApplicationReading::set_reading(reading *avian, reading *reptilian) {
   memcpy(&this->reptilian, reptilian, sizeof(reading));
 }
 
+/*
+ *This method is used to set the unfiltered readings of the avian and reptilian enclosures.
+ *They are only added to the JSON string if publishing raw readings is enabled.
+ */
+void ApplicationReading::set_raw_reading(reading *avian, reading *reptilian) {
+  memcpy(&this->raw_avian, avian, sizeof(reading));
+  memcpy(&this->raw_reptilian, reptilian, sizeof(reading));
+}
+
+/*
+ *This method is used to set when the sensors were read, the stamp is published with the reading.
+ */
+void ApplicationReading::set_stamp(const sampleStamp *stamp) {
+  this->stamp = *stamp;
+}
+
+/*
+ *This method is used to enable or disable publishing the raw readings alongside the filtered ones.
+ */
+void ApplicationReading::publish_raw(bool enabled) {
+  this->include_raw = enabled;
+}
+
+/*
+ *This method is used to set the status from the level of one reading.
+ *severity is the most severe level seen so far in this reading, it ensures that the status is not downgraded.
+ *A reading only sets the status to ideal if nothing before it was a warning or critical,
+ *a warning or critical reading replaces a status of the same or a lower level.
+ */
+void ApplicationReading::update_status(readingLevel level, const char *enclosure, const char *measurement, uint8_t *severity) {
+  readingStatus status;
+  if (level == LEVEL_IDEAL && *severity == 0) {
+    status.decision = "ideal";
+    status.enclosure[0] = "";
+    status.enclosure[1] = "";
+    this->set_status(&status);
+  } else if (level != LEVEL_IDEAL && *severity <= level) {
+    *severity = level;
+    status.decision = level_name(level);
+    status.enclosure[0] = enclosure;
+    status.enclosure[1] = measurement;
+    this->set_status(&status);
+  }
+}
+
+/*
+ *This method is used to check the readings against the limits and set the status.
+ *The status names the last of the readings with the most severe level, the checks run in the order
+ *avian temperature, avian humidity, reptilian temperature, reptilian humidity.
+ *The method returns the most severe level of each enclosure.
+ */
+enclosureLevels ApplicationReading::analyze(const Limits *limits) {
+  uint8_t severity = 0; // 0 = ideal, 1 = warning, 2 = critical
+  readingLevel avian_temperature = classify_reading(this->avian.temperature, limits->avian_temp_limits);
+  this->update_status(avian_temperature, "avian", "temperature", &severity);
+  readingLevel avian_humidity = classify_reading(this->avian.humidity, limits->avian_humid_limits);
+  this->update_status(avian_humidity, "avian", "humidity", &severity);
+  readingLevel reptilian_temperature = classify_reading(this->reptilian.temperature, limits->reptile_temp_limits);
+  this->update_status(reptilian_temperature, "reptilian", "temperature", &severity);
+  readingLevel reptilian_humidity = classify_reading(this->reptilian.humidity, limits->reptile_humid_limits);
+  this->update_status(reptilian_humidity, "reptilian", "humidity", &severity);
+
+  enclosureLevels levels;
+  levels.avian = avian_temperature > avian_humidity ? avian_temperature : avian_humidity;
+  levels.reptilian = reptilian_temperature > reptilian_humidity ? reptilian_temperature : reptilian_humidity;
+  return levels;
+}
+
+/*
+ *A function to add a 64 bit number to a JSON object without depending on ArduinoJson being built with long long support.
+ *The number is formatted into buffer which must stay alive until the document is serialized.
+ */
+static void add_uint64(JsonObject object, const char *key, uint64_t value, char *buffer, size_t size) {
+  snprintf(buffer, size, "%llu", static_cast<unsigned long long>(value));
+  object[key] = serialized(static_cast<const char *>(buffer));
+}
+
+/*
+ *A function to add a centi_t to a JSON object as a decimal number.
+ *The number is formatted into buffer which must stay alive until the document is serialized.
+ */
+static void add_centi(JsonObject object, const char *key, centi_t value, char *buffer) {
+  format_centi(value, buffer, CENTI_STRING_SIZE);
+  object[key] = serialized(static_cast<const char *>(buffer));
+}
+
 /*
  *This method is used to convert the data in the class into a JSON string.
- *The method uses the ArduinoJson library to convert the data into a JSON string.
- *The method returns the JSON string.
+ *The method uses the ArduinoJson library to write the JSON string into output.
+ *The method returns the length of the JSON string, READING_JSON_SIZE is enough for any reading.
  */
-String ApplicationReading::stringify_reading() {
+size_t ApplicationReading::stringify_reading(char *output, size_t size) {
   StaticJsonDocument<512> doc;
 
+  // When and in what order the sample was taken, see SampleClock
+  // ts is milliseconds since the epoch, or since boot when clk is 0
+  char time[24];
+  char boot[12];
+  JsonObject root = doc.to<JsonObject>();
+  add_uint64(root, "ts", this->stamp.time_ms, time, sizeof(time));
+  doc["seq"] = this->stamp.sequence;
+  snprintf(boot, sizeof(boot), "%08lx", static_cast<unsigned long>(this->stamp.boot_id));
+  doc["boot"] = static_cast<const char *>(boot);
+  doc["clk"] = static_cast<uint8_t>(this->stamp.quality);
+
   // Create a nested "status" object and add "decision" and "enclosure" fields
+  // The strings are literals so they are stored by pointer without copying
   JsonObject status = doc.createNestedObject("status");
-  // Use strncpy to copy the character array to a char array and ensure null termination
-  char decision[10];
-  strncpy(decision, this->status.decision, sizeof(decision) - 1);
-  decision[sizeof(decision) - 1] = '\0';
-  status["decision"] = decision;
+  status["decision"] = this->status.decision;
   JsonArray enclosure = status.createNestedArray("enclosure");
-  char enclosure0[10];
-  strncpy(enclosure0, this->status.enclosure[0], sizeof(enclosure0) - 1);
-  enclosure0[sizeof(enclosure0) - 1] = '\0';
-  enclosure.add(enclosure0);
-  char enclosure1[15];
-  strncpy(enclosure1, this->status.enclosure[1], sizeof(enclosure1) - 1);
-  enclosure1[sizeof(enclosure1) - 1] = '\0';
-  enclosure.add(enclosure1);
+  enclosure.add(this->status.enclosure[0]);
+  enclosure.add(this->status.enclosure[1]);
+
+  // The readings are written straight from hundredths, this holds the text until the document is serialized
+  char numbers[8][CENTI_STRING_SIZE];
 
   // Create nested "avian" object and add "temperature" and "humidity" fields
   JsonObject avian = doc.createNestedObject("avian");
-  avian["temperature"] = this->avian.temperature;
-  avian["humidity"] = this->avian.humidity;
+  add_centi(avian, "temperature", this->avian.temperature, numbers[0]);
+  add_centi(avian, "humidity", this->avian.humidity, numbers[1]);
+  if (this->include_raw) {
+    add_centi(avian, "raw_temperature", this->raw_avian.temperature, numbers[2]);
+    add_centi(avian, "raw_humidity", this->raw_avian.humidity, numbers[3]);
+  }
 
   // Create nested "reptilian" object and add "temperature" and "humidity" fields
   JsonObject reptilian = doc.createNestedObject("reptilian");
-  reptilian["temperature"] = this->reptilian.temperature;
-  reptilian["humidity"] = this->reptilian.humidity;
-
-  // Serialize the JSON document to a String
-  String output;
-  serializeJson(doc, output);
+  add_centi(reptilian, "temperature", this->reptilian.temperature, numbers[4]);
+  add_centi(reptilian, "humidity", this->reptilian.humidity, numbers[5]);
+  if (this->include_raw) {
+    add_centi(reptilian, "raw_temperature", this->raw_reptilian.temperature, numbers[6]);
+    add_centi(reptilian, "raw_humidity", this->raw_reptilian.humidity, numbers[7]);
+  }
 
-  // Return the JSON string
-  return output;
+  // Serialize the JSON document into the output buffer
+  return serializeJson(doc, output, size);
 }
 
 /*
  *This method is used to reset the data in the class.
- *The method sets the status to "ideal" and the readings to 0.0.
+ *The method sets the status to "ideal" and the readings to 0.
  */
 void ApplicationReading::reset() {
-  char ideal[] = "ideal";
-  char empty[] = "";
-  this->status.decision = ideal;
-  this->status.enclosure[0] = empty;
-  this->status.enclosure[1] = empty;
-  this->avian.temperature = 0.0;
-  this->avian.humidity = 0.0;
-  this->reptilian.temperature = 0.0;
-  this->reptilian.humidity = 0.0;
-}
\ No newline at end of file
+  this->status.decision = "ideal";
+  this->status.enclosure[0] = "";
+  this->status.enclosure[1] = "";
+  this->avian.temperature = 0;
+  this->avian.humidity = 0;
+  this->reptilian.temperature = 0;
+  this->reptilian.humidity = 0;
+  this->raw_avian = this->avian;
+  this->raw_reptilian = this->reptilian;
+}
+
+/*
+ *A function to widen a range so that it includes value
+ */
+static void include_in_range(readingRange *r, centi_t value, bool first) {
+  if (first || value < r->minimum) {
+    r->minimum = value;
+  }
+  if (first || value > r->maximum) {
+    r->maximum = value;
+  }
+}
+
+ApplicationStats::ApplicationStats() {
+  this->samples = 0;
+  this->commands = 0;
+  this->max_command_us = 0;
+  this->loops = 0;
+  this->total_loop_us = 0;
+  this->max_loop_us = 0;
+  this->log_drops = 0;
+  this->retransmitted = 0;
+  this->publish_drops = 0;
+  this->publish_expired = 0;
+  this->stalls = 0;
+  this->sensor_failures = 0;
+  this->wakes = 0;
+  this->duty_permille = 1000;
+  for (uint8_t i = 0; i < 2; i++) {
+    this->avian[i].minimum = 0;
+    this->avian[i].maximum = 0;
+    this->reptilian[i].minimum = 0;
+    this->reptilian[i].maximum = 0;
+  }
+}
+
+/*
+ *This method is used to add a filtered reading to the statistics.
+ */
+void ApplicationStats::record_reading(reading *avian, reading *reptilian) {
+  bool first = this->samples == 0;
+  include_in_range(&this->avian[0], avian->temperature, first);
+  include_in_range(&this->avian[1], avian->humidity, first);
+  include_in_range(&this->reptilian[0], reptilian->temperature, first);
+  include_in_range(&this->reptilian[1], reptilian->humidity, first);
+  this->samples++;
+}
+
+/*
+ *This method is used to count a handled command and keep the longest time a handler took.
+ */
+void ApplicationStats::record_command(uint32_t duration_us) {
+  this->commands++;
+  if (duration_us > this->max_command_us) {
+    this->max_command_us = duration_us;
+  }
+}
+
+/*
+ *This method is used to add the time one pass of the loop took.
+ */
+void ApplicationStats::record_loop(uint32_t duration_us) {
+  this->loops++;
+  this->total_loop_us += duration_us;
+  if (duration_us > this->max_loop_us) {
+    this->max_loop_us = duration_us;
+  }
+}
+
+/*
+ *This method is used to set the number of log messages dropped because the log queue was full.
+ */
+void ApplicationStats::record_log_drops(uint32_t drops) {
+  this->log_drops = drops;
+}
+
+/*
+ *This method is used to set the counters of the QoS 1 publisher.
+ *dropped counts messages that found the window full and expired counts messages given up after too many retransmissions.
+ */
+void ApplicationStats::record_publishes(uint32_t retransmitted, uint32_t dropped, uint32_t expired) {
+  this->retransmitted = retransmitted;
+  this->publish_drops = dropped;
+  this->publish_expired = expired;
+}
+
+/*
+ *This method is used to set the number of loop stages that went over their deadline and of failed sensor reads.
+ */
+void ApplicationStats::record_health(uint32_t stalls, uint32_t sensor_failures) {
+  this->stalls = stalls;
+  this->sensor_failures = sensor_failures;
+}
+
+/*
+ *This method is used to set how many times the loop woke from sleep and the share of the time it was awake in thousandths.
+ */
+void ApplicationStats::record_sleep(uint32_t wakes, uint16_t duty_permille) {
+  this->wakes = wakes;
+  this->duty_permille = duty_permille;
+}
+
+/*
+ *This method is used to convert the statistics into a JSON string written into output.
+ *rejected holds the number of samples rejected by the filter for each of the four channels.
+ *The method returns the length of the JSON string, STATS_JSON_SIZE is enough for the statistics.
+ */
+size_t ApplicationStats::stringify_stats(char *output, size_t size, uint32_t uptime_s, uint32_t interval_s, const uint32_t *rejected) {
+  StaticJsonDocument<768> doc;
+  doc["uptime"] = uptime_s;
+  doc["interval"] = interval_s;
+  doc["samples"] = this->samples;
+  doc["commands"] = this->commands;
+  doc["max_command_us"] = this->max_command_us;
+  doc["mean_loop_us"] = this->loops == 0 ? 0 : static_cast<uint32_t>(this->total_loop_us / this->loops);
+  doc["max_loop_us"] = this->max_loop_us;
+  doc["log_drops"] = this->log_drops;
+  doc["retransmitted"] = this->retransmitted;
+  doc["publish_drops"] = this->publish_drops;
+  doc["publish_expired"] = this->publish_expired;
+  doc["stalls"] = this->stalls;
+  doc["sensor_failures"] = this->sensor_failures;
+  doc["wakes"] = this->wakes;
+  doc["duty_permille"] = this->duty_permille;
+
+  // The ranges are written straight from hundredths, this holds the text until the document is serialized
+  char numbers[8][CENTI_STRING_SIZE];
+  const char *measurements[2] = {"temperature", "humidity"};
+  JsonObject avian = doc.createNestedObject("avian");
+  JsonObject reptilian = doc.createNestedObject("reptilian");
+  for (uint8_t i = 0; i < 2; i++) {
+    JsonObject avian_range = avian.createNestedObject(measurements[i]);
+    add_centi(avian_range, "min", this->avian[i].minimum, numbers[i * 4]);
+    add_centi(avian_range, "max", this->avian[i].maximum, numbers[i * 4 + 1]);
+    avian_range["rejected"] = rejected[i];
+
+    JsonObject reptilian_range = reptilian.createNestedObject(measurements[i]);
+    add_centi(reptilian_range, "min", this->reptilian[i].minimum, numbers[i * 4 + 2]);
+    add_centi(reptilian_range, "max", this->reptilian[i].maximum, numbers[i * 4 + 3]);
+    reptilian_range["rejected"] = rejected[i + 2];
+  }
+
+  return serializeJson(doc, output, size);
+}
@@ -1,15 +1,39 @@
 #ifndef ReadingController_h
 #define ReadingController_h
-#include <Arduino.h>
+#include <Classifier.h>
+#include <FixedPoint.h>
+#include <SampleClock.h>
+#include <stddef.h>
+#include <stdint.h>
 
+/*
+ * Size of the buffers the readings and the statistics are serialized into
+ */
+#define READING_JSON_SIZE 384
+#define STATS_JSON_SIZE 704
+
+/*
+ * The strings are string literals so the struct can be copied without copying the text
+ */
 struct readingStatus {
-  char *decision;
-  char *enclosure[2]; // enclosure[0] = "avian",enclosure[1] = "temperature"
+  const char *decision;
+  const char *enclosure[2]; // enclosure[0] = "avian",enclosure[1] = "temperature"
 };
 
+/*
+ * Temperature and humidity in hundredths of a unit
+ */
 struct reading {
-  float temperature;
-  float humidity;
+  centi_t temperature;
+  centi_t humidity;
+};
+
+/*
+ * The most severe level of the readings of each enclosure
+ */
+struct enclosureLevels {
+  readingLevel avian;
+  readingLevel reptilian;
 };
 
 class ApplicationReading {
@@ -17,13 +41,64 @@ class ApplicationReading {
   readingStatus status;
   reading avian;
   reading reptilian;
+  reading raw_avian;
+  reading raw_reptilian;
+  sampleStamp stamp;
+  bool include_raw;
+  void update_status(readingLevel level, const char *enclosure, const char *measurement, uint8_t *severity);
 
   public:
   ApplicationReading();
   void set_status(readingStatus *status);
   void set_reading(reading *avian, reading *reptilian);
-  String stringify_reading();
+  void set_raw_reading(reading *avian, reading *reptilian);
+  void set_stamp(const sampleStamp *stamp);
+  void publish_raw(bool enabled);
+  enclosureLevels analyze(const Limits *limits);
+  size_t stringify_reading(char *output, size_t size);
   void reset();
 };
 
+/*
+ * Minimum and maximum of a measurement since boot in hundredths
+ */
+struct readingRange {
+  centi_t minimum;
+  centi_t maximum;
+};
+
+/*
+ * Statistics that are published when the "publish stats" command is received
+ */
+class ApplicationStats {
+  private:
+  uint32_t samples;
+  readingRange avian[2]; // avian[0] = temperature, avian[1] = humidity
+  readingRange reptilian[2];
+  uint32_t commands;
+  uint32_t max_command_us;
+  uint32_t loops;
+  uint64_t total_loop_us;
+  uint32_t max_loop_us;
+  uint32_t log_drops;
+  uint32_t retransmitted;
+  uint32_t publish_drops;
+  uint32_t publish_expired;
+  uint32_t stalls;
+  uint32_t sensor_failures;
+  uint32_t wakes;
+  uint16_t duty_permille;
+
+  public:
+  ApplicationStats();
+  void record_reading(reading *avian, reading *reptilian);
+  void record_command(uint32_t duration_us);
+  void record_loop(uint32_t duration_us);
+  void record_log_drops(uint32_t drops);
+  void record_publishes(uint32_t retransmitted, uint32_t dropped, uint32_t expired);
+  void record_health(uint32_t stalls, uint32_t sensor_failures);
+  void record_sleep(uint32_t wakes, uint16_t duty_permille);
+  size_t stringify_stats(char *output, size_t size, uint32_t uptime_s, uint32_t interval_s, const uint32_t *rejected);
+};
+
 #endif
\ No newline at end of file
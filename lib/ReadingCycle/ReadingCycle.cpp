@@ -0,0 +1,128 @@
+#include "ReadingCycle.h"
+#include <BoardProfile.h>
+#include <CommandChannel.h>
+
+ReadingCycle::ReadingCycle(SensorSet *sensors, SleepScheduler *scheduler, ApplicationFilter *filter, SampleClock *clock, ApplicationReading *current,
+                           AlarmController *alarm, ApplicationStats *stats) {
+  this->sensors = sensors;
+  this->scheduler = scheduler;
+  this->filter = filter;
+  this->clock = clock;
+  this->current = current;
+  this->alarm = alarm;
+  this->stats = stats;
+  this->sample_event = -1;
+  this->sensor_event = -1;
+  this->failures = 0;
+}
+
+/*
+ *This method is used to add the events of the acquisition to the scheduler, the first reading is taken straight away.
+ */
+void ReadingCycle::begin(uint32_t interval_ms) {
+  this->sample_event = this->scheduler->add(interval_ms);
+  this->sensor_event = this->scheduler->add(SENSOR_TIMEOUT_MS);
+  this->scheduler->set_enabled(this->sensor_event, false);
+  this->scheduler->run_in(this->sample_event, 0);
+}
+
+void ReadingCycle::set_interval(uint32_t interval_ms) {
+  this->scheduler->set_period(this->sample_event, interval_ms);
+}
+
+/*
+ *This method is used to start the conversions of all the sensors when the interval is up or a reading is requested.
+ *It returns true if they were started, a request made while the sensors convert waits for the next pass.
+ */
+bool ReadingCycle::start(bool requested) {
+  if (this->sensors->converting() || !(this->scheduler->due(this->sample_event) || requested)) {
+    return false;
+  }
+  this->sensors->start();
+  this->scheduler->restart(this->sample_event);
+  this->scheduler->run_in(this->sensor_event, this->sensors->next_poll_in());
+  return true;
+}
+
+/*
+ *This method is used to collect the results of the conversions when the drivers expect them.
+ *A read that failed is tried again after SENSOR_RETRY_MS instead of holding up the loop.
+ */
+readingStep ReadingCycle::poll() {
+  this->scheduler->set_enabled(this->sensor_event, this->sensors->converting());
+  if (!this->scheduler->due(this->sensor_event)) {
+    return READING_NONE;
+  }
+  readingStep step = READING_NONE;
+  if (!this->sensors->poll()) {
+    this->scheduler->run_in(this->sensor_event, this->sensors->next_poll_in());
+  } else if (this->collect()) {
+    step = READING_TAKEN;
+  } else {
+    this->failures++;
+    this->scheduler->run_in(this->sample_event, SENSOR_RETRY_MS);
+    step = READING_FAILED;
+  }
+  this->scheduler->set_enabled(this->sensor_event, this->sensors->converting());
+  return step;
+}
+
+/*
+ *This method is used to set the reading from the acquisition that just finished, it returns false if one of the sensors did not answer.
+ *The sample is stamped as soon as the sensors have been read, not when it is published.
+ *The drivers already give hundredths so nothing here uses floating point.
+ */
+bool ReadingCycle::collect() {
+  sensorSample avian_sample;
+  sensorSample reptile_sample;
+  if (!this->sensors->get_sample(ENCLOSURE_AVIAN, &avian_sample) || !this->sensors->get_sample(ENCLOSURE_REPTILE, &reptile_sample)) {
+    return false;
+  }
+  sampleStamp stamp = this->clock->stamp();
+  this->current->set_stamp(&stamp);
+
+  reading raw_avian = {avian_sample.temperature, avian_sample.humidity};
+  reading raw_reptilian = {reptile_sample.temperature, reptile_sample.humidity};
+  this->current->set_raw_reading(&raw_avian, &raw_reptilian);
+
+  reading avian = {this->filter->filter(AVIAN_TEMPERATURE, raw_avian.temperature), this->filter->filter(AVIAN_HUMIDITY, raw_avian.humidity)};
+  reading reptilian = {this->filter->filter(REPTILE_TEMPERATURE, raw_reptilian.temperature),
+                       this->filter->filter(REPTILE_HUMIDITY, raw_reptilian.humidity)};
+  this->current->set_reading(&avian, &reptilian);
+  if (this->stats != NULL) {
+    this->stats->record_reading(&avian, &reptilian);
+  }
+  return true;
+}
+
+/*
+ *This method is used to analyze the reading that was just taken, update the siren and serialize the reading into output.
+ *The reading is reset afterwards, so it is called once per reading.
+ */
+readingOutcome ReadingCycle::evaluate(const Limits *limits, char *output, size_t size) {
+  readingOutcome outcome;
+  outcome.levels = this->current->analyze(limits);
+  outcome.change = this->alarm->update(outcome.levels);
+  outcome.length = this->current->stringify_reading(output, size);
+  this->current->reset();
+  return outcome;
+}
+
+/*
+ *This method is used to get the number of reads that failed since boot.
+ */
+uint32_t ReadingCycle::get_failures() {
+  return this->failures;
+}
+
+/*
+ *A function to parse the payload of the "set interval" command, the interval in seconds between READ_INTERVAL_MIN_S and READ_INTERVAL_MAX_S.
+ */
+bool parse_read_interval(const uint8_t *payload, unsigned int length, uint32_t *interval_ms) {
+  uint32_t seconds;
+  if (!payload_to_uint(payload, length, &seconds) || seconds < READ_INTERVAL_MIN_S || seconds > READ_INTERVAL_MAX_S) {
+    return false;
+  }
+  *interval_ms = seconds * 1000;
+  return true;
+}
@@ -0,0 +1,78 @@
+#ifndef ReadingCycle_h
+#define ReadingCycle_h
+#include <AlarmController.h>
+#include <ReadingController.h>
+#include <SampleClock.h>
+#include <SensorDriver.h>
+#include <SensorFilter.h>
+#include <SleepScheduler.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Bounds of the interval between readings set with the "set interval" command, in seconds
+ * The DHT11 cannot be read more often than every 2 seconds
+ */
+#define READ_INTERVAL_MIN_S 2
+#define READ_INTERVAL_MAX_S 3600
+
+/*
+ * Time before a read that failed is tried again, the DHT11 cannot be read again sooner than 2 seconds after the last read
+ */
+#ifndef SENSOR_RETRY_MS
+#define SENSOR_RETRY_MS 2500
+#endif
+
+/*
+ * What a pass of the loop did with the sensors
+ */
+enum readingStep {
+  READING_NONE = 0,
+  READING_TAKEN,
+  READING_FAILED // one of the sensors did not answer, the read is tried again after SENSOR_RETRY_MS
+};
+
+/*
+ * The decisions taken on a reading, the loop drives the pins and publishes from them
+ */
+struct readingOutcome {
+  enclosureLevels levels;
+  alarmChange change;
+  size_t length; // of the reading JSON, 0 if it did not fit
+};
+
+/*
+ * The steps from starting the conversions of the sensors to the reading JSON, shared by main.cpp and the trace replay
+ * start() and poll() run the acquisition on two events of the scheduler: the conversions start every interval or when a reading
+ * is requested and the loop sleeps until the drivers expect the results. The samples are stamped as soon as they are collected,
+ * passed through the filter and set on the reading. evaluate() then analyzes the reading against the limits, updates the alarm
+ * and serializes the reading.
+ */
+class ReadingCycle {
+  private:
+  SensorSet *sensors;
+  SleepScheduler *scheduler;
+  ApplicationFilter *filter;
+  SampleClock *clock;
+  ApplicationReading *current; // the reading being taken
+  AlarmController *alarm;
+  ApplicationStats *stats;
+  int8_t sample_event;
+  int8_t sensor_event;
+  uint32_t failures;
+  bool collect();
+
+  public:
+  ReadingCycle(SensorSet *sensors, SleepScheduler *scheduler, ApplicationFilter *filter, SampleClock *clock, ApplicationReading *current,
+               AlarmController *alarm, ApplicationStats *stats);
+  void begin(uint32_t interval_ms);
+  void set_interval(uint32_t interval_ms);
+  bool start(bool requested);
+  readingStep poll();
+  readingOutcome evaluate(const Limits *limits, char *output, size_t size);
+  uint32_t get_failures();
+};
+
+bool parse_read_interval(const uint8_t *payload, unsigned int length, uint32_t *interval_ms);
+
+#endif
@@ -0,0 +1,86 @@
+#ifdef ARDUINO
+#include "AckSniffingClient.h"
+
+AckSniffingClient::AckSniffingClient(Client &client, ReliablePublisher *publisher) {
+  this->client = &client;
+  this->publisher = publisher;
+}
+
+/*
+ * A new connection starts at a packet boundary
+ */
+int AckSniffingClient::connect(IPAddress ip, uint16_t port) {
+  this->parser.reset();
+  return this->client->connect(ip, port);
+}
+
+int AckSniffingClient::connect(const char *host, uint16_t port) {
+  this->parser.reset();
+  return this->client->connect(host, port);
+}
+
+/*
+ * The timeout is passed on so a caller that limits how long a connect may block gets that limit
+ */
+int AckSniffingClient::connect(IPAddress ip, uint16_t port, int32_t timeout) {
+  this->parser.reset();
+  return this->client->connect(ip, port, timeout);
+}
+
+int AckSniffingClient::connect(const char *host, uint16_t port, int32_t timeout) {
+  this->parser.reset();
+  return this->client->connect(host, port, timeout);
+}
+
+size_t AckSniffingClient::write(uint8_t byte) {
+  return this->client->write(byte);
+}
+
+size_t AckSniffingClient::write(const uint8_t *buffer, size_t size) {
+  return this->client->write(buffer, size);
+}
+
+int AckSniffingClient::available() {
+  return this->client->available();
+}
+
+int AckSniffingClient::read() {
+  int byte = this->client->read();
+  uint16_t packet_id;
+  if (byte >= 0 && this->parser.feed(static_cast<uint8_t>(byte), &packet_id)) {
+    this->publisher->acknowledge(packet_id);
+  }
+  return byte;
+}
+
+int AckSniffingClient::read(uint8_t *buffer, size_t size) {
+  int count = this->client->read(buffer, size);
+  uint16_t packet_id;
+  for (int i = 0; i < count; i++) {
+    if (this->parser.feed(buffer[i], &packet_id)) {
+      this->publisher->acknowledge(packet_id);
+    }
+  }
+  return count;
+}
+
+int AckSniffingClient::peek() {
+  return this->client->peek();
+}
+
+void AckSniffingClient::flush() {
+  this->client->flush();
+}
+
+void AckSniffingClient::stop() {
+  this->client->stop();
+}
+
+uint8_t AckSniffingClient::connected() {
+  return this->client->connected();
+}
+
+AckSniffingClient::operator bool() {
+  return static_cast<bool>(*this->client);
+}
+#endif
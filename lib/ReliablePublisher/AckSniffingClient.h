@@ -0,0 +1,36 @@
+#ifndef AckSniffingClient_h
+#define AckSniffingClient_h
+#include <Arduino.h>
+#include <Client.h>
+#include <ReliablePublisher.h>
+
+/*
+ * A Client that passes everything through to the real connection
+ * and hands the PUBACKs it sees on the way to the publisher
+ * PubSubClient reads and ignores PUBACKs, so this is the only place they can be picked up without changing the library
+ */
+class AckSniffingClient : public Client {
+  private:
+  Client *client;
+  ReliablePublisher *publisher;
+  PubackParser parser;
+
+  public:
+  AckSniffingClient(Client &client, ReliablePublisher *publisher);
+  int connect(IPAddress ip, uint16_t port);
+  int connect(const char *host, uint16_t port);
+  int connect(IPAddress ip, uint16_t port, int32_t timeout);
+  int connect(const char *host, uint16_t port, int32_t timeout);
+  size_t write(uint8_t byte);
+  size_t write(const uint8_t *buffer, size_t size);
+  int available();
+  int read();
+  int read(uint8_t *buffer, size_t size);
+  int peek();
+  void flush();
+  void stop();
+  uint8_t connected();
+  operator bool();
+};
+
+#endif
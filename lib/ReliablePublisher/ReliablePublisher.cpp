@@ -0,0 +1,250 @@
+#include "ReliablePublisher.h"
+#include <string.h>
+
+#define MQTT_PUBLISH_QOS1 0x32
+#define MQTT_DUP_FLAG 0x08
+#define MQTT_PUBACK 0x40
+
+enum parserState {
+  PARSE_HEADER,
+  PARSE_LENGTH,
+  PARSE_BODY
+};
+
+ReliablePublisher::ReliablePublisher(packetWriter writer, uint8_t window, uint32_t retry_ms) {
+  this->writer = writer;
+  this->window = window == 0 ? 1 : (window > PUBLISH_WINDOW_SIZE ? PUBLISH_WINDOW_SIZE : window);
+  this->retry_ms = retry_ms;
+  this->last_packet_id = 0;
+  memset(&this->counters, 0, sizeof(this->counters));
+  for (uint8_t i = 0; i < PUBLISH_WINDOW_SIZE; i++) {
+    this->slots[i].used = false;
+  }
+}
+
+/*
+ *This method is used to pick a packet id that is not 0 and not used by a message still waiting for its PUBACK.
+ */
+uint16_t ReliablePublisher::next_packet_id() {
+  while (true) {
+    this->last_packet_id++;
+    if (this->last_packet_id == 0) {
+      continue;
+    }
+    bool in_use = false;
+    for (uint8_t i = 0; i < this->window; i++) {
+      if (this->slots[i].used && this->slots[i].packet_id == this->last_packet_id) {
+        in_use = true;
+        break;
+      }
+    }
+    if (!in_use) {
+      return this->last_packet_id;
+    }
+  }
+}
+
+/*
+ *This method is used to write the packet of a slot and restart its timeout.
+ *A send that did not write the whole packet is not counted as an attempt, it is tried again after the timeout or on resend(),
+ *so a message is not given up for an outage, only for a broker that does not acknowledge it or for a newer message.
+ */
+bool ReliablePublisher::send(pendingPublish *slot, uint32_t now) {
+  slot->sent_at = now;
+  if (this->writer(slot->packet, slot->length) != slot->length) {
+    return false;
+  }
+  slot->attempts++;
+  return true;
+}
+
+/*
+ *This method is used to build a QoS 1 PUBLISH packet in a free slot of the window and send it.
+ *The message is kept until it is acknowledged, so it is also sent if there is no connection right now.
+ *If the window is full the oldest message is given up and counted as dropped to make room, e.g after an outage
+ *the window holds the latest readings and an alarm event always gets a slot.
+ *It returns false and counts the message as dropped if the packet is larger than PUBLISH_PACKET_SIZE.
+ */
+bool ReliablePublisher::publish(const char *topic, const uint8_t *payload, size_t length, uint32_t now) {
+  size_t topic_length = strlen(topic);
+  // Topic length, topic, packet id and payload
+  size_t remaining = 2 + topic_length + 2 + length;
+  if (remaining > PUBLISH_PACKET_SIZE - 3) {
+    this->counters.dropped++;
+    return false;
+  }
+  pendingPublish *slot = NULL;
+  for (uint8_t i = 0; i < this->window; i++) {
+    if (!this->slots[i].used) {
+      slot = &this->slots[i];
+      break;
+    }
+    if (slot == NULL || static_cast<int32_t>(this->slots[i].order - slot->order) < 0) {
+      slot = &this->slots[i];
+    }
+  }
+  if (slot->used) {
+    slot->used = false;
+    this->counters.dropped++;
+  }
+
+  uint8_t *packet = slot->packet;
+  size_t position = 0;
+  packet[position++] = MQTT_PUBLISH_QOS1;
+  size_t encoded = remaining;
+  do {
+    uint8_t digit = encoded % 128;
+    encoded /= 128;
+    packet[position++] = encoded > 0 ? (digit | 0x80) : digit;
+  } while (encoded > 0);
+  packet[position++] = static_cast<uint8_t>(topic_length >> 8);
+  packet[position++] = static_cast<uint8_t>(topic_length & 0xff);
+  memcpy(packet + position, topic, topic_length);
+  position += topic_length;
+  slot->packet_id = this->next_packet_id();
+  packet[position++] = static_cast<uint8_t>(slot->packet_id >> 8);
+  packet[position++] = static_cast<uint8_t>(slot->packet_id & 0xff);
+  memcpy(packet + position, payload, length);
+  position += length;
+
+  slot->length = position;
+  slot->attempts = 0;
+  slot->order = this->counters.sent;
+  slot->used = true;
+  this->counters.sent++;
+  this->send(slot, now);
+  return true;
+}
+
+bool ReliablePublisher::publish(const char *topic, const char *payload, uint32_t now) {
+  return this->publish(topic, reinterpret_cast<const uint8_t *>(payload), strlen(payload), now);
+}
+
+/*
+ *This method is used to free the slot of the message a PUBACK is for.
+ *It returns false if no message is waiting for that packet id e.g a late PUBACK for a message that was given up.
+ */
+bool ReliablePublisher::acknowledge(uint16_t packet_id) {
+  for (uint8_t i = 0; i < this->window; i++) {
+    if (this->slots[i].used && this->slots[i].packet_id == packet_id) {
+      this->slots[i].used = false;
+      this->counters.acknowledged++;
+      return true;
+    }
+  }
+  return false;
+}
+
+/*
+ *This method is used to send again the messages that were not acknowledged within retry_ms.
+ *It should be called on every pass of the loop, it only writes to the connection when a message timed out.
+ */
+void ReliablePublisher::poll(uint32_t now) {
+  for (uint8_t i = 0; i < this->window; i++) {
+    pendingPublish *slot = &this->slots[i];
+    if (!slot->used || now - slot->sent_at < this->retry_ms) {
+      continue;
+    }
+    if (slot->attempts >= PUBLISH_MAX_ATTEMPTS) {
+      slot->used = false;
+      this->counters.expired++;
+      continue;
+    }
+    bool first = slot->attempts == 0;
+    slot->packet[0] |= first ? 0 : MQTT_DUP_FLAG;
+    if (this->send(slot, now) && !first) {
+      this->counters.retransmitted++;
+    }
+  }
+}
+
+/*
+ *This method is used to send all the messages waiting for a PUBACK straight after reconnecting.
+ *The broker does not keep a session for the device, so the PUBACKs for the old connection will never come.
+ */
+void ReliablePublisher::resend(uint32_t now) {
+  for (uint8_t i = 0; i < this->window; i++) {
+    pendingPublish *slot = &this->slots[i];
+    if (!slot->used) {
+      continue;
+    }
+    bool first = slot->attempts == 0;
+    slot->packet[0] |= first ? 0 : MQTT_DUP_FLAG;
+    if (this->send(slot, now) && !first) {
+      this->counters.retransmitted++;
+    }
+  }
+}
+
+uint8_t ReliablePublisher::in_flight() {
+  uint8_t count = 0;
+  for (uint8_t i = 0; i < this->window; i++) {
+    if (this->slots[i].used) {
+      count++;
+    }
+  }
+  return count;
+}
+
+publisherCounters ReliablePublisher::get_counters() {
+  return this->counters;
+}
+
+PubackParser::PubackParser() {
+  this->reset();
+}
+
+/*
+ *This method is used to start again at a packet boundary, it must be called when a new connection is made.
+ */
+void PubackParser::reset() {
+  this->state = PARSE_HEADER;
+  this->header = 0;
+  this->remaining = 0;
+  this->position = 0;
+  this->shift = 0;
+  this->packet_id = 0;
+}
+
+/*
+ *This method is used to follow the packet framing one byte at a time.
+ *It returns true and sets packet_id when the byte completes a PUBACK.
+ */
+bool PubackParser::feed(uint8_t byte, uint16_t *packet_id) {
+  switch (this->state) {
+  case PARSE_HEADER:
+    this->header = byte;
+    this->remaining = 0;
+    this->shift = 0;
+    this->state = PARSE_LENGTH;
+    return false;
+  case PARSE_LENGTH:
+    this->remaining |= static_cast<uint32_t>(byte & 0x7f) << this->shift;
+    this->shift += 7;
+    if (byte & 0x80) {
+      // The remaining length is at most four bytes, anything longer means the stream was not followed from the start
+      if (this->shift > 21) {
+        this->reset();
+      }
+      return false;
+    }
+    this->position = 0;
+    this->packet_id = 0;
+    this->state = this->remaining == 0 ? PARSE_HEADER : PARSE_BODY;
+    return false;
+  default:
+    if (this->position < 2) {
+      this->packet_id = static_cast<uint16_t>((this->packet_id << 8) | byte);
+    }
+    this->position++;
+    if (this->position < this->remaining) {
+      return false;
+    }
+    this->state = PARSE_HEADER;
+    if ((this->header & 0xf0) == MQTT_PUBACK && this->remaining == 2) {
+      *packet_id = this->packet_id;
+      return true;
+    }
+    return false;
+  }
+}
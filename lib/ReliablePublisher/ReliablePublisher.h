@@ -0,0 +1,108 @@
+#ifndef ReliablePublisher_h
+#define ReliablePublisher_h
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Number of QoS 1 messages that can wait for their PUBACK at the same time, each one holds a slot of PUBLISH_PACKET_SIZE bytes
+ * Set it with a build flag e.g -DPUBLISH_WINDOW_SIZE=8, it cannot be more than PUBLISH_WINDOW_MAX
+ */
+#ifndef PUBLISH_WINDOW_SIZE
+#define PUBLISH_WINDOW_SIZE 4
+#endif
+#define PUBLISH_WINDOW_MAX 16
+
+/*
+ * Time to wait for a PUBACK before the message is sent again with the DUP flag
+ * A message that is not acknowledged after PUBLISH_MAX_ATTEMPTS sends is given up
+ * Only sends that were written count, so while there is no connection nothing expires,
+ * instead a publish into a full window gives up the oldest message so the window always holds the newest ones
+ */
+#ifndef PUBLISH_RETRY_MS
+#define PUBLISH_RETRY_MS 5000
+#endif
+#define PUBLISH_MAX_ATTEMPTS 5
+
+/*
+ * Largest PUBLISH packet, a namespaced topic and a reading with the raw values fit
+ */
+#define PUBLISH_PACKET_SIZE 512
+
+static_assert(PUBLISH_WINDOW_SIZE > 0 && PUBLISH_WINDOW_SIZE <= PUBLISH_WINDOW_MAX, "PUBLISH_WINDOW_SIZE must be between 1 and PUBLISH_WINDOW_MAX");
+
+/*
+ * Writes a whole packet to the connection to the broker and returns the number of bytes written
+ * It should return 0 when there is no connection
+ */
+typedef size_t (*packetWriter)(const uint8_t *packet, size_t length);
+
+/*
+ * A message that was sent and is waiting for its PUBACK
+ * The packet is kept as it was sent so a retransmission only has to set the DUP flag
+ */
+struct pendingPublish {
+  bool used;
+  uint16_t packet_id;
+  uint8_t attempts;
+  uint32_t order; // the oldest message is given up first when the window is full
+  uint32_t sent_at;
+  size_t length;
+  uint8_t packet[PUBLISH_PACKET_SIZE];
+};
+
+struct publisherCounters {
+  uint32_t sent;
+  uint32_t acknowledged;
+  uint32_t retransmitted;
+  uint32_t dropped; // given up to make room for a newer message or did not fit in a packet
+  uint32_t expired; // given up after PUBLISH_MAX_ATTEMPTS
+};
+
+/*
+ * Publishes messages at QoS 1 with up to window messages waiting for a PUBACK at the same time
+ * so one slow acknowledgement does not hold up the messages behind it
+ * The slots are sized by PUBLISH_WINDOW_SIZE, a smaller window can be passed to the constructor
+ * It only builds and tracks packets, the PUBACKs are handed to acknowledge() by whatever reads the connection
+ */
+class ReliablePublisher {
+  private:
+  pendingPublish slots[PUBLISH_WINDOW_SIZE];
+  uint8_t window;
+  uint32_t retry_ms;
+  uint16_t last_packet_id;
+  packetWriter writer;
+  publisherCounters counters;
+  uint16_t next_packet_id();
+  bool send(pendingPublish *slot, uint32_t now);
+
+  public:
+  ReliablePublisher(packetWriter writer, uint8_t window = PUBLISH_WINDOW_SIZE, uint32_t retry_ms = PUBLISH_RETRY_MS);
+  bool publish(const char *topic, const uint8_t *payload, size_t length, uint32_t now);
+  bool publish(const char *topic, const char *payload, uint32_t now);
+  bool acknowledge(uint16_t packet_id);
+  void poll(uint32_t now);
+  void resend(uint32_t now);
+  uint8_t in_flight();
+  publisherCounters get_counters();
+};
+
+/*
+ * Follows the packets the broker sends and picks out the PUBACKs
+ * It is fed every byte read from the connection and does not keep the packets
+ */
+class PubackParser {
+  private:
+  uint8_t state;
+  uint8_t header;
+  uint32_t remaining;
+  uint32_t position;
+  uint8_t shift;
+  uint16_t packet_id;
+
+  public:
+  PubackParser();
+  void reset();
+  bool feed(uint8_t byte, uint16_t *packet_id);
+};
+
+#endif
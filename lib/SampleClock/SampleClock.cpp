@@ -0,0 +1,89 @@
+#include "SampleClock.h"
+
+SampleClock::SampleClock(monotonicClock monotonic) {
+  this->monotonic = monotonic;
+  this->boot_id = 0;
+  this->sequence = 0;
+  this->synced = false;
+  this->anchor_monotonic = 0;
+  this->anchor_unix = 0;
+  this->last_time = 0;
+  this->last_correction = 0;
+  this->syncs = 0;
+}
+
+/*
+ *This method is used to start the samples of a boot.
+ *boot_id should be random so that two boots of the same device can be told apart.
+ */
+void SampleClock::begin(uint32_t boot_id) {
+  std::lock_guard<std::mutex> guard(this->lock);
+  this->boot_id = boot_id;
+  this->sequence = 0;
+}
+
+/*
+ *This method is used to anchor the wall clock when SNTP delivers the time.
+ *The difference from the time the clock had counted to is kept as the last correction, it shows how much the clock drifted.
+ */
+void SampleClock::sync(uint64_t unix_ms) {
+  uint64_t now = this->monotonic();
+  std::lock_guard<std::mutex> guard(this->lock);
+  if (this->synced) {
+    uint64_t estimate = this->anchor_unix + (now - this->anchor_monotonic);
+    this->last_correction = static_cast<int64_t>(unix_ms - estimate);
+    if (this->last_correction < -static_cast<int64_t>(CLOCK_MAX_HOLD_MS)) {
+      this->last_time = 0;
+    }
+  }
+  this->anchor_monotonic = now;
+  this->anchor_unix = unix_ms;
+  this->synced = true;
+  this->syncs++;
+}
+
+/*
+ *This method is used to stamp a sample, it should be called as soon as the sensors have been read.
+ *Each call takes the next sequence number.
+ */
+sampleStamp SampleClock::stamp() {
+  uint64_t now = this->monotonic();
+  std::lock_guard<std::mutex> guard(this->lock);
+  sampleStamp stamp;
+  stamp.sequence = this->sequence++;
+  stamp.boot_id = this->boot_id;
+  if (!this->synced) {
+    stamp.time_ms = now;
+    stamp.quality = CLOCK_UNSYNCED;
+    return stamp;
+  }
+  uint64_t time = this->anchor_unix + (now - this->anchor_monotonic);
+  if (time < this->last_time) {
+    time = this->last_time;
+  }
+  this->last_time = time;
+  stamp.time_ms = time;
+  stamp.quality = now - this->anchor_monotonic > CLOCK_STALE_MS ? CLOCK_STALE : CLOCK_SYNCED;
+  return stamp;
+}
+
+int64_t SampleClock::get_last_correction() {
+  std::lock_guard<std::mutex> guard(this->lock);
+  return this->last_correction;
+}
+
+uint32_t SampleClock::get_syncs() {
+  std::lock_guard<std::mutex> guard(this->lock);
+  return this->syncs;
+}
+
+const char *clock_quality_name(clockQuality quality) {
+  switch (quality) {
+  case CLOCK_SYNCED:
+    return "synced";
+  case CLOCK_STALE:
+    return "stale";
+  default:
+    return "unsynced";
+  }
+}
@@ -0,0 +1,78 @@
+#ifndef SampleClock_h
+#define SampleClock_h
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * A clock that has not been synchronized for this long is reported as stale
+ * SNTP synchronizes every hour by default, so this allows a couple of missed synchronizations
+ */
+#ifndef CLOCK_STALE_MS
+#define CLOCK_STALE_MS (3UL * 60 * 60 * 1000)
+#endif
+
+/*
+ * A synchronization that moves the clock back by less than this holds the timestamps until the clock catches up,
+ * so timestamps within a boot never go backwards. A larger step back is taken as it is.
+ */
+#ifndef CLOCK_MAX_HOLD_MS
+#define CLOCK_MAX_HOLD_MS 2000
+#endif
+
+/*
+ * How far the timestamp of a sample can be trusted
+ * Unsynced timestamps are milliseconds since boot, the others are milliseconds since the Unix epoch
+ */
+enum clockQuality {
+  CLOCK_UNSYNCED = 0,
+  CLOCK_SYNCED = 1,
+  CLOCK_STALE = 2
+};
+
+/*
+ * When a sample was taken and where it sits in the samples of this boot
+ * A gap in sequence for the same boot_id means samples were lost, a new boot_id means the device restarted
+ */
+struct sampleStamp {
+  uint64_t time_ms;
+  uint32_t sequence;
+  uint32_t boot_id;
+  clockQuality quality;
+};
+
+/*
+ * Milliseconds since boot from a clock that never goes backwards
+ */
+typedef uint64_t (*monotonicClock)();
+
+/*
+ * Wall clock time for the samples
+ * Each synchronization anchors the wall clock time to the monotonic clock and the time in between is counted on the monotonic clock,
+ * so the timestamps do not depend on when the system time is changed. sync() is called from the SNTP task and stamp() from the loop.
+ */
+class SampleClock {
+  private:
+  monotonicClock monotonic;
+  std::mutex lock;
+  uint32_t boot_id;
+  uint32_t sequence;
+  bool synced;
+  uint64_t anchor_monotonic;
+  uint64_t anchor_unix;
+  uint64_t last_time;
+  int64_t last_correction;
+  uint32_t syncs;
+
+  public:
+  SampleClock(monotonicClock monotonic);
+  void begin(uint32_t boot_id);
+  void sync(uint64_t unix_ms);
+  sampleStamp stamp();
+  int64_t get_last_correction();
+  uint32_t get_syncs();
+};
+
+const char *clock_quality_name(clockQuality quality);
+
+#endif
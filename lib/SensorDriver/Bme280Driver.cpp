@@ -0,0 +1,121 @@
+#include "Bme280Driver.h"
+#include <string.h>
+
+Bme280Driver::Bme280Driver(SensorBus *bus, uint8_t address) {
+  this->bus = bus;
+  this->address = address;
+  this->calibrated = false;
+  this->ready_ms = 0;
+  memset(&this->calibration, 0, sizeof(this->calibration));
+}
+
+const char *Bme280Driver::name() {
+  return "bme280";
+}
+
+/*
+ *This method is used to check the chip id and read the trimming parameters.
+ *It returns false if the sensor did not answer or is not a BME280, begin() is tried again on the next start().
+ */
+bool Bme280Driver::begin() {
+  uint8_t id;
+  if (!this->bus->read_registers(this->address, BME280_REG_CHIP_ID, &id, 1) || id != BME280_CHIP_ID) {
+    return false;
+  }
+  uint8_t tp[26];
+  uint8_t h[7];
+  if (!this->bus->read_registers(this->address, BME280_REG_CALIB_TP, tp, sizeof(tp)) ||
+      !this->bus->read_registers(this->address, BME280_REG_CALIB_H, h, sizeof(h))) {
+    return false;
+  }
+  bme280_parse_calibration(tp, h, &this->calibration);
+  this->calibrated = true;
+  return true;
+}
+
+/*
+ *This method is used to start a forced measurement, the sensor goes back to sleep when it is done.
+ *The BME280 takes register and value pairs in one write, ctrl_hum is written every time so a sensor that was reset still measures
+ *the humidity, it only takes effect when ctrl_meas is written after it.
+ */
+bool Bme280Driver::start(uint32_t now_ms) {
+  if (!this->calibrated && !this->begin()) {
+    return false;
+  }
+  this->ready_ms = now_ms + BME280_MEASURE_MS;
+  const uint8_t data[4] = {BME280_REG_CTRL_HUM, BME280_CTRL_HUM_X1, BME280_REG_CTRL_MEAS, BME280_CTRL_MEAS_FORCED};
+  return this->bus->write(this->address, data, sizeof(data));
+}
+
+/*
+ *This method is used to read the result once the status register shows the measurement is done.
+ *The compensation is done in integers with the formulas of the datasheet.
+ */
+sensorPoll Bme280Driver::poll(uint32_t now_ms, sensorSample *sample) {
+  if (static_cast<int32_t>(now_ms - this->ready_ms) < 0) {
+    return SENSOR_PENDING;
+  }
+  uint8_t status;
+  if (!this->bus->read_registers(this->address, BME280_REG_STATUS, &status, 1)) {
+    return SENSOR_FAILED;
+  }
+  if (status & BME280_STATUS_MEASURING) {
+    return SENSOR_PENDING;
+  }
+  uint8_t data[8];
+  if (!this->bus->read_registers(this->address, BME280_REG_DATA, data, sizeof(data))) {
+    return SENSOR_FAILED;
+  }
+  int32_t adc_t = (static_cast<int32_t>(data[3]) << 12) | (static_cast<int32_t>(data[4]) << 4) | (data[5] >> 4);
+  int32_t adc_h = (static_cast<int32_t>(data[6]) << 8) | data[7];
+  int32_t t_fine;
+  sample->temperature = static_cast<centi_t>(bme280_temperature(&this->calibration, adc_t, &t_fine));
+  // Q22.10 percent to hundredths of a percent
+  sample->humidity = static_cast<centi_t>((bme280_humidity(&this->calibration, adc_h, t_fine) * 100 + 512) / 1024);
+  return SENSOR_DONE;
+}
+
+uint32_t Bme280Driver::ready_in(uint32_t now_ms) {
+  int32_t left = static_cast<int32_t>(this->ready_ms - now_ms);
+  return left > 0 ? left : 1;
+}
+
+/*
+ * A function to unpack the trimming parameters from the two calibration blocks
+ * tp holds the 26 bytes from 0x88 and h the 7 bytes from 0xe1, dig_H4 and dig_H5 share the nibbles of 0xe5
+ */
+void bme280_parse_calibration(const uint8_t *tp, const uint8_t *h, bme280Calibration *calibration) {
+  calibration->t1 = static_cast<uint16_t>(tp[0] | (tp[1] << 8));
+  calibration->t2 = static_cast<int16_t>(tp[2] | (tp[3] << 8));
+  calibration->t3 = static_cast<int16_t>(tp[4] | (tp[5] << 8));
+  calibration->h1 = tp[25];
+  calibration->h2 = static_cast<int16_t>(h[0] | (h[1] << 8));
+  calibration->h3 = h[2];
+  calibration->h4 = static_cast<int16_t>((static_cast<int8_t>(h[3]) * 16) | (h[4] & 0x0f));
+  calibration->h5 = static_cast<int16_t>((static_cast<int8_t>(h[5]) * 16) | (h[4] >> 4));
+  calibration->h6 = static_cast<int8_t>(h[6]);
+}
+
+/*
+ * A function to compensate a raw temperature, it returns hundredths of a degree and sets t_fine for the humidity
+ */
+int32_t bme280_temperature(const bme280Calibration *calibration, int32_t adc_t, int32_t *t_fine) {
+  int32_t t1 = calibration->t1;
+  int32_t var1 = (((adc_t >> 3) - (t1 << 1)) * calibration->t2) >> 11;
+  int32_t var2 = (((((adc_t >> 4) - t1) * ((adc_t >> 4) - t1)) >> 12) * calibration->t3) >> 14;
+  *t_fine = var1 + var2;
+  return (*t_fine * 5 + 128) >> 8;
+}
+
+/*
+ * A function to compensate a raw humidity, it returns the humidity in percent as a Q22.10 fixed point number
+ */
+uint32_t bme280_humidity(const bme280Calibration *calibration, int32_t adc_h, int32_t t_fine) {
+  int32_t v = t_fine - 76800;
+  v = (((((adc_h << 14) - (static_cast<int32_t>(calibration->h4) << 20) - (static_cast<int32_t>(calibration->h5) * v)) + 16384) >> 15) *
+       (((((((v * calibration->h6) >> 10) * (((v * static_cast<int32_t>(calibration->h3)) >> 11) + 32768)) >> 10) + 2097152) * calibration->h2 + 8192) >> 14));
+  v = v - (((((v >> 15) * (v >> 15)) >> 7) * static_cast<int32_t>(calibration->h1)) >> 4);
+  v = v < 0 ? 0 : v;
+  v = v > 419430400 ? 419430400 : v;
+  return static_cast<uint32_t>(v >> 12);
+}
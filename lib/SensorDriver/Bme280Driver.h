@@ -0,0 +1,69 @@
+#ifndef Bme280Driver_h
+#define Bme280Driver_h
+#include "SensorDriver.h"
+
+/*
+ * The BME280 answers on 0x76, or on 0x77 when its SDO pin is pulled high
+ */
+#define BME280_ADDRESS 0x76
+#define BME280_ADDRESS_ALT 0x77
+#define BME280_CHIP_ID 0x60
+
+#define BME280_REG_CALIB_TP 0x88 // 26 bytes up to dig_H1 at 0xa1
+#define BME280_REG_CHIP_ID 0xd0
+#define BME280_REG_CALIB_H 0xe1 // 7 bytes
+#define BME280_REG_CTRL_HUM 0xf2
+#define BME280_REG_STATUS 0xf3
+#define BME280_REG_CTRL_MEAS 0xf4
+#define BME280_REG_DATA 0xf7 // pressure, temperature and humidity, 8 bytes
+
+#define BME280_STATUS_MEASURING 0x08
+
+/*
+ * Temperature and humidity are oversampled once and the pressure is skipped, it is not used by the firmware
+ * A forced measurement then takes 6.2 ms at most
+ */
+#define BME280_CTRL_HUM_X1 0x01
+#define BME280_CTRL_MEAS_FORCED 0x21 // osrs_t x1, osrs_p skipped, forced mode
+#define BME280_MEASURE_MS 7
+
+/*
+ * The trimming parameters of one sensor, read once at boot
+ */
+struct bme280Calibration {
+  uint16_t t1;
+  int16_t t2;
+  int16_t t3;
+  uint8_t h1;
+  int16_t h2;
+  uint8_t h3;
+  int16_t h4;
+  int16_t h5;
+  int8_t h6;
+};
+
+/*
+ * Bosch BME280 on the shared I2C bus in forced mode, the sensor sleeps between readings
+ */
+class Bme280Driver : public SensorDriver {
+  private:
+  SensorBus *bus;
+  uint8_t address;
+  bme280Calibration calibration;
+  bool calibrated;
+  uint32_t ready_ms;
+
+  public:
+  Bme280Driver(SensorBus *bus, uint8_t address);
+  const char *name();
+  bool begin();
+  bool start(uint32_t now_ms);
+  sensorPoll poll(uint32_t now_ms, sensorSample *sample);
+  uint32_t ready_in(uint32_t now_ms);
+};
+
+void bme280_parse_calibration(const uint8_t *tp, const uint8_t *h, bme280Calibration *calibration);
+int32_t bme280_temperature(const bme280Calibration *calibration, int32_t adc_t, int32_t *t_fine);
+uint32_t bme280_humidity(const bme280Calibration *calibration, int32_t adc_h, int32_t t_fine);
+
+#endif
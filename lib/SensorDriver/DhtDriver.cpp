@@ -0,0 +1,134 @@
+#ifdef ARDUINO
+#include "DhtDriver.h"
+#include <Arduino.h>
+
+/*
+ * A level of the answer lasts 80 us at most, a line that does not change for this long has no sensor on it
+ */
+#define DHT_PULSE_TIMEOUT_US 1000
+
+DhtDriver::DhtDriver(uint8_t pin, uint8_t type) {
+  this->pin = pin;
+  this->type = type;
+  this->ready_ms = 0;
+  this->read_ms = 0;
+  this->read_once = false;
+  this->cached = false;
+  this->last_result = SENSOR_FAILED;
+  this->last_sample.temperature = CENTI_INVALID;
+  this->last_sample.humidity = CENTI_INVALID;
+}
+
+const char *DhtDriver::name() {
+  return this->type == 22 ? "dht22" : "dht11";
+}
+
+/*
+ *This method is used to let the line idle high, the sensor does not answer until it is started.
+ */
+bool DhtDriver::begin() {
+  pinMode(this->pin, INPUT_PULLUP);
+  return true;
+}
+
+/*
+ *This method is used to wake the sensor by holding the line low.
+ *Within DHT_MIN_INTERVAL_MS of the last read the sensor is left alone and the conversion ends with the last result.
+ */
+bool DhtDriver::start(uint32_t now_ms) {
+  this->cached = this->read_once && now_ms - this->read_ms < DHT_MIN_INTERVAL_MS;
+  if (this->cached) {
+    this->ready_ms = now_ms;
+    return true;
+  }
+  pinMode(this->pin, OUTPUT);
+  digitalWrite(this->pin, LOW);
+  this->ready_ms = now_ms + (this->type == 22 ? DHT22_START_MS : DHT11_START_MS);
+  return true;
+}
+
+/*
+ *This method is used to time how long the line stays at level, it returns 0 on a timeout.
+ */
+uint32_t DhtDriver::pulse(uint8_t level) {
+  uint32_t start = micros();
+  while (digitalRead(this->pin) == level) {
+    if (micros() - start > DHT_PULSE_TIMEOUT_US) {
+      return 0;
+    }
+  }
+  uint32_t length = micros() - start;
+  return length == 0 ? 1 : length;
+}
+
+/*
+ *This method is used to read the sensor once it has been held low long enough, or to return the last result if it was not woken.
+ */
+sensorPoll DhtDriver::poll(uint32_t now_ms, sensorSample *sample) {
+  if (this->cached) {
+    *sample = this->last_sample;
+    return this->last_result;
+  }
+  if (static_cast<int32_t>(now_ms - this->ready_ms) < 0) {
+    return SENSOR_PENDING;
+  }
+  this->last_result = this->read(&this->last_sample);
+  this->read_ms = now_ms;
+  this->read_once = true;
+  *sample = this->last_sample;
+  return this->last_result;
+}
+
+/*
+ *This method is used to read the answer of the sensor once it has been held low long enough.
+ *A bit is a 50 us low followed by a high of 26 us for a zero or 70 us for a one, the fifth byte is the sum of the other four.
+ */
+sensorPoll DhtDriver::read(sensorSample *sample) {
+  uint8_t data[5] = {0, 0, 0, 0, 0};
+  uint32_t lows[40];
+  uint32_t highs[40];
+  bool answered;
+
+  noInterrupts();
+  pinMode(this->pin, INPUT_PULLUP);
+  delayMicroseconds(55);
+  // The sensor answers with 80 us low and 80 us high before the first bit
+  answered = this->pulse(LOW) != 0 && this->pulse(HIGH) != 0;
+  // Stop at the first pulse that timed out so a sensor that drops out does not keep interrupts off for every bit left
+  for (uint8_t i = 0; answered && i < 40; i++) {
+    lows[i] = this->pulse(LOW);
+    highs[i] = lows[i] == 0 ? 0 : this->pulse(HIGH);
+    answered = highs[i] != 0;
+  }
+  interrupts();
+
+  if (!answered) {
+    return SENSOR_FAILED;
+  }
+  for (uint8_t i = 0; i < 40; i++) {
+    data[i / 8] = static_cast<uint8_t>((data[i / 8] << 1) | (highs[i] > lows[i] ? 1 : 0));
+  }
+  if (static_cast<uint8_t>(data[0] + data[1] + data[2] + data[3]) != data[4]) {
+    return SENSOR_FAILED;
+  }
+
+  if (this->type == 22) {
+    // Tenths in 16 bits, the top bit of the temperature is its sign
+    int32_t temperature = ((data[2] & 0x7f) << 8 | data[3]) * 10;
+    sample->temperature = static_cast<centi_t>(data[2] & 0x80 ? -temperature : temperature);
+    sample->humidity = static_cast<centi_t>((data[0] << 8 | data[1]) * 10);
+  } else {
+    // Whole units and tenths, the top bit of the tenths of the temperature is its sign
+    int32_t temperature = data[2] * 100 + (data[3] & 0x0f) * 10;
+    sample->temperature = static_cast<centi_t>(data[3] & 0x80 ? -temperature : temperature);
+    sample->humidity = static_cast<centi_t>(data[0] * 100 + data[1] * 10);
+  }
+  return SENSOR_DONE;
+}
+
+uint32_t DhtDriver::ready_in(uint32_t now_ms) {
+  int32_t left = static_cast<int32_t>(this->ready_ms - now_ms);
+  return left > 0 ? left : 1;
+}
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef DhtDriver_h
+#define DhtDriver_h
+#include "SensorDriver.h"
+
+#ifdef ARDUINO
+
+/*
+ * How long the host holds the line low to wake the sensor, at least 18 ms for the DHT11 and 1 ms for the DHT22
+ */
+#define DHT11_START_MS 20
+#define DHT22_START_MS 2
+
+/*
+ * The sensors cannot be read more often than this
+ */
+#define DHT_MIN_INTERVAL_MS 2000
+
+/*
+ * A DHT11 or DHT22 on its own pin
+ * start() pulls the line low and returns, the loop sleeps while the sensor wakes up instead of waiting in delay().
+ * poll() releases the line and times the 40 bits of the answer, about 4 ms with the interrupts off so the pulses are not stretched.
+ * The sensors cannot be read more often than every 2 seconds. A conversion started sooner after the last read, e.g by a sample now
+ * command, does not wake the sensor, poll() returns the result of the last read straight away.
+ */
+class DhtDriver : public SensorDriver {
+  private:
+  uint8_t pin;
+  uint8_t type;
+  uint32_t ready_ms;
+  uint32_t read_ms;
+  bool read_once;
+  bool cached;
+  sensorPoll last_result;
+  sensorSample last_sample;
+  uint32_t pulse(uint8_t level);
+  sensorPoll read(sensorSample *sample);
+
+  public:
+  DhtDriver(uint8_t pin, uint8_t type);
+  const char *name();
+  bool begin();
+  bool start(uint32_t now_ms);
+  sensorPoll poll(uint32_t now_ms, sensorSample *sample);
+  uint32_t ready_in(uint32_t now_ms);
+};
+
+#endif
+
+#endif
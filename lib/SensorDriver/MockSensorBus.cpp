@@ -0,0 +1,230 @@
+#include "MockSensorBus.h"
+#include "Sht3xDriver.h"
+#include <string.h>
+
+static sensorClock mock_clock = NULL;
+static uint32_t mock_frequency_hz = 400000;
+static MockI2cDevice *mock_devices[MOCK_BUS_MAX_DEVICES];
+static size_t mock_device_count = 0;
+static uint64_t mock_wire_ns = 0;
+
+/*
+ * A function to add the time of one transaction on the wire, a start, the address and each byte with its acknowledge, and a stop
+ */
+static void add_wire_time(size_t bytes) {
+  uint64_t bits = 2 + 9 * (1 + bytes);
+  mock_wire_ns += bits * 1000000000ULL / mock_frequency_hz;
+}
+
+static MockI2cDevice *find_device(uint8_t address) {
+  for (size_t i = 0; i < mock_device_count; i++) {
+    if (mock_devices[i]->address == address && mock_devices[i]->present) {
+      return mock_devices[i];
+    }
+  }
+  return NULL;
+}
+
+/*
+ * A function to empty the bus and set its clock and speed
+ */
+void mock_bus_begin(sensorClock clock, uint32_t frequency_hz) {
+  mock_clock = clock;
+  mock_frequency_hz = frequency_hz;
+  mock_device_count = 0;
+  mock_wire_ns = 0;
+}
+
+bool mock_bus_attach(MockI2cDevice *device) {
+  if (mock_device_count >= MOCK_BUS_MAX_DEVICES) {
+    return false;
+  }
+  mock_devices[mock_device_count++] = device;
+  return true;
+}
+
+bool mock_bus_write(uint8_t address, const uint8_t *data, size_t length) {
+  MockI2cDevice *device = find_device(address);
+  if (device == NULL || !device->write(data, length, mock_clock())) {
+    add_wire_time(0);
+    return false;
+  }
+  add_wire_time(length);
+  return true;
+}
+
+bool mock_bus_read(uint8_t address, uint8_t *data, size_t length) {
+  MockI2cDevice *device = find_device(address);
+  if (device == NULL || !device->read(data, length, mock_clock())) {
+    add_wire_time(0);
+    return false;
+  }
+  add_wire_time(length);
+  return true;
+}
+
+/*
+ * A function to get the time the transactions so far would have taken on the wire, in nanoseconds
+ */
+uint64_t mock_bus_wire_ns() {
+  return mock_wire_ns;
+}
+
+MockI2cDevice::MockI2cDevice(uint8_t address) {
+  this->address = address;
+  this->present = true;
+}
+
+MockSht3x::MockSht3x(uint8_t address) : MockI2cDevice(address) {
+  this->measured = false;
+  this->ready_ms = 0;
+  this->set(2500, 5000);
+}
+
+void MockSht3x::set(centi_t temperature, centi_t humidity) {
+  this->raw_temperature = static_cast<uint16_t>(((static_cast<int32_t>(temperature) + 4500) * 65535L + 8750) / 17500);
+  this->raw_humidity = static_cast<uint16_t>((static_cast<int32_t>(humidity) * 65535L + 5000) / 10000);
+}
+
+bool MockSht3x::write(const uint8_t *data, size_t length, uint32_t now_ms) {
+  if (length != 2) {
+    return false;
+  }
+  uint16_t code = static_cast<uint16_t>((data[0] << 8) | data[1]);
+  if (code == SHT3X_MEASURE_HIGH) {
+    this->measured = true;
+    this->ready_ms = now_ms + 13; // 12.5 ms typical
+  }
+  return true;
+}
+
+bool MockSht3x::read(uint8_t *data, size_t length, uint32_t now_ms) {
+  if (!this->measured || static_cast<int32_t>(now_ms - this->ready_ms) < 0 || length != 6) {
+    return false;
+  }
+  data[0] = static_cast<uint8_t>(this->raw_temperature >> 8);
+  data[1] = static_cast<uint8_t>(this->raw_temperature & 0xff);
+  data[2] = sht3x_crc(data, 2);
+  data[3] = static_cast<uint8_t>(this->raw_humidity >> 8);
+  data[4] = static_cast<uint8_t>(this->raw_humidity & 0xff);
+  data[5] = sht3x_crc(data + 3, 2);
+  this->measured = false;
+  return true;
+}
+
+static void put_le16(uint8_t *registers, uint8_t reg, uint16_t value) {
+  registers[reg] = static_cast<uint8_t>(value & 0xff);
+  registers[reg + 1] = static_cast<uint8_t>(value >> 8);
+}
+
+MockBme280::MockBme280(uint8_t address) : MockI2cDevice(address) {
+  memset(this->registers, 0, sizeof(this->registers));
+  this->pointer = 0;
+  this->ready_ms = 0;
+  this->measuring = false;
+  this->humidity_on = false;
+  this->registers[BME280_REG_CHIP_ID] = BME280_CHIP_ID;
+
+  // Trimming parameters of a real part, the pressure ones are those of the example of the datasheet
+  const uint16_t tp[12] = {27504, 26435, static_cast<uint16_t>(-1000), 36477, static_cast<uint16_t>(-10685), 3024,
+                           2855, 140, static_cast<uint16_t>(-7), 15500, static_cast<uint16_t>(-14600), 6000};
+  for (uint8_t i = 0; i < 12; i++) {
+    put_le16(this->registers, BME280_REG_CALIB_TP + 2 * i, tp[i]);
+  }
+  const int16_t h4 = 300;
+  const int16_t h5 = 50;
+  this->registers[0xa1] = 75;
+  put_le16(this->registers, BME280_REG_CALIB_H, 370);
+  this->registers[0xe3] = 0;
+  this->registers[0xe4] = static_cast<uint8_t>(h4 >> 4);
+  this->registers[0xe5] = static_cast<uint8_t>((h4 & 0x0f) | ((h5 & 0x0f) << 4));
+  this->registers[0xe6] = static_cast<uint8_t>(h5 >> 4);
+  this->registers[0xe7] = 30;
+  bme280_parse_calibration(&this->registers[BME280_REG_CALIB_TP], &this->registers[BME280_REG_CALIB_H], &this->calibration);
+
+  // Skipped measurements read as 0x80000 until the first forced measurement
+  this->registers[BME280_REG_DATA] = 0x80;
+  this->registers[BME280_REG_DATA + 3] = 0x80;
+  this->registers[BME280_REG_DATA + 6] = 0x80;
+  this->set(2500, 5000);
+}
+
+/*
+ *This method is used to find the raw values that the compensation turns into the given values, both grow with the raw value.
+ */
+void MockBme280::set(centi_t temperature, centi_t humidity) {
+  int32_t t_fine;
+  int32_t low = 0;
+  int32_t high = 0xfffff;
+  while (low < high) {
+    int32_t middle = (low + high) / 2;
+    if (bme280_temperature(&this->calibration, middle, &t_fine) < temperature) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  this->adc_t = low;
+  bme280_temperature(&this->calibration, this->adc_t, &t_fine);
+
+  // The driver rounds the Q22.10 humidity to hundredths, aim for the middle of the hundredth
+  uint32_t target = (static_cast<uint32_t>(humidity < 0 ? 0 : humidity) * 1024 + 50) / 100;
+  low = 0;
+  high = 0xffff;
+  while (low < high) {
+    int32_t middle = (low + high) / 2;
+    if (bme280_humidity(&this->calibration, middle, t_fine) < target) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  this->adc_h = low;
+}
+
+void MockBme280::finish(uint32_t now_ms) {
+  if (!this->measuring || static_cast<int32_t>(now_ms - this->ready_ms) < 0) {
+    return;
+  }
+  this->measuring = false;
+  this->registers[BME280_REG_STATUS] = 0;
+  this->registers[BME280_REG_DATA + 3] = static_cast<uint8_t>(this->adc_t >> 12);
+  this->registers[BME280_REG_DATA + 4] = static_cast<uint8_t>((this->adc_t >> 4) & 0xff);
+  this->registers[BME280_REG_DATA + 5] = static_cast<uint8_t>((this->adc_t & 0x0f) << 4);
+  int32_t adc_h = this->humidity_on ? this->adc_h : 0x8000;
+  this->registers[BME280_REG_DATA + 6] = static_cast<uint8_t>(adc_h >> 8);
+  this->registers[BME280_REG_DATA + 7] = static_cast<uint8_t>(adc_h & 0xff);
+  // The forced measurement ends in sleep mode
+  this->registers[BME280_REG_CTRL_MEAS] &= 0xfc;
+}
+
+/*
+ *This method is used to take a write, a single byte sets the register pointer of the next read and longer writes are register and value pairs.
+ *A write of forced mode to ctrl_meas starts a measurement that takes 6 ms, the humidity is skipped unless ctrl_hum was written before.
+ */
+bool MockBme280::write(const uint8_t *data, size_t length, uint32_t now_ms) {
+  if (length == 0 || (length > 1 && length % 2 != 0)) {
+    return false;
+  }
+  this->finish(now_ms);
+  this->pointer = data[0];
+  for (size_t i = 0; i + 1 < length; i += 2) {
+    uint8_t reg = data[i];
+    this->registers[reg] = data[i + 1];
+    if (reg == BME280_REG_CTRL_MEAS && (data[i + 1] & 0x03) != 0 && (data[i + 1] & 0x03) != 0x03) {
+      this->measuring = true;
+      this->ready_ms = now_ms + 6;
+      this->registers[BME280_REG_STATUS] = BME280_STATUS_MEASURING;
+      this->humidity_on = this->registers[BME280_REG_CTRL_HUM] != 0;
+    }
+  }
+  return true;
+}
+
+bool MockBme280::read(uint8_t *data, size_t length, uint32_t now_ms) {
+  this->finish(now_ms);
+  for (size_t i = 0; i < length; i++) {
+    data[i] = this->registers[this->pointer++];
+  }
+  return true;
+}
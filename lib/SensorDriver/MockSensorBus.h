@@ -0,0 +1,73 @@
+#ifndef MockSensorBus_h
+#define MockSensorBus_h
+#include "Bme280Driver.h"
+#include "SensorDriver.h"
+
+/*
+ * A simulated I2C bus for the native build
+ * The devices answer the transactions of the drivers the way the sensors do, including the conversion time.
+ * The time the transactions would take on the wire is added up, on the ESP32 the CPU waits for it because Wire is synchronous.
+ */
+
+#ifndef MOCK_BUS_MAX_DEVICES
+#define MOCK_BUS_MAX_DEVICES 8
+#endif
+
+class MockI2cDevice {
+  public:
+  uint8_t address;
+  bool present;
+  MockI2cDevice(uint8_t address);
+  virtual ~MockI2cDevice() {}
+  virtual bool write(const uint8_t *data, size_t length, uint32_t now_ms) = 0;
+  virtual bool read(uint8_t *data, size_t length, uint32_t now_ms) = 0;
+};
+
+/*
+ * An SHT3x that measures the values given to set()
+ * It does not acknowledge a read while it converts, as in the single shot mode without clock stretching
+ */
+class MockSht3x : public MockI2cDevice {
+  private:
+  uint16_t raw_temperature;
+  uint16_t raw_humidity;
+  bool measured;
+  uint32_t ready_ms;
+
+  public:
+  MockSht3x(uint8_t address);
+  void set(centi_t temperature, centi_t humidity);
+  bool write(const uint8_t *data, size_t length, uint32_t now_ms);
+  bool read(uint8_t *data, size_t length, uint32_t now_ms);
+};
+
+/*
+ * A BME280 with the trimming parameters of a real part
+ * The raw values are worked out from the values given to set() so the driver gets them back after the compensation
+ */
+class MockBme280 : public MockI2cDevice {
+  private:
+  uint8_t registers[256];
+  uint8_t pointer;
+  bme280Calibration calibration;
+  int32_t adc_t;
+  int32_t adc_h;
+  uint32_t ready_ms;
+  bool measuring;
+  bool humidity_on;
+  void finish(uint32_t now_ms);
+
+  public:
+  MockBme280(uint8_t address);
+  void set(centi_t temperature, centi_t humidity);
+  bool write(const uint8_t *data, size_t length, uint32_t now_ms);
+  bool read(uint8_t *data, size_t length, uint32_t now_ms);
+};
+
+void mock_bus_begin(sensorClock clock, uint32_t frequency_hz);
+bool mock_bus_attach(MockI2cDevice *device);
+bool mock_bus_write(uint8_t address, const uint8_t *data, size_t length);
+bool mock_bus_read(uint8_t address, uint8_t *data, size_t length);
+uint64_t mock_bus_wire_ns();
+
+#endif
@@ -0,0 +1,157 @@
+#include "SensorDriver.h"
+#include <string.h>
+
+SensorBus::SensorBus(busWrite writer, busRead reader) {
+  this->writer = writer;
+  this->reader = reader;
+  memset(&this->counters, 0, sizeof(this->counters));
+}
+
+bool SensorBus::write(uint8_t address, const uint8_t *data, size_t length) {
+  this->counters.transactions++;
+  if (!this->writer(address, data, length)) {
+    this->counters.nacks++;
+    return false;
+  }
+  this->counters.bytes += length;
+  return true;
+}
+
+bool SensorBus::read(uint8_t address, uint8_t *data, size_t length) {
+  this->counters.transactions++;
+  if (!this->reader(address, data, length)) {
+    this->counters.nacks++;
+    return false;
+  }
+  this->counters.bytes += length;
+  return true;
+}
+
+/*
+ *This method is used to read length registers starting at reg, the register pointer is written first and the registers read in a second transaction.
+ */
+bool SensorBus::read_registers(uint8_t address, uint8_t reg, uint8_t *data, size_t length) {
+  return this->write(address, &reg, 1) && this->read(address, data, length);
+}
+
+busCounters SensorBus::get_counters() {
+  return this->counters;
+}
+
+SensorSet::SensorSet(sensorClock clock) {
+  this->clock = clock;
+  this->running = false;
+  this->started_ms = 0;
+  for (uint8_t i = 0; i < SENSOR_MAX_CHANNELS; i++) {
+    this->drivers[i] = NULL;
+    this->results[i] = SENSOR_FAILED;
+    this->samples[i].temperature = CENTI_INVALID;
+    this->samples[i].humidity = CENTI_INVALID;
+  }
+}
+
+/*
+ *This method is used to attach the driver that reads a channel, it returns false if the channel does not exist.
+ */
+bool SensorSet::attach(uint8_t channel, SensorDriver *driver) {
+  if (channel >= SENSOR_MAX_CHANNELS) {
+    return false;
+  }
+  this->drivers[channel] = driver;
+  return true;
+}
+
+/*
+ *This method is used to set up the sensors, it returns false if one of them did not answer.
+ *A sensor that failed here is still started on every acquisition so it is picked up once it answers.
+ */
+bool SensorSet::begin() {
+  bool ok = true;
+  for (uint8_t i = 0; i < SENSOR_MAX_CHANNELS; i++) {
+    if (this->drivers[i] != NULL && !this->drivers[i]->begin()) {
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+/*
+ *This method is used to start a conversion on every channel.
+ */
+void SensorSet::start() {
+  uint32_t now = this->clock();
+  this->started_ms = now;
+  this->running = true;
+  for (uint8_t i = 0; i < SENSOR_MAX_CHANNELS; i++) {
+    if (this->drivers[i] == NULL) {
+      continue;
+    }
+    this->results[i] = this->drivers[i]->start(now) ? SENSOR_PENDING : SENSOR_FAILED;
+  }
+}
+
+/*
+ *This method is used to collect the results of the conversions that are ready.
+ *It returns true once every channel has a result or failed, a channel still pending after SENSOR_TIMEOUT_MS failed.
+ */
+bool SensorSet::poll() {
+  if (!this->running) {
+    return true;
+  }
+  uint32_t now = this->clock();
+  bool finished = true;
+  for (uint8_t i = 0; i < SENSOR_MAX_CHANNELS; i++) {
+    if (this->drivers[i] == NULL || this->results[i] != SENSOR_PENDING) {
+      continue;
+    }
+    this->results[i] = this->drivers[i]->poll(now, &this->samples[i]);
+    if (this->results[i] == SENSOR_PENDING && now - this->started_ms >= SENSOR_TIMEOUT_MS) {
+      this->results[i] = SENSOR_FAILED;
+    }
+    if (this->results[i] == SENSOR_PENDING) {
+      finished = false;
+    }
+  }
+  this->running = !finished;
+  return finished;
+}
+
+bool SensorSet::converting() {
+  return this->running;
+}
+
+/*
+ *This method is used to get the time until the first pending conversion is expected to be ready, so the loop can sleep until then.
+ */
+uint32_t SensorSet::next_poll_in() {
+  uint32_t now = this->clock();
+  uint32_t next = SENSOR_TIMEOUT_MS;
+  for (uint8_t i = 0; i < SENSOR_MAX_CHANNELS; i++) {
+    if (this->drivers[i] == NULL || this->results[i] != SENSOR_PENDING) {
+      continue;
+    }
+    uint32_t ready = this->drivers[i]->ready_in(now);
+    if (ready < next) {
+      next = ready;
+    }
+  }
+  return next;
+}
+
+/*
+ *This method is used to get the sample of a channel from the last acquisition, it returns false if the read failed.
+ */
+bool SensorSet::get_sample(uint8_t channel, sensorSample *sample) {
+  if (channel >= SENSOR_MAX_CHANNELS || this->drivers[channel] == NULL || this->results[channel] != SENSOR_DONE) {
+    return false;
+  }
+  *sample = this->samples[channel];
+  return true;
+}
+
+const char *SensorSet::driver_name(uint8_t channel) {
+  if (channel >= SENSOR_MAX_CHANNELS || this->drivers[channel] == NULL) {
+    return "none";
+  }
+  return this->drivers[channel]->name();
+}
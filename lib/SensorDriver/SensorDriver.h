@@ -0,0 +1,115 @@
+#ifndef SensorDriver_h
+#define SensorDriver_h
+#include <FixedPoint.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Number of channels a SensorSet can hold, one per enclosure on the current boards
+ */
+#ifndef SENSOR_MAX_CHANNELS
+#define SENSOR_MAX_CHANNELS 4
+#endif
+
+/*
+ * A conversion that has not finished this long after it was started is counted as a failed read
+ */
+#ifndef SENSOR_TIMEOUT_MS
+#define SENSOR_TIMEOUT_MS 100
+#endif
+
+/*
+ * Milliseconds since boot
+ */
+typedef uint32_t (*sensorClock)();
+
+/*
+ * The result of polling a conversion
+ */
+enum sensorPoll {
+  SENSOR_PENDING = 0,
+  SENSOR_DONE,
+  SENSOR_FAILED
+};
+
+/*
+ * Temperature and humidity in hundredths of a unit, the drivers convert in integers so no floating point is used
+ */
+struct sensorSample {
+  centi_t temperature;
+  centi_t humidity;
+};
+
+/*
+ * A sensor that is read in two steps
+ * start() begins a conversion and returns straight away, poll() returns SENSOR_PENDING until the result can be read.
+ * The sensors of all the channels convert at the same time and the loop sleeps in between instead of waiting for each one in turn.
+ */
+class SensorDriver {
+  public:
+  virtual ~SensorDriver() {}
+  virtual const char *name() = 0;
+  virtual bool begin() = 0;
+  virtual bool start(uint32_t now_ms) = 0;
+  virtual sensorPoll poll(uint32_t now_ms, sensorSample *sample) = 0;
+  virtual uint32_t ready_in(uint32_t now_ms) = 0;
+};
+
+/*
+ * Write and read one I2C transaction, they return false when the device did not acknowledge
+ * On the ESP32 they go through Wire, on the native build through the mock bus of MockSensorBus.h
+ */
+typedef bool (*busWrite)(uint8_t address, const uint8_t *data, size_t length);
+typedef bool (*busRead)(uint8_t address, uint8_t *data, size_t length);
+
+struct busCounters {
+  uint32_t transactions;
+  uint32_t bytes;
+  uint32_t nacks;
+};
+
+/*
+ * An I2C bus shared by the drivers
+ * Every transaction is complete when the call returns and no driver keeps the bus while its sensor converts,
+ * so the drivers of one bus never wait for each other and the bus is free between transactions.
+ */
+class SensorBus {
+  private:
+  busWrite writer;
+  busRead reader;
+  busCounters counters;
+
+  public:
+  SensorBus(busWrite writer, busRead reader);
+  bool write(uint8_t address, const uint8_t *data, size_t length);
+  bool read(uint8_t address, uint8_t *data, size_t length);
+  bool read_registers(uint8_t address, uint8_t reg, uint8_t *data, size_t length);
+  busCounters get_counters();
+};
+
+/*
+ * The drivers of the channels and the results of the last acquisition
+ * A driver is attached to each channel, start() starts every conversion and poll() collects the results as they are ready
+ */
+class SensorSet {
+  private:
+  sensorClock clock;
+  SensorDriver *drivers[SENSOR_MAX_CHANNELS];
+  sensorSample samples[SENSOR_MAX_CHANNELS];
+  sensorPoll results[SENSOR_MAX_CHANNELS];
+  bool running;
+  uint32_t started_ms;
+
+  public:
+  SensorSet(sensorClock clock);
+  bool attach(uint8_t channel, SensorDriver *driver);
+  bool begin();
+  void start();
+  bool poll();
+  bool converting();
+  uint32_t next_poll_in();
+  bool get_sample(uint8_t channel, sensorSample *sample);
+  const char *driver_name(uint8_t channel);
+};
+
+#endif
@@ -0,0 +1,82 @@
+#include "Sht3xDriver.h"
+
+Sht3xDriver::Sht3xDriver(SensorBus *bus, uint8_t address) {
+  this->bus = bus;
+  this->address = address;
+  this->ready_ms = 0;
+}
+
+bool Sht3xDriver::command(uint16_t code) {
+  uint8_t data[2] = {static_cast<uint8_t>(code >> 8), static_cast<uint8_t>(code & 0xff)};
+  return this->bus->write(this->address, data, sizeof(data));
+}
+
+const char *Sht3xDriver::name() {
+  return "sht3x";
+}
+
+/*
+ *This method is used to reset the sensor, it returns false if the sensor did not answer.
+ */
+bool Sht3xDriver::begin() {
+  return this->command(SHT3X_SOFT_RESET);
+}
+
+bool Sht3xDriver::start(uint32_t now_ms) {
+  this->ready_ms = now_ms + SHT3X_MEASURE_MS;
+  return this->command(SHT3X_MEASURE_HIGH);
+}
+
+/*
+ *This method is used to read the result once the conversion time has passed.
+ *Each word is followed by its CRC, a result with a wrong CRC is a failed read.
+ */
+sensorPoll Sht3xDriver::poll(uint32_t now_ms, sensorSample *sample) {
+  if (static_cast<int32_t>(now_ms - this->ready_ms) < 0) {
+    return SENSOR_PENDING;
+  }
+  uint8_t data[6];
+  if (!this->bus->read(this->address, data, sizeof(data))) {
+    // Not acknowledged while the measurement is still running
+    return SENSOR_PENDING;
+  }
+  if (sht3x_crc(data, 2) != data[2] || sht3x_crc(data + 3, 2) != data[5]) {
+    return SENSOR_FAILED;
+  }
+  sample->temperature = sht3x_temperature(static_cast<uint16_t>((data[0] << 8) | data[1]));
+  sample->humidity = sht3x_humidity(static_cast<uint16_t>((data[3] << 8) | data[4]));
+  return SENSOR_DONE;
+}
+
+uint32_t Sht3xDriver::ready_in(uint32_t now_ms) {
+  int32_t left = static_cast<int32_t>(this->ready_ms - now_ms);
+  return left > 0 ? left : 1;
+}
+
+/*
+ * A function to compute the CRC-8 of the datasheet, polynomial 0x31 starting from 0xff
+ */
+uint8_t sht3x_crc(const uint8_t *data, size_t length) {
+  uint8_t crc = 0xff;
+  for (size_t i = 0; i < length; i++) {
+    crc ^= data[i];
+    for (uint8_t bit = 0; bit < 8; bit++) {
+      crc = crc & 0x80 ? static_cast<uint8_t>((crc << 1) ^ 0x31) : static_cast<uint8_t>(crc << 1);
+    }
+  }
+  return crc;
+}
+
+/*
+ * A function to convert a raw temperature to hundredths of a degree, T = -45 + 175 * raw / 65535
+ */
+centi_t sht3x_temperature(uint16_t raw) {
+  return static_cast<centi_t>(-4500 + static_cast<int32_t>((17500UL * raw + 32767) / 65535));
+}
+
+/*
+ * A function to convert a raw humidity to hundredths of a percent, RH = 100 * raw / 65535
+ */
+centi_t sht3x_humidity(uint16_t raw) {
+  return static_cast<centi_t>((10000UL * raw + 32767) / 65535);
+}
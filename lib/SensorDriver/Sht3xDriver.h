@@ -0,0 +1,42 @@
+#ifndef Sht3xDriver_h
+#define Sht3xDriver_h
+#include "SensorDriver.h"
+
+/*
+ * The SHT3x answers on 0x44, or on 0x45 when its ADDR pin is pulled high
+ */
+#define SHT3X_ADDRESS 0x44
+#define SHT3X_ADDRESS_ALT 0x45
+
+/*
+ * Single shot measurement with high repeatability and without clock stretching, the sensor does not hold the bus while it converts
+ * and does not acknowledge a read until the result is ready
+ */
+#define SHT3X_MEASURE_HIGH 0x2400
+#define SHT3X_SOFT_RESET 0x30a2
+#define SHT3X_MEASURE_MS 16 // 15.5 ms at most for high repeatability
+
+/*
+ * Sensirion SHT30/31/35 on the shared I2C bus
+ */
+class Sht3xDriver : public SensorDriver {
+  private:
+  SensorBus *bus;
+  uint8_t address;
+  uint32_t ready_ms;
+  bool command(uint16_t code);
+
+  public:
+  Sht3xDriver(SensorBus *bus, uint8_t address);
+  const char *name();
+  bool begin();
+  bool start(uint32_t now_ms);
+  sensorPoll poll(uint32_t now_ms, sensorSample *sample);
+  uint32_t ready_in(uint32_t now_ms);
+};
+
+uint8_t sht3x_crc(const uint8_t *data, size_t length);
+centi_t sht3x_temperature(uint16_t raw);
+centi_t sht3x_humidity(uint16_t raw);
+
+#endif
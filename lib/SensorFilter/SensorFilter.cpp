@@ -0,0 +1,158 @@
+#include "SensorFilter.h"
+
+/*
+ * Scale factor that makes the median absolute deviation comparable to a standard deviation
+ * 1.4826 is stored in ten thousandths
+ */
+static const int32_t MAD_SCALE = 14826;
+
+/*
+ * Smallest deviation from the median that can be treated as an outlier, in hundredths.
+ * The DHT11 reports whole units so a steady window has a MAD of zero,
+ * without this floor a change of a single unit would be rejected.
+ */
+static const int32_t HAMPEL_MIN_DEVIATION = 100;
+
+/*
+ *A function to get the median of a small array of centi_t values
+ *The values are copied into a local buffer and sorted with an insertion sort
+ *count must not be bigger than FILTER_WINDOW_SIZE
+ */
+centi_t median_of(const centi_t *values, size_t count) {
+  centi_t sorted[FILTER_WINDOW_SIZE];
+  for (size_t i = 0; i < count; i++) {
+    centi_t value = values[i];
+    size_t j = i;
+    while (j > 0 && sorted[j - 1] > value) {
+      sorted[j] = sorted[j - 1];
+      j--;
+    }
+    sorted[j] = value;
+  }
+  if (count % 2 == 1) {
+    return sorted[count / 2];
+  }
+  return static_cast<centi_t>((static_cast<int32_t>(sorted[count / 2 - 1]) + sorted[count / 2]) / 2);
+}
+
+ChannelFilter::ChannelFilter() {
+  this->reset();
+}
+
+/*
+ *This method is used to pass a new sample through the filter stages.
+ *The raw sample is always stored in the window so that a real step change is accepted once it fills half the window.
+ *rejected is set to true if the hampel stage replaced the sample.
+ *The method returns the filtered value.
+ */
+centi_t ChannelFilter::apply(centi_t sample, const FilterConfig *config, bool *rejected) {
+  *rejected = false;
+  this->window[this->head] = sample;
+  this->head = (this->head + 1) % FILTER_WINDOW_SIZE;
+  if (this->count < FILTER_WINDOW_SIZE) {
+    this->count++;
+  }
+
+  centi_t value = sample;
+  if (config->hampel || config->median) {
+    centi_t median = median_of(this->window, this->count);
+
+    // The hampel identifier needs at least three samples to have a meaningful deviation
+    if (config->hampel && this->count >= 3) {
+      centi_t deviations[FILTER_WINDOW_SIZE];
+      for (uint8_t i = 0; i < this->count; i++) {
+        int32_t deviation = static_cast<int32_t>(this->window[i]) - median;
+        deviation = deviation < 0 ? -deviation : deviation;
+        deviations[i] = static_cast<centi_t>(deviation > CENTI_MAX ? CENTI_MAX : deviation);
+      }
+      int32_t scaled_mad = static_cast<int32_t>(median_of(deviations, this->count)) * MAD_SCALE / 10000;
+      int32_t threshold = static_cast<int32_t>(static_cast<int64_t>(scaled_mad) * config->hampel_k / 100);
+      if (threshold < HAMPEL_MIN_DEVIATION) {
+        threshold = HAMPEL_MIN_DEVIATION;
+      }
+      int32_t distance = static_cast<int32_t>(sample) - median;
+      if (distance > threshold || -distance > threshold) {
+        value = median;
+        *rejected = true;
+      }
+    }
+    if (config->median) {
+      value = median;
+    }
+  }
+
+  if (config->ewma) {
+    int32_t scaled = static_cast<int32_t>(value) * 100;
+    if (!this->smoothed_primed) {
+      this->smoothed = scaled;
+      this->smoothed_primed = true;
+    } else {
+      this->smoothed += (scaled - this->smoothed) * config->ewma_alpha / 100;
+    }
+    // Round to the nearest hundredth
+    int32_t rounded = this->smoothed >= 0 ? this->smoothed + 50 : this->smoothed - 50;
+    value = static_cast<centi_t>(rounded / 100);
+  }
+  return value;
+}
+
+/*
+ *This method is used to clear the window and the smoother state.
+ */
+void ChannelFilter::reset() {
+  for (uint8_t i = 0; i < FILTER_WINDOW_SIZE; i++) {
+    this->window[i] = 0;
+  }
+  this->head = 0;
+  this->count = 0;
+  this->smoothed = 0;
+  this->smoothed_primed = false;
+}
+
+/*
+ * The default configuration rejects single sample spikes but otherwise passes readings through unchanged
+ */
+ApplicationFilter::ApplicationFilter() {
+  this->config.median = false;
+  this->config.hampel = true;
+  this->config.hampel_k = 300;
+  this->config.ewma = false;
+  this->config.ewma_alpha = 30;
+  this->reset();
+}
+
+/*
+ *This method is used to change the filter stages.
+ *The windows are kept so the change takes effect from the next sample.
+ */
+void ApplicationFilter::set_config(FilterConfig *config) {
+  this->config = *config;
+}
+
+FilterConfig ApplicationFilter::get_config() {
+  return this->config;
+}
+
+/*
+ *This method is used to filter a sample of one of the channels.
+ *It returns the filtered value and counts the samples rejected as outliers.
+ */
+centi_t ApplicationFilter::filter(filterChannel channel, centi_t sample) {
+  bool rejected = false;
+  centi_t value = this->channels[channel].apply(sample, &this->config, &rejected);
+  if (rejected) {
+    this->rejected[channel]++;
+  }
+  return value;
+}
+
+uint32_t ApplicationFilter::rejected_samples(filterChannel channel) {
+  return this->rejected[channel];
+}
+
+void ApplicationFilter::reset() {
+  for (uint8_t i = 0; i < FILTER_CHANNELS; i++) {
+    this->channels[i].reset();
+    this->rejected[i] = 0;
+  }
+}
@@ -0,0 +1,73 @@
+#ifndef SensorFilter_h
+#define SensorFilter_h
+#include <FixedPoint.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Number of samples kept per channel.
+ * The window is a fixed-size ring so the filter never allocates.
+ */
+#ifndef FILTER_WINDOW_SIZE
+#define FILTER_WINDOW_SIZE 5
+#endif
+
+/*
+ * Channels filtered by the application
+ * There is one channel per enclosure measurement
+ */
+enum filterChannel {
+  AVIAN_TEMPERATURE = 0,
+  AVIAN_HUMIDITY,
+  REPTILE_TEMPERATURE,
+  REPTILE_HUMIDITY,
+  FILTER_CHANNELS
+};
+
+/*
+ * The stages of the filter that can be turned on or off
+ * median: output the median of the last FILTER_WINDOW_SIZE samples
+ * hampel: replace a sample with the window median if it is more than hampel_k scaled MADs away from it, hampel_k is in hundredths
+ * ewma: smooth the output with an exponentially weighted moving average, ewma_alpha is the weight of the newest sample in percent
+ * All the samples are in hundredths of a unit so the filter does not use floating point
+ */
+struct FilterConfig {
+  bool median;
+  bool hampel;
+  uint16_t hampel_k;
+  bool ewma;
+  uint8_t ewma_alpha;
+};
+
+class ChannelFilter {
+  private:
+  centi_t window[FILTER_WINDOW_SIZE];
+  uint8_t head;
+  uint8_t count;
+  int32_t smoothed; // hundredths of a centi_t to keep the precision of the smoother
+  bool smoothed_primed;
+
+  public:
+  ChannelFilter();
+  centi_t apply(centi_t sample, const FilterConfig *config, bool *rejected);
+  void reset();
+};
+
+class ApplicationFilter {
+  private:
+  FilterConfig config;
+  ChannelFilter channels[FILTER_CHANNELS];
+  uint32_t rejected[FILTER_CHANNELS];
+
+  public:
+  ApplicationFilter();
+  void set_config(FilterConfig *config);
+  FilterConfig get_config();
+  centi_t filter(filterChannel channel, centi_t sample);
+  uint32_t rejected_samples(filterChannel channel);
+  void reset();
+};
+
+centi_t median_of(const centi_t *values, size_t count);
+
+#endif
@@ -0,0 +1,74 @@
+#include "SharedLimits.h"
+#include <string.h>
+
+ApplicationLimits::ApplicationLimits() {
+  memset(this->buffers, 0, sizeof(this->buffers));
+  this->active.store(&this->buffers[0]);
+  this->version.store(0);
+  this->limits_set.store(false);
+}
+
+/*
+ *This method is used to replace the limits.
+ *Writers are serialized with a mutex, readers are not blocked.
+ */
+void ApplicationLimits::set_limits(Limits *limits) {
+  std::lock_guard<std::mutex> lock(this->writer);
+  this->write(limits);
+}
+
+/*
+ *This method is used to replace the limits only if they changed, with commit called first under the writer lock.
+ *The check, commit and swap of two callers can not interleave, so what commit saved is always what is in use.
+ *It returns false if commit failed, the limits in use are kept.
+ */
+bool ApplicationLimits::update_limits(Limits *limits, limitsCommit commit) {
+  std::lock_guard<std::mutex> lock(this->writer);
+  if (this->limits_set.load(std::memory_order_relaxed) && memcmp(this->active.load(std::memory_order_relaxed), limits, sizeof(Limits)) == 0) {
+    return true;
+  }
+  if (commit != NULL && !commit(limits)) {
+    return false;
+  }
+  this->write(limits);
+  return true;
+}
+
+/*
+ *This method is used to write the buffer that is not in use and swap it in, the writer lock must be held.
+ */
+void ApplicationLimits::write(const Limits *limits) {
+  Limits *current = this->active.load(std::memory_order_relaxed);
+  Limits *next = current == &this->buffers[0] ? &this->buffers[1] : &this->buffers[0];
+
+  this->version.fetch_add(1, std::memory_order_acq_rel);
+  *next = *limits;
+  this->active.store(next, std::memory_order_release);
+  this->version.fetch_add(1, std::memory_order_release);
+  this->limits_set.store(true, std::memory_order_release);
+}
+
+/*
+ *This method is used to get a consistent copy of the limits.
+ *If a write started or finished while copying, the buffer that was copied may have been overwritten so it is copied again.
+ */
+Limits ApplicationLimits::get_limits() {
+  Limits limits;
+  uint32_t before;
+  uint32_t after;
+  do {
+    before = this->version.load(std::memory_order_acquire);
+    limits = *this->active.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    after = this->version.load(std::memory_order_relaxed);
+  } while (before != after);
+  return limits;
+}
+
+bool ApplicationLimits::limits_are_set() {
+  return this->limits_set.load(std::memory_order_acquire);
+}
+
+void ApplicationLimits::reset_limits() {
+  this->limits_set.store(false, std::memory_order_release);
+}
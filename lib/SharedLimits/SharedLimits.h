@@ -0,0 +1,38 @@
+#ifndef SharedLimits_h
+#define SharedLimits_h
+#include <Classifier.h>
+#include <atomic>
+#include <mutex>
+
+/*
+ * Called by update_limits() with the writer lock held before new limits are used, e.g to save them
+ * It returns false to keep the limits in use
+ */
+typedef bool (*limitsCommit)(const Limits *limits);
+
+/*
+ * The limits are double buffered so they can be replaced while the readings are being analyzed
+ * set_limits() writes the buffer that is not in use and then swaps the active pointer,
+ * get_limits() copies the active buffer and copies again if a write finished or started in the meantime.
+ * The limits can be set from the web server task and the MQTT callback while the loop reads them,
+ * a reader never sees a half written Limits and never waits for a writer.
+ */
+class ApplicationLimits {
+  private:
+  Limits buffers[2];
+  std::atomic<Limits *> active;
+  std::atomic<uint32_t> version; // odd while a write is in progress
+  std::atomic<bool> limits_set;
+  std::mutex writer;
+  void write(const Limits *limits);
+
+  public:
+  ApplicationLimits();
+  void set_limits(Limits *limits);
+  bool update_limits(Limits *limits, limitsCommit commit);
+  Limits get_limits();
+  bool limits_are_set();
+  void reset_limits();
+};
+
+#endif
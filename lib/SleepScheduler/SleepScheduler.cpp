@@ -0,0 +1,157 @@
+#include "SleepScheduler.h"
+#include <string.h>
+
+/*
+ * True when time a is at or after time b, the clock wraps after 49 days
+ */
+static bool reached(uint32_t a, uint32_t b) {
+  return static_cast<int32_t>(a - b) >= 0;
+}
+
+SleepScheduler::SleepScheduler(schedulerClock clock, sleepBackend backend) {
+  this->clock = clock;
+  this->backend = backend;
+  this->count = 0;
+  this->max_sleep_ms = SCHEDULER_MAX_SLEEP_MS;
+  this->woke_ms = 0;
+  memset(this->events, 0, sizeof(this->events));
+  memset(&this->counters, 0, sizeof(this->counters));
+}
+
+/*
+ *This method is used to add an event that is due every period_ms, the first time one period from now.
+ *It returns the id of the event or -1 if SCHEDULER_MAX_EVENTS events have already been added.
+ */
+int8_t SleepScheduler::add(uint32_t period_ms) {
+  if (this->count >= SCHEDULER_MAX_EVENTS) {
+    return -1;
+  }
+  uint32_t now = this->clock();
+  scheduledEvent *e = &this->events[this->count];
+  e->period_ms = period_ms;
+  e->started_ms = now;
+  e->next_ms = now + period_ms;
+  e->enabled = true;
+  if (this->count == 0) {
+    this->woke_ms = now;
+  }
+  return this->count++;
+}
+
+/*
+ *This method is used to change the period of an event, the current period is shortened or stretched to the new one.
+ */
+void SleepScheduler::set_period(int8_t event, uint32_t period_ms) {
+  scheduledEvent *e = &this->events[event];
+  e->period_ms = period_ms;
+  e->next_ms = e->started_ms + period_ms;
+}
+
+/*
+ *This method is used to stop and start an event, a disabled event never wakes the loop.
+ *An event that was due while it was disabled is due as soon as it is enabled.
+ */
+void SleepScheduler::set_enabled(int8_t event, bool enabled) {
+  this->events[event].enabled = enabled;
+}
+
+void SleepScheduler::set_max_sleep(uint32_t max_sleep_ms) {
+  this->max_sleep_ms = max_sleep_ms;
+}
+
+/*
+ *This method is used to check if an event is due, a due event starts its next period.
+ */
+bool SleepScheduler::due(int8_t event) {
+  scheduledEvent *e = &this->events[event];
+  uint32_t now = this->clock();
+  if (!e->enabled || !reached(now, e->next_ms)) {
+    return false;
+  }
+  e->started_ms = now;
+  e->next_ms = now + e->period_ms;
+  return true;
+}
+
+/*
+ *This method is used to start a new period of an event now e.g after a reading was requested outside of the schedule.
+ */
+void SleepScheduler::restart(int8_t event) {
+  scheduledEvent *e = &this->events[event];
+  e->started_ms = this->clock();
+  e->next_ms = e->started_ms + e->period_ms;
+}
+
+/*
+ *This method is used to make an event due after delay_ms instead of at the end of its period e.g to try a failed read again.
+ */
+void SleepScheduler::run_in(int8_t event, uint32_t delay_ms) {
+  this->events[event].next_ms = this->clock() + delay_ms;
+}
+
+/*
+ *This method is used to get the time until the next enabled event is due, at most the longest sleep.
+ */
+uint32_t SleepScheduler::next_due_in() {
+  uint32_t now = this->clock();
+  uint32_t next = this->max_sleep_ms;
+  for (uint8_t i = 0; i < this->count; i++) {
+    scheduledEvent *e = &this->events[i];
+    if (!e->enabled) {
+      continue;
+    }
+    if (reached(now, e->next_ms)) {
+      return 0;
+    }
+    if (e->next_ms - now < next) {
+      next = e->next_ms - now;
+    }
+  }
+  return next;
+}
+
+/*
+ *This method is used to sleep at the end of a pass of the loop until the next event is due or the backend is woken.
+ *The loop does not sleep when an event is already due.
+ */
+wakeReason SleepScheduler::sleep() {
+  uint32_t now = this->clock();
+  this->counters.awake_ms += now - this->woke_ms;
+  this->woke_ms = now;
+  uint32_t duration = this->next_due_in();
+  if (duration == 0) {
+    return WAKE_TIMER;
+  }
+  wakeReason reason = this->backend(duration);
+  uint32_t after = this->clock();
+  this->counters.asleep_ms += after - now;
+  this->counters.wakes[reason]++;
+  this->woke_ms = after;
+  return reason;
+}
+
+sleepCounters SleepScheduler::get_counters() {
+  return this->counters;
+}
+
+/*
+ *This method is used to get the share of the time the loop was awake since boot, in thousandths.
+ */
+uint16_t SleepScheduler::duty_cycle_permille() {
+  uint64_t total = this->counters.awake_ms + this->counters.asleep_ms;
+  if (total == 0) {
+    return 1000;
+  }
+  return static_cast<uint16_t>(this->counters.awake_ms * 1000 / total);
+}
+
+const char *wake_reason_name(wakeReason reason) {
+  switch (reason) {
+  case WAKE_BUTTON:
+    return "button";
+  case WAKE_NETWORK:
+    return "network";
+  default:
+    return "timer";
+  }
+}
@@ -0,0 +1,84 @@
+#ifndef SleepScheduler_h
+#define SleepScheduler_h
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef SCHEDULER_MAX_EVENTS
+#define SCHEDULER_MAX_EVENTS 8
+#endif
+
+/*
+ * The longest the loop sleeps even when nothing is due, so the work done on every pass such as the QoS 1 retransmissions
+ * and feeding the watchdog still happens at least this often
+ */
+#ifndef SCHEDULER_MAX_SLEEP_MS
+#define SCHEDULER_MAX_SLEEP_MS 1000
+#endif
+
+/*
+ * Why the loop woke up
+ */
+enum wakeReason {
+  WAKE_TIMER = 0,
+  WAKE_BUTTON,
+  WAKE_NETWORK,
+  WAKE_REASON_COUNT
+};
+
+/*
+ * Milliseconds since boot
+ */
+typedef uint32_t (*schedulerClock)();
+
+/*
+ * Sleeps for at most duration_ms and returns why it woke, WAKE_TIMER when the time ran out
+ * On the ESP32 the loop task blocks on a task notification given by the button interrupts and the WiFi events,
+ * on the native build a virtual clock is moved forward
+ */
+typedef wakeReason (*sleepBackend)(uint32_t duration_ms);
+
+struct scheduledEvent {
+  uint32_t period_ms;
+  uint32_t started_ms; // the time the current period started
+  uint32_t next_ms;
+  bool enabled;
+};
+
+struct sleepCounters {
+  uint32_t wakes[WAKE_REASON_COUNT];
+  uint64_t asleep_ms;
+  uint64_t awake_ms;
+};
+
+/*
+ * Works out when the next event of the loop is due and sleeps until then
+ * Each event has a period, due() returns true once per period. An event can be moved with run_in(), e.g a retry.
+ */
+class SleepScheduler {
+  private:
+  schedulerClock clock;
+  sleepBackend backend;
+  scheduledEvent events[SCHEDULER_MAX_EVENTS];
+  uint8_t count;
+  uint32_t max_sleep_ms;
+  uint32_t woke_ms;
+  sleepCounters counters;
+
+  public:
+  SleepScheduler(schedulerClock clock, sleepBackend backend);
+  int8_t add(uint32_t period_ms);
+  void set_period(int8_t event, uint32_t period_ms);
+  void set_enabled(int8_t event, bool enabled);
+  void set_max_sleep(uint32_t max_sleep_ms);
+  bool due(int8_t event);
+  void restart(int8_t event);
+  void run_in(int8_t event, uint32_t delay_ms);
+  uint32_t next_due_in();
+  wakeReason sleep();
+  sleepCounters get_counters();
+  uint16_t duty_cycle_permille();
+};
+
+const char *wake_reason_name(wakeReason reason);
+
+#endif
@@ -0,0 +1,203 @@
+#include "StallMonitor.h"
+#include <Logger.h>
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * The deadline of each stage, in the order of loopStage
+ */
+static const uint32_t default_deadlines[STAGE_COUNT] = {
+    0,
+    STAGE_WIFI_DEADLINE_MS,
+    STAGE_MQTT_CONNECT_DEADLINE_MS,
+    STAGE_COMMANDS_DEADLINE_MS,
+    STAGE_SENSORS_DEADLINE_MS,
+    STAGE_PUBLISH_DEADLINE_MS,
+};
+
+StallMonitor::StallMonitor(stallRecord *record, stageClock clock, watchdogFeed feed_watchdog) {
+  this->record = record;
+  this->clock = clock;
+  this->feed_watchdog = feed_watchdog;
+  memcpy(this->deadlines, default_deadlines, sizeof(this->deadlines));
+  this->warned = false;
+  this->has_report = false;
+  memset(&this->report, 0, sizeof(this->report));
+}
+
+/*
+ *This method is used to pick up the record of the previous boot and start a new one, it should be called once early in setup().
+ *The method returns true if the previous boot reset during a stage or had a stage go over its deadline.
+ */
+bool StallMonitor::begin() {
+  std::lock_guard<std::mutex> guard(this->lock);
+  stallRecord *r = this->record;
+  bool valid = r->magic == STALL_RECORD_MAGIC && r->check == ~STALL_RECORD_MAGIC && r->stage < STAGE_COUNT && r->stall_stage < STAGE_COUNT;
+  this->has_report = false;
+  if (valid && r->stage != STAGE_NONE) {
+    this->report.stage = static_cast<loopStage>(r->stage);
+    this->report.in_progress = true;
+    this->report.deadline_ms = r->deadline_ms;
+    this->report.elapsed_ms = r->elapsed_ms;
+    this->report.uptime_ms = r->started_ms + r->elapsed_ms;
+    this->report.stalls = r->stalls;
+    this->has_report = true;
+  } else if (valid && r->stalls > 0) {
+    this->report.stage = static_cast<loopStage>(r->stall_stage);
+    this->report.in_progress = false;
+    this->report.deadline_ms = r->stall_deadline_ms;
+    this->report.elapsed_ms = r->stall_elapsed_ms;
+    this->report.uptime_ms = r->stall_uptime_ms;
+    this->report.stalls = r->stalls;
+    this->has_report = true;
+  }
+
+  memset(r, 0, sizeof(stallRecord));
+  r->magic = STALL_RECORD_MAGIC;
+  r->check = ~STALL_RECORD_MAGIC;
+  return this->has_report;
+}
+
+/*
+ *This method is used to change the deadline of a stage from the one set at build time.
+ */
+void StallMonitor::set_deadline(loopStage stage, uint32_t deadline_ms) {
+  std::lock_guard<std::mutex> guard(this->lock);
+  this->deadlines[stage] = deadline_ms;
+}
+
+/*
+ *This method is used to record the time the running stage took, the lock must be held.
+ */
+void StallMonitor::finish(uint32_t now) {
+  stallRecord *r = this->record;
+  uint32_t elapsed = now - r->started_ms;
+  r->elapsed_ms = elapsed;
+  if (elapsed > r->deadline_ms) {
+    r->stalls++;
+    r->stall_stage = r->stage;
+    r->stall_deadline_ms = r->deadline_ms;
+    r->stall_elapsed_ms = elapsed;
+    r->stall_uptime_ms = now;
+    LOG_WARN("Stage %s took %lu ms, its deadline is %lu ms", stage_name(static_cast<loopStage>(r->stage)),
+             static_cast<unsigned long>(elapsed), static_cast<unsigned long>(r->deadline_ms));
+  }
+  r->stage = STAGE_NONE;
+}
+
+/*
+ *This method is used to start a stage of the loop, a stage that is still running is finished first.
+ *It feeds the watchdog, the loop is making progress.
+ */
+void StallMonitor::enter(loopStage stage) {
+  uint32_t now = this->clock();
+  {
+    std::lock_guard<std::mutex> guard(this->lock);
+    stallRecord *r = this->record;
+    if (r->stage != STAGE_NONE) {
+      this->finish(now);
+    }
+    r->started_ms = now;
+    r->deadline_ms = this->deadlines[stage];
+    r->elapsed_ms = 0;
+    r->stage = stage;
+    this->warned = false;
+  }
+  this->feed();
+}
+
+/*
+ *This method is used to finish the running stage and feed the watchdog.
+ */
+void StallMonitor::leave() {
+  uint32_t now = this->clock();
+  {
+    std::lock_guard<std::mutex> guard(this->lock);
+    if (this->record->stage != STAGE_NONE) {
+      this->finish(now);
+    }
+  }
+  this->feed();
+}
+
+/*
+ *This method is used to feed the watchdog when the loop makes progress outside of a stage e.g at the start of each pass.
+ */
+void StallMonitor::feed() {
+  if (this->feed_watchdog != NULL) {
+    this->feed_watchdog();
+  }
+}
+
+/*
+ *This method is used to update how long the running stage has taken, it is called periodically from a timer.
+ *A stage that goes over its deadline is logged once while it is still running.
+ *The method returns true if the running stage is over its deadline.
+ */
+bool StallMonitor::check() {
+  uint32_t now = this->clock();
+  std::lock_guard<std::mutex> guard(this->lock);
+  stallRecord *r = this->record;
+  if (r->stage == STAGE_NONE) {
+    return false;
+  }
+  r->elapsed_ms = now - r->started_ms;
+  if (r->elapsed_ms <= r->deadline_ms) {
+    return false;
+  }
+  if (!this->warned) {
+    LOG_WARN("Stage %s is over its %lu ms deadline", stage_name(static_cast<loopStage>(r->stage)), static_cast<unsigned long>(r->deadline_ms));
+    this->warned = true;
+  }
+  return true;
+}
+
+/*
+ *This method is used to get what the previous boot left behind, it returns false if there was nothing to report.
+ */
+bool StallMonitor::get_report(stallReport *report) {
+  std::lock_guard<std::mutex> guard(this->lock);
+  if (this->has_report) {
+    *report = this->report;
+  }
+  return this->has_report;
+}
+
+uint32_t StallMonitor::get_stalls() {
+  std::lock_guard<std::mutex> guard(this->lock);
+  return this->record->stalls;
+}
+
+const char *stage_name(loopStage stage) {
+  switch (stage) {
+  case STAGE_WIFI:
+    return "wifi";
+  case STAGE_MQTT_CONNECT:
+    return "mqtt_connect";
+  case STAGE_COMMANDS:
+    return "commands";
+  case STAGE_SENSORS:
+    return "sensors";
+  case STAGE_PUBLISH:
+    return "publish";
+  default:
+    return "none";
+  }
+}
+
+/*
+ *A function to write the report of the previous boot as JSON
+ *e.g {"reset":"task_wdt","stage":"mqtt_connect","in_progress":true,"elapsed_ms":30004,"deadline_ms":10000,"uptime_ms":61230,"stalls":1}
+ *It returns the length of the report or 0 if it did not fit in output
+ */
+size_t format_stall_report(char *output, size_t size, const stallReport *report, const char *reset_reason) {
+  int length = snprintf(output, size,
+                        "{\"reset\":\"%s\",\"stage\":\"%s\",\"in_progress\":%s,\"elapsed_ms\":%lu,\"deadline_ms\":%lu,\"uptime_ms\":%lu,\"stalls\":%lu}",
+                        reset_reason, stage_name(report->stage), report->in_progress ? "true" : "false",
+                        static_cast<unsigned long>(report->elapsed_ms), static_cast<unsigned long>(report->deadline_ms),
+                        static_cast<unsigned long>(report->uptime_ms), static_cast<unsigned long>(report->stalls));
+  if (length < 0 || static_cast<size_t>(length) >= size) {
+    return 0;
+  }
+  return length;
+}
@@ -0,0 +1,121 @@
+#ifndef StallMonitor_h
+#define StallMonitor_h
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Deadlines of the stages of the loop in milliseconds, a stage that runs longer is recorded as a stall
+ * The WiFi stage includes the 5 second connection timeout and the MQTT stage the TCP connect and the wait for the CONNACK
+ */
+#ifndef STAGE_WIFI_DEADLINE_MS
+#define STAGE_WIFI_DEADLINE_MS 8000
+#endif
+#ifndef STAGE_MQTT_CONNECT_DEADLINE_MS
+#define STAGE_MQTT_CONNECT_DEADLINE_MS 10000
+#endif
+#ifndef STAGE_COMMANDS_DEADLINE_MS
+#define STAGE_COMMANDS_DEADLINE_MS 2000
+#endif
+#ifndef STAGE_SENSORS_DEADLINE_MS
+#define STAGE_SENSORS_DEADLINE_MS 1000
+#endif
+#ifndef STAGE_PUBLISH_DEADLINE_MS
+#define STAGE_PUBLISH_DEADLINE_MS 500
+#endif
+
+/*
+ * Marks a stall record that was written by this firmware, the memory it lives in is random after a power on
+ */
+#define STALL_RECORD_MAGIC 0x57a11ed0U
+
+/*
+ * Size of the buffer the stall report is formatted into
+ */
+#define STALL_REPORT_SIZE 192
+
+enum loopStage {
+  STAGE_NONE = 0,
+  STAGE_WIFI,
+  STAGE_MQTT_CONNECT,
+  STAGE_COMMANDS,
+  STAGE_SENSORS,
+  STAGE_PUBLISH,
+  STAGE_COUNT
+};
+
+/*
+ * What the monitor keeps across a reset, it is placed in memory that is not cleared at boot (RTC_NOINIT_ATTR on the ESP32)
+ * Every field is 32 bits wide so a reset in the middle of an update cannot leave half of a field written
+ */
+struct stallRecord {
+  uint32_t magic;
+  uint32_t check; // ~magic
+  uint32_t stage; // the stage running, STAGE_NONE between stages
+  uint32_t started_ms;
+  uint32_t deadline_ms;
+  uint32_t elapsed_ms; // how long the stage had been running the last time it was checked
+  uint32_t stalls;     // stages that went over their deadline since boot
+  uint32_t stall_stage; // the last of them
+  uint32_t stall_deadline_ms;
+  uint32_t stall_elapsed_ms;
+  uint32_t stall_uptime_ms;
+};
+
+/*
+ * What the previous boot left behind
+ * in_progress is true when the device reset while the stage was running, e.g the task watchdog fired,
+ * otherwise the stage is the last one that went over its deadline and finished
+ */
+struct stallReport {
+  loopStage stage;
+  bool in_progress;
+  uint32_t deadline_ms;
+  uint32_t elapsed_ms;
+  uint32_t uptime_ms;
+  uint32_t stalls;
+};
+
+/*
+ * Milliseconds since boot
+ */
+typedef uint32_t (*stageClock)();
+
+/*
+ * Feeds the hardware watchdog, esp_task_wdt_reset() on the ESP32
+ */
+typedef void (*watchdogFeed)();
+
+/*
+ * Deadlines for the stages of the loop
+ * The loop enters and leaves each stage, which feeds the watchdog. check() is called from a timer so a stage that hangs
+ * is seen while it runs, and the record shows which stage it was and for how long after the watchdog resets the device.
+ */
+class StallMonitor {
+  private:
+  stallRecord *record;
+  stageClock clock;
+  watchdogFeed feed_watchdog;
+  std::mutex lock;
+  uint32_t deadlines[STAGE_COUNT];
+  bool warned;
+  bool has_report;
+  stallReport report;
+  void finish(uint32_t now);
+
+  public:
+  StallMonitor(stallRecord *record, stageClock clock, watchdogFeed feed_watchdog);
+  bool begin();
+  void set_deadline(loopStage stage, uint32_t deadline_ms);
+  void enter(loopStage stage);
+  void leave();
+  void feed();
+  bool check();
+  bool get_report(stallReport *report);
+  uint32_t get_stalls();
+};
+
+const char *stage_name(loopStage stage);
+size_t format_stall_report(char *output, size_t size, const stallReport *report, const char *reset_reason);
+
+#endif
@@ -3,60 +3,67 @@
 #include <ArduinoJson.h>
 #include <AsyncTCP.h>
 #include <ESPAsyncWebServer.h>
+#include <Logger.h>
 #include <SPIFFS.h>
 
 // Set web server port number to 80
 AsyncWebServer server(80);
 bool server_running = false; // keep track of whether the server is running to prevent multiple server.begin() calls which makes it unpredictable
 
+/*
+ *Initialize the limits that will be used to check the readings and determine the status of the enclosures
+ *They are defined here so that the web server and the MQTT commands can replace them
+ */
+ApplicationLimits application_limits;
+
 void init_spiffs() {
   if (!SPIFFS.begin(true)) {
-    Serial.println("An Error has occurred while mounting SPIFFS");
+    LOG_ERROR("An Error has occurred while mounting SPIFFS");
     return;
   }
-  Serial.println("SPIFFS mounted successfully");
+  LOG_DEBUG("SPIFFS mounted successfully");
 }
 
-String read_file(fs::FS &fs, const char *path) {
-  Serial.printf("Reading file: %s\r\n", path);
+// A function to read the first line of a file into buffer
+// It returns the length of the line, an empty line if the file cannot be read
+size_t read_file(fs::FS &fs, const char *path, char *buffer, size_t size) {
+  LOG_DEBUG("Reading file: %s", path);
+  buffer[0] = '\0';
 
   File file = fs.open(path);
   if (!file || file.isDirectory()) {
-    Serial.println("- failed to open file for reading");
-    return String();
+    LOG_WARN("Failed to open %s for reading", path);
+    return 0;
   }
 
-  String fileContent;
-  while (file.available()) {
-    fileContent = file.readStringUntil('\n');
-    break;
-  }
+  size_t length = file.readBytesUntil('\n', buffer, size - 1);
+  buffer[length] = '\0';
   file.close();
-  return fileContent;
+  return length;
 }
 
 void write_file(fs::FS &fs, const char *path, const char *message) {
-  Serial.printf("Writing file: %s\r\n", path);
+  LOG_DEBUG("Writing file: %s", path);
 
   File file = fs.open(path, FILE_WRITE);
   if (!file) {
-    Serial.println("- failed to open file for writing");
+    LOG_ERROR("Failed to open %s for writing", path);
     return;
   }
   if (file.print(message)) {
-    Serial.println("- file written");
+    LOG_DEBUG("%s written", path);
   } else {
-    Serial.println("- write failed");
+    LOG_ERROR("Writing %s failed", path);
   }
   file.close();
 }
 
 void delete_file(fs::FS &fs, const char *path) {
-  Serial.printf("Deleting file: %s\r\n", path);
+  LOG_DEBUG("Deleting file: %s", path);
   if (fs.remove(path)) {
-    Serial.println("- file deleted");
+    LOG_DEBUG("%s deleted", path);
   } else {
-    Serial.println("- delete failed");
+    LOG_WARN("Deleting %s failed", path);
   }
 }
 
@@ -64,30 +71,27 @@ void delete_file_abstraction(const char *path) {
   delete_file(SPIFFS, path);
 }
 
-bool wifi_connected(String ssid, String password) {
-  if (ssid == "" || password == "") {
+bool wifi_connected(const char *ssid, const char *password) {
+  if (ssid[0] == '\0' || password[0] == '\0') {
     return false;
   }
 
   WiFi.mode(WIFI_STA);
-  WiFi.begin(ssid.c_str(), password.c_str());
-  Serial.println("Connecting to WiFi network: " + ssid);
+  WiFi.begin(ssid, password);
+  LOG_INFO("Connecting to WiFi network: %s", ssid);
   unsigned long start = millis();
   unsigned long elapsed = 0;
 
   while (WiFi.status() != WL_CONNECTED) {
     elapsed = millis() - start;
     if (elapsed > 5000) {
-      Serial.println("Connection timed out");
+      LOG_WARN("Connection timed out");
       return false;
     }
     delay(500);
   }
 
-  Serial.println("");
-  Serial.println("WiFi connected");
-  Serial.println("IP address: ");
-  Serial.println(WiFi.localIP());
+  LOG_INFO("WiFi connected, IP address: %s", WiFi.localIP().toString().c_str());
   return true;
 }
 
@@ -96,28 +100,28 @@ void wifi_config() {
   init_spiffs();
 
   // Read SSID and password from file
-  String ssid = read_file(SPIFFS, "/ssid.txt");
-  String password = read_file(SPIFFS, "/password.txt");
-  Serial.println("SSID: " + ssid);
-  Serial.println("Password: " + password);
+  char ssid[CONFIG_LINE_SIZE];
+  char password[CONFIG_LINE_SIZE];
+  read_file(SPIFFS, "/ssid.txt", ssid, sizeof(ssid));
+  read_file(SPIFFS, "/password.txt", password, sizeof(password));
+  LOG_INFO("SSID: %s", ssid);
+  LOG_DEBUG("Password: %s", LOG_SECRET(password));
 
   bool connected = wifi_connected(ssid, password);
   if (connected) {
-    Serial.println("WiFi connected successfully");
+    LOG_INFO("WiFi connected successfully");
     if (server_running) {
       server.end();
       server_running = false;
     }
   } else {
-    Serial.println("WiFi connection failed");
-    Serial.println("Starting access point");
+    LOG_WARN("WiFi connection failed, starting access point");
 
     // Set WiFi to AP mode
     WiFi.mode(WIFI_AP);
     WiFi.softAP("ESP32-Access-Point", "password");
     IPAddress IP = WiFi.softAPIP();
-    Serial.print("AP IP address: ");
-    Serial.println(IP);
+    LOG_INFO("AP IP address: %s", IP.toString().c_str());
 
     // Start web server
     server.on("/", HTTP_GET, [](AsyncWebServerRequest *request) {
@@ -130,8 +134,8 @@ void wifi_config() {
     server.on("/", HTTP_POST, [](AsyncWebServerRequest *request) {
       String ssid = request->arg("ssid");
       String password = request->arg("pass");
-      Serial.println("SSID: " + ssid);
-      Serial.println("Password: " + password);
+      LOG_INFO("SSID: %s", ssid.c_str());
+      LOG_DEBUG("Password: %s", LOG_SECRET(password.c_str()));
 
       // Write SSID and password to file
       write_file(SPIFFS, "/ssid.txt", ssid.c_str());
@@ -144,72 +148,76 @@ void wifi_config() {
     });
     server_running = true;
     server.begin();
-    Serial.println("Server started, visit");
-    Serial.println(WiFi.softAPIP());
+    LOG_INFO("Server started, visit %s", WiFi.softAPIP().toString().c_str());
   }
 }
 
-// A function to read a json file and return a char pointer
-// Do not forget to free the memory after using the char pointer
-char *read_file_json(fs::FS &fs, const char *path) {
-  Serial.printf("Reading file: %s\r\n", path);
+// A function to read a json file into buffer
+// It returns false if the file cannot be read or does not fit in buffer
+bool read_file_json(fs::FS &fs, const char *path, char *buffer, size_t size) {
+  LOG_DEBUG("Reading file: %s", path);
 
   File file = fs.open(path);
   if (!file || file.isDirectory()) {
-    Serial.println("- failed to open file for reading");
-    return NULL;
+    LOG_WARN("Failed to open %s for reading", path);
+    return false;
   }
 
   size_t fileSize = file.size();
-  char *buffer = (char *)malloc(fileSize + 1); // allocate memory for file contents
-  if (!buffer) {
-    Serial.println("- failed to allocate memory");
-    return NULL;
+  if (fileSize >= size) {
+    LOG_ERROR("%s is %u bytes, it does not fit in %u", path, static_cast<unsigned>(fileSize), static_cast<unsigned>(size));
+    file.close();
+    return false;
   }
 
   size_t bytesRead = file.readBytes(buffer, fileSize); // read file contents into buffer
   buffer[bytesRead] = '\0';                            // terminate buffer with null character
   file.close();
-  return buffer;
+  return true;
+}
+
+// A function to add one set of limits to a json array
+// The values are formatted into numbers, which must hold 4 strings and stay alive until the document is serialized
+static void add_limit_array(JsonArray array, const centi_t *limits, char (*numbers)[CENTI_STRING_SIZE]) {
+  for (uint8_t i = 0; i < 4; i++) {
+    format_centi(limits[i], numbers[i], CENTI_STRING_SIZE);
+    array.add(serialized(static_cast<const char *>(numbers[i])));
+  }
+}
+
+// A function to read one set of limits from a json array
+// Older limits files hold whole numbers and newer ones may hold decimals, both are converted to hundredths
+static void read_limit_array(JsonArray array, centi_t *limits) {
+  for (uint8_t i = 0; i < 4; i++) {
+    limits[i] = centi_from_float(array[i].as<float>());
+  }
 }
 
 // A function to save the limits to a json file
-void save_limits_config(Limits *limits) {
+// It returns false if the limits could not be serialized
+bool save_limits_config(const Limits *limits) {
   // Initialize SPIFFS
   init_spiffs();
 
   // Create a json object
   StaticJsonDocument<384> doc;
 
-  JsonArray avian_temp = doc.createNestedArray("avian_temp");
-  avian_temp.add(limits->avian_temp_limits[0]);
-  avian_temp.add(limits->avian_temp_limits[1]);
-  avian_temp.add(limits->avian_temp_limits[2]);
-  avian_temp.add(limits->avian_temp_limits[3]);
-
-  JsonArray avian_humid = doc.createNestedArray("avian_humid");
-  avian_humid.add(limits->avian_humid_limits[0]);
-  avian_humid.add(limits->avian_humid_limits[1]);
-  avian_humid.add(limits->avian_humid_limits[2]);
-  avian_humid.add(limits->avian_humid_limits[3]);
-
-  JsonArray rept_temp = doc.createNestedArray("rept_temp");
-  rept_temp.add(limits->reptile_temp_limits[0]);
-  rept_temp.add(limits->reptile_temp_limits[1]);
-  rept_temp.add(limits->reptile_temp_limits[2]);
-  rept_temp.add(limits->reptile_temp_limits[3]);
-
-  JsonArray rept_humid = doc.createNestedArray("rept_humid");
-  rept_humid.add(limits->reptile_humid_limits[0]);
-  rept_humid.add(limits->reptile_humid_limits[1]);
-  rept_humid.add(limits->reptile_humid_limits[2]);
-  rept_humid.add(limits->reptile_humid_limits[3]);
-
-  String json;
-  serializeJson(doc, json);
+  // The limits are written straight from hundredths, this holds the text until the document is serialized
+  char numbers[16][CENTI_STRING_SIZE];
+  add_limit_array(doc.createNestedArray("avian_temp"), limits->avian_temp_limits, numbers + 0);
+  add_limit_array(doc.createNestedArray("avian_humid"), limits->avian_humid_limits, numbers + 4);
+  add_limit_array(doc.createNestedArray("rept_temp"), limits->reptile_temp_limits, numbers + 8);
+  add_limit_array(doc.createNestedArray("rept_humid"), limits->reptile_humid_limits, numbers + 12);
+
+  char json[LIMITS_FILE_SIZE];
+  if (serializeJson(doc, json, sizeof(json)) == 0) {
+    LOG_ERROR("Failed to serialize the limits");
+    return false;
+  }
 
   // Write the json to a file
-  write_file(SPIFFS, "/limits.json", json.c_str());
+  write_file(SPIFFS, "/limits.json", json);
+  return true;
 }
 
 // A function to read the limits from a json file
@@ -217,47 +225,23 @@ Limits read_limits_from_file() {
   // Initialize SPIFFS
   init_spiffs();
 
-  char *json = read_file_json(SPIFFS, "/limits.json");
-  if (json == NULL) {
-    Serial.println("Failed to read limits.json");
-    free(json);
+  char json[LIMITS_FILE_SIZE];
+  if (!read_file_json(SPIFFS, "/limits.json", json, sizeof(json))) {
+    LOG_ERROR("Failed to read limits.json");
     return Limits();
   }
   StaticJsonDocument<384> doc;
   DeserializationError error = deserializeJson(doc, json);
   if (error) {
-    Serial.println("Failed to deserialize limits.json");
-    Serial.println(error.c_str());
-    free(json);
+    LOG_ERROR("Failed to deserialize limits.json: %s", error.c_str());
     return Limits();
   }
 
   Limits limits;
-  JsonArray avian_temp = doc["avian_temp"];
-  limits.avian_temp_limits[0] = static_cast<uint16_t>(avian_temp[0]);
-  limits.avian_temp_limits[1] = static_cast<uint16_t>(avian_temp[1]);
-  limits.avian_temp_limits[2] = static_cast<uint16_t>(avian_temp[2]);
-  limits.avian_temp_limits[3] = static_cast<uint16_t>(avian_temp[3]);
-
-  JsonArray avian_humid = doc["avian_humid"];
-  limits.avian_humid_limits[0] = static_cast<uint16_t>(avian_humid[0]);
-  limits.avian_humid_limits[1] = static_cast<uint16_t>(avian_humid[1]);
-  limits.avian_humid_limits[2] = static_cast<uint16_t>(avian_humid[2]);
-  limits.avian_humid_limits[3] = static_cast<uint16_t>(avian_humid[3]);
-
-  JsonArray rept_temp = doc["rept_temp"];
-  limits.reptile_temp_limits[0] = static_cast<uint16_t>(rept_temp[0]);
-  limits.reptile_temp_limits[1] = static_cast<uint16_t>(rept_temp[1]);
-  limits.reptile_temp_limits[2] = static_cast<uint16_t>(rept_temp[2]);
-  limits.reptile_temp_limits[3] = static_cast<uint16_t>(rept_temp[3]);
-
-  JsonArray rept_humid = doc["rept_humid"];
-  limits.reptile_humid_limits[0] = static_cast<uint16_t>(rept_humid[0]);
-  limits.reptile_humid_limits[1] = static_cast<uint16_t>(rept_humid[1]);
-  limits.reptile_humid_limits[2] = static_cast<uint16_t>(rept_humid[2]);
-  limits.reptile_humid_limits[3] = static_cast<uint16_t>(rept_humid[3]);
-
-  free(json);
+  read_limit_array(doc["avian_temp"], limits.avian_temp_limits);
+  read_limit_array(doc["avian_humid"], limits.avian_humid_limits);
+  read_limit_array(doc["rept_temp"], limits.reptile_temp_limits);
+  read_limit_array(doc["rept_humid"], limits.reptile_humid_limits);
   return limits;
 }
 
@@ -268,7 +252,7 @@ bool limits_file_exists() {
 
   bool exists = SPIFFS.exists("/limits.json");
   if (!exists) {
-    Serial.println("limits.json does not exist");
+    LOG_INFO("limits.json does not exist");
     return false;
   }
   return true;
@@ -301,63 +285,78 @@ void get_limits() {
   server_running = true;
 }
 
-// Parse the request body
-void parse_body(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
+// A function to read limits in the limits.json format from a buffer
+// It is used for the web form and for limits pushed over MQTT
+bool parse_limits_json(const uint8_t *data, size_t len, Limits *limits) {
   StaticJsonDocument<384> doc;
   DeserializationError error = deserializeJson(doc, data, len);
   if (error) {
-    Serial.println("Failed to deserialize request body");
-    Serial.println(error.c_str());
-    request->send(400);
-    return;
+    LOG_WARN("Failed to deserialize limits: %s", error.c_str());
+    return false;
   }
-
-  // Get the limits from the request body
-  Limits limits;
-  JsonArray avian_temp = doc["avian_temp"];
-  limits.avian_temp_limits[0] = static_cast<uint16_t>(avian_temp[0]);
-  limits.avian_temp_limits[1] = static_cast<uint16_t>(avian_temp[1]);
-  limits.avian_temp_limits[2] = static_cast<uint16_t>(avian_temp[2]);
-  limits.avian_temp_limits[3] = static_cast<uint16_t>(avian_temp[3]);
-
-  JsonArray avian_humid = doc["avian_humid"];
-  limits.avian_humid_limits[0] = static_cast<uint16_t>(avian_humid[0]);
-  limits.avian_humid_limits[1] = static_cast<uint16_t>(avian_humid[1]);
-  limits.avian_humid_limits[2] = static_cast<uint16_t>(avian_humid[2]);
-  limits.avian_humid_limits[3] = static_cast<uint16_t>(avian_humid[3]);
-
-  JsonArray rept_temp = doc["rept_temp"];
-  limits.reptile_temp_limits[0] = static_cast<uint16_t>(rept_temp[0]);
-  limits.reptile_temp_limits[1] = static_cast<uint16_t>(rept_temp[1]);
-  limits.reptile_temp_limits[2] = static_cast<uint16_t>(rept_temp[2]);
-  limits.reptile_temp_limits[3] = static_cast<uint16_t>(rept_temp[3]);
-
-  JsonArray rept_humid = doc["rept_humid"];
-  limits.reptile_humid_limits[0] = static_cast<uint16_t>(rept_humid[0]);
-  limits.reptile_humid_limits[1] = static_cast<uint16_t>(rept_humid[1]);
-  limits.reptile_humid_limits[2] = static_cast<uint16_t>(rept_humid[2]);
-  limits.reptile_humid_limits[3] = static_cast<uint16_t>(rept_humid[3]);
-
-  // Save the limits to the limits.json file
-  save_limits_config(&limits);
-
-  // Send a response
-  request->send(200, "text/plain", "Limits saved successfully");
+  const char *keys[4] = {"avian_temp", "avian_humid", "rept_temp", "rept_humid"};
+  for (uint8_t i = 0; i < 4; i++) {
+    JsonArray array = doc[keys[i]];
+    if (array.isNull() || array.size() != 4) {
+      LOG_WARN("Limits are missing a value");
+      return false;
+    }
+  }
+  read_limit_array(doc["avian_temp"], limits->avian_temp_limits);
+  read_limit_array(doc["avian_humid"], limits->avian_humid_limits);
+  read_limit_array(doc["rept_temp"], limits->reptile_temp_limits);
+  read_limit_array(doc["rept_humid"], limits->reptile_humid_limits);
+  return true;
 }
 
-ApplicationLimits::ApplicationLimits() {}
-void ApplicationLimits::set_limits(Limits *limits) {
-  this->limits = *limits;
-  this->limits_set = true;
+// A function to check one set of limits
+// The values must be between lowest and highest and strictly increasing, the same as the checks of the limits page
+static bool validate_limit_array(const centi_t *limits, centi_t lowest, centi_t highest) {
+  for (uint8_t i = 0; i < 4; i++) {
+    if (limits[i] < lowest || limits[i] > highest) {
+      return false;
+    }
+    if (i > 0 && limits[i] <= limits[i - 1]) {
+      return false;
+    }
+  }
+  return true;
 }
-Limits ApplicationLimits::get_limits() {
-  return this->limits;
+
+bool validate_limits(const Limits *limits) {
+  return validate_limit_array(limits->avian_temp_limits, TEMPERATURE_LIMIT_MIN, TEMPERATURE_LIMIT_MAX) &&
+         validate_limit_array(limits->avian_humid_limits, HUMIDITY_LIMIT_MIN, HUMIDITY_LIMIT_MAX) &&
+         validate_limit_array(limits->reptile_temp_limits, TEMPERATURE_LIMIT_MIN, TEMPERATURE_LIMIT_MAX) &&
+         validate_limit_array(limits->reptile_humid_limits, HUMIDITY_LIMIT_MIN, HUMIDITY_LIMIT_MAX);
 }
 
-bool ApplicationLimits::limits_are_set() {
-  return this->limits_set;
+// A function to validate, save and start using new limits
+// The file is only written if the limits changed because retained limits are received again on every reconnect
+// It runs on the web server task and in the MQTT callback, the check, the save and the swap are done under the writer lock of the limits
+// It returns false if the limits are not valid or could not be saved
+bool apply_limits(Limits *limits) {
+  if (!validate_limits(limits)) {
+    LOG_WARN("Limits are not valid");
+    return false;
+  }
+  return application_limits.update_limits(limits, save_limits_config);
 }
 
-void ApplicationLimits::reset_limits() {
-  this->limits_set = false;
-}
\ No newline at end of file
+// Parse the request body
+void parse_body(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
+  // Get the limits from the request body
+  Limits limits;
+  if (!parse_limits_json(data, len, &limits)) {
+    request->send(400);
+    return;
+  }
+
+  // Save the limits to the limits.json file and start using them straight away
+  if (!apply_limits(&limits)) {
+    request->send(400, "text/plain", "Limits are not valid");
+    return;
+  }
+
+  // Send a response
+  request->send(200, "text/plain", "Limits saved successfully");
+}
@@ -1,44 +1,50 @@
 #ifndef UserConfig_h
 #define UserConfig_h
 #include <Arduino.h>
+#include <Classifier.h>
 #include <ESPAsyncWebServer.h>
+#include <FixedPoint.h>
 #include <SPIFFS.h>
+#include <SharedLimits.h>
 #include <WiFi.h>
 
+/*
+ * Sizes of the buffers the configuration files are read into
+ * An SSID is at most 32 characters and a WPA2 passphrase at most 63
+ */
+#define CONFIG_LINE_SIZE 64
+#define LIMITS_FILE_SIZE 384
+
+/*
+ * The range each limit must be in, in hundredths, the same as the inputs of the limits page
+ * so limits received over MQTT or read from limits.json are held to what the page accepts
+ */
+#define TEMPERATURE_LIMIT_MIN (15 * CENTI_SCALE)
+#define TEMPERATURE_LIMIT_MAX (100 * CENTI_SCALE)
+#define HUMIDITY_LIMIT_MIN (15 * CENTI_SCALE)
+#define HUMIDITY_LIMIT_MAX (100 * CENTI_SCALE)
+
 // Function declarations
 void init_spiffs();
-String read_file(fs::FS &fs, const char *path);
+size_t read_file(fs::FS &fs, const char *path, char *buffer, size_t size);
 void write_file(fs::FS &fs, const char *path, const char *message);
 void delete_file(fs::FS &fs, const char *path);
 void delete_file_abstraction(const char *path);
-bool wifi_connected(String ssid, String password);
+bool wifi_connected(const char *ssid, const char *password);
 void wifi_config();
 extern AsyncWebServer server;
 extern bool server_running;
 
-struct Limits {
-  uint16_t avian_temp_limits[4];
-  uint16_t avian_humid_limits[4];
-  uint16_t reptile_temp_limits[4];
-  uint16_t reptile_humid_limits[4];
-};
 bool limits_file_exists();
-char *read_file_json(fs::FS &fs, const char *path);
+bool read_file_json(fs::FS &fs, const char *path, char *buffer, size_t size);
 Limits read_limits_from_file();
-void save_limits_config(Limits *limits);
+bool save_limits_config(const Limits *limits);
+bool parse_limits_json(const uint8_t *data, size_t len, Limits *limits);
+bool validate_limits(const Limits *limits);
+bool apply_limits(Limits *limits);
 void get_limits();
 void parse_body(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total);
-class ApplicationLimits {
-  private:
-  Limits limits;
-  bool limits_set;
 
-  public:
-  ApplicationLimits();
-  void set_limits(Limits *limits);
-  Limits get_limits();
-  bool limits_are_set();
-  void reset_limits();
-};
+extern ApplicationLimits application_limits;
 
 #endif
\ No newline at end of file
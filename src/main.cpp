@@ -1,10 +1,38 @@
+#include <AckSniffingClient.h> // This is used to pick up the PUBACKs for the QoS 1 messages
+#include <AlarmController.h>   // This is used to decide when the siren goes on and off
 #include <Arduino.h>
 #include <ArduinoJson.h>
-#include <DHT.h>
+#include <Bme280Driver.h>
+#include <BoardSetup.h>      // This is used to set up the pins of the board profile the firmware is built for
+#include <CommandChannel.h> // This is used to dispatch the commands received over MQTT
+#include <DeviceIdentity.h> // This is used to build the client id and the topics of this device
+#include <DhtDriver.h>
+#include <LiveStream.h>     // This is used to push the readings and alarms to browsers on the local network
+#include <Logger.h> // This is used to log without blocking on the serial port
 #include <PubSubClient.h>
 #include <ReadingController.h> // This is used to create and stringify the readings
+#include <ReadingCycle.h>      // This is used to take, analyze and serialize each reading, the same steps as the trace replay
+#include <ReliablePublisher.h> // This is used to publish the readings and alarm events at QoS 1
+#include <SampleClock.h>       // This is used to stamp each sample with the time it was taken and a sequence number
+#include <SensorDriver.h>      // This is used to start the conversions of all the sensors at once and collect them without blocking
+#include <SensorFilter.h>      // This is used to reject outliers in the raw sensor samples
+#include <Sht3xDriver.h>
+#include <SleepScheduler.h>    // This is used to sleep between the events of the loop instead of spinning
+#include <StallMonitor.h>      // This is used to catch stages of the loop that hang and report them after the reset
 #include <UserConfig.h>        // This is used to configure the wifi credentials and the limits for the readings
 #include <WiFi.h>
+#include <Wire.h>
+#include <esp_random.h>
+#include <esp_sntp.h>
+#include <esp_system.h>
+#include <esp_task_wdt.h>
+#include <esp_timer.h>
+
+/*
+ *Initialize the identity of the device
+ *The client id and the topics are built from the MAC address once at boot
+ */
+DeviceIdentity application_identity;
 
 /*
  *Initialize the reading class
@@ -12,51 +40,173 @@
  */
 ApplicationReading application_reading;
 /*
- *Initialize the limits that will be used to check the readings and determine the status of the enclosures
+ *Initialize the filter that sits between reading the sensors and analyzing the readings
+ *A single spike from a DHT11 would otherwise turn on the siren for a whole cycle
+ */
+ApplicationFilter application_filter;
+/*
+ *Initialize the statistics that are published on request
+ */
+ApplicationStats application_stats;
+/*
+ *Initialize the live stream, it keeps working when the MQTT broker cannot be reached
+ */
+LiveStream live_stream;
+
+/*
+ * A function to get the time since boot from the 64 bit timer, unlike millis() it does not wrap after 49 days
+ */
+uint64_t monotonic_ms() {
+  return esp_timer_get_time() / 1000;
+}
+
+/*
+ *Initialize the clock the samples are stamped with
+ *It counts on the monotonic timer between SNTP synchronizations
+ */
+SampleClock sample_clock(monotonic_ms);
+
+/*
+ * Seconds without progress before the task watchdog resets the device
+ * It is longer than the deadline of any stage so a slow stage is recorded before the device is reset
+ */
+#define WATCHDOG_TIMEOUT_S 30
+
+static_assert(WATCHDOG_TIMEOUT_S * 1000UL > STAGE_WIFI_DEADLINE_MS && WATCHDOG_TIMEOUT_S * 1000UL > STAGE_MQTT_CONNECT_DEADLINE_MS,
+              "the watchdog must give the slowest stage time to finish");
+
+/*
+ * The stall record is kept in RTC memory that is not cleared by the reset the watchdog does, only by a power on
+ */
+RTC_NOINIT_ATTR stallRecord stall_record;
+
+uint32_t uptime_ms() {
+  return millis();
+}
+
+void feed_watchdog() {
+  esp_task_wdt_reset();
+}
+
+/*
+ *Initialize the monitor of the stages of the loop
+ *It feeds the task watchdog as the loop moves from one stage to the next and a timer checks the running stage every second
+ */
+StallMonitor stall_monitor(&stall_record, uptime_ms, feed_watchdog);
+esp_timer_handle_t stall_timer;
+
+void check_stages(void *argument) {
+  stall_monitor.check();
+}
+
+/*
+ * The loop task blocks on a task notification between events
+ * The button interrupts and the WiFi events give the notification so the loop wakes straight away, the CPU idles in between
+ */
+TaskHandle_t loop_task = NULL;
+volatile wakeReason wake_source = WAKE_TIMER;
+
+wakeReason sleep_loop_task(uint32_t duration_ms) {
+  if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(duration_ms)) == 0) {
+    return WAKE_TIMER;
+  }
+  return wake_source;
+}
+
+void IRAM_ATTR wake_on_button() {
+  wake_source = WAKE_BUTTON;
+  BaseType_t higher_priority_woken = pdFALSE;
+  vTaskNotifyGiveFromISR(loop_task, &higher_priority_woken);
+  if (higher_priority_woken) {
+    portYIELD_FROM_ISR();
+  }
+}
+
+void wake_on_network(arduino_event_id_t event) {
+  wake_source = WAKE_NETWORK;
+  xTaskNotifyGive(loop_task);
+}
+
+/*
+ *Initialize the scheduler of the loop
+ *The events are added in setup(), each pass of the loop ends with the loop task asleep until the next one is due
+ */
+SleepScheduler scheduler(uptime_ms, sleep_loop_task);
+int8_t commandEvent = -1;
+int8_t mqttEvent = -1;
+
+/*
+ * Set to true to publish the unfiltered readings next to the filtered ones
+ */
+const bool publish_raw_readings = false;
+
+/*
+ * Set to true to also publish warnings and errors on the "logs" topic
  */
-ApplicationLimits application_limits;
+const bool forward_logs = false;
 
 /*
  * A function to check if the limits file exists
- *if the limits file exists, the limits are set and the server is ended
- *if the limits file does not exist, the get_limits() function is called
+ *if the limits file exists and holds valid limits, the limits are set and the server is ended
+ *if the limits file does not exist or is not valid, the get_limits() function is called
  *The get_limits() function starts the server and waits for the user to set the limits
  */
 void setLimits() {
   bool file_exists = limits_file_exists();
-  Serial.println("Checking if limits file exists");
+  LOG_DEBUG("Checking if limits file exists");
   if (file_exists) {
     Limits limits = read_limits_from_file();
-    application_limits.set_limits(&limits);
-    if (server_running) {
-      server.end();
-      server_running = false;
+    if (validate_limits(&limits)) {
+      application_limits.set_limits(&limits);
+      if (server_running) {
+        server.end();
+        server_running = false;
+      }
+      return;
     }
-  } else {
     if (!server_running) {
-      get_limits();
+      LOG_WARN("limits.json is not valid, set the limits on the limits page");
     }
-    delay(3500);
   }
+  if (!server_running) {
+    get_limits();
+  }
+  delay(3500);
 }
 
 /*
- * DHT sensor pins and type
- * The first pin is for the avian enclosure
- * The second pin is for the reptile enclosure
- * The type is the type of DHT sensor
+ * The I2C transactions of the sensor drivers, Wire returns once the transaction is over
  */
-#define DHTPIN1 4
-#define DHTPIN2 13
-#define DHTTYPE DHT11
+bool i2c_write(uint8_t address, const uint8_t *data, size_t length) {
+  Wire.beginTransmission(address);
+  Wire.write(data, length);
+  return Wire.endTransmission() == 0;
+}
+
+bool i2c_read(uint8_t address, uint8_t *data, size_t length) {
+  if (Wire.requestFrom(address, length, true) != length) {
+    return false;
+  }
+  for (size_t i = 0; i < length; i++) {
+    data[i] = static_cast<uint8_t>(Wire.read());
+  }
+  return true;
+}
+
+SensorBus sensor_bus(i2c_write, i2c_read);
+
+/*
+ * The driver of the sensor the board profile fits to each enclosure, the other kinds are not built in
+ */
+typedef SensorFor<Board, ENCLOSURE_AVIAN> AvianSensor;
+typedef SensorFor<Board, ENCLOSURE_REPTILE> ReptileSensor;
+AvianSensor::type avian_sensor = AvianSensor::make(&sensor_bus);
+ReptileSensor::type reptile_sensor = ReptileSensor::make(&sensor_bus);
 
 /*
- * Create two DHT objects
- * The first object is for the avian enclosure
- * The second object is for the reptile enclosure
+ * The sensors of the enclosures, the channel of a sensor is the enclosure it is in
  */
-DHT dhtAvian(DHTPIN1, DHTTYPE);
-DHT dhtReptilian(DHTPIN2, DHTTYPE);
+SensorSet sensors(uptime_ms);
 
 /*
  * MQTT server details
@@ -70,51 +220,44 @@ const char *mqtt_password = "<password>";
 const uint16_t mqtt_port = 1883;
 
 /*
- * GPIO pins used for LED1,LED2 and button
- * LED connected to sirenPin simulates a siren
- * The reset_wifi_pin is used to reset the WiFi credentials
- * The setLimitsPin is used to delete the limits and set new limits
- * LED connected to avianIdealPin, avianWarning and avianCritical indicate the status of the avian enclosure
- * LED connected to reptileIdealPin, reptileWarning and reptileCritical indicate the status of the reptile enclosure
+ * SNTP server the sample clock is synchronized with
+ */
+const char *ntp_server = "pool.ntp.org";
+
+/*
+ * GPIO pins used for the LEDs and the buttons come from the board profile selected by the PlatformIO environment, see BoardProfile.h
+ * LED connected to Board::siren simulates a siren
+ * The Board::reset_wifi button is used to reset the WiFi credentials
+ * The Board::set_limits button is used to open the limits page, the current limits are used until new ones are submitted
+ * LEDs connected to Board::avian_ideal, avian_warning and avian_critical indicate the status of the avian enclosure
+ * LEDs connected to Board::reptile_ideal, reptile_warning and reptile_critical indicate the status of the reptile enclosure
+ */
+
+/*
+ * The siren and the levels the enclosure LEDs show
+ * The pins are driven from it instead of being read back, the same decisions are replayed off the device by tools/replay
  */
-const uint8_t reset_wifi_pin = 15;
-const uint8_t setLimitsPin = 23;
-const uint8_t sirenPin = 2;
-const uint8_t avianIdealPin = 21;
-const uint8_t avianWarning = 19;
-const uint8_t avianCritical = 18;
-const uint8_t reptileIdealPin = 27;
-const uint8_t reptileWarning = 26;
-const uint8_t reptileCritical = 25;
-const uint8_t stop_siren = 22;
+AlarmController alarm_controller;
+
+/*
+ * The acquisition, the filter, the analysis and the alarm of each reading, the trace replay runs the same steps
+ * The sample and sensor events are added to the scheduler in setup()
+ */
+ReadingCycle reading_cycle(&sensors, &scheduler, &application_filter, &sample_clock, &application_reading, &alarm_controller, &application_stats);
 
 /*
  * A function to initialize all the pins
  */
 void initPins() {
-  pinMode(sirenPin, OUTPUT);
-  pinMode(avianIdealPin, OUTPUT);
-  pinMode(avianWarning, OUTPUT);
-  pinMode(avianCritical, OUTPUT);
-  pinMode(reptileIdealPin, OUTPUT);
-  pinMode(reptileWarning, OUTPUT);
-  pinMode(reptileCritical, OUTPUT);
-  pinMode(setLimitsPin, INPUT_PULLUP);
-  pinMode(reset_wifi_pin, INPUT_PULLUP);
-  pinMode(stop_siren, INPUT_PULLUP);
+  init_board_pins<Board>();
 }
 
 /*
- * A function to turn off all the LEDs
+ * A function to turn off all the LEDs and the siren
  */
 void turn_off_leds() {
-  digitalWrite(avianIdealPin, LOW);
-  digitalWrite(avianWarning, LOW);
-  digitalWrite(avianCritical, LOW);
-  digitalWrite(reptileIdealPin, LOW);
-  digitalWrite(reptileWarning, LOW);
-  digitalWrite(reptileCritical, LOW);
-  digitalWrite(sirenPin, LOW);
+  clear_board_outputs<Board>();
+  alarm_controller.clear();
 }
 
 /*
@@ -123,211 +266,294 @@ void turn_off_leds() {
 bool reset = false;
 
 /*
- * Timers for checking MQTT messages and reading DHT sensor
- * This prevents blocking the main thread by using delay() and allows the ESP32 to handle other tasks
+ * Time of the last reading
+ * The readings, the MQTT messages and the connection attempts are timed by the scheduler
  */
-unsigned long lastCheck = 0;
 unsigned long lastRead = 0;
 
 /*
- * A struct to hold the readings from the DHT sensors
+ * Time between two attempts to connect to the broker
+ * A read of the sensors that failed is tried again after SENSOR_RETRY_MS, see ReadingCycle.h
  */
-struct Reading {
-  float avianTemp;
-  float avianHumidity;
-  float reptileTemp;
-  float reptileHumidity;
-};
+const unsigned long mqttRetryInterval = 5000;
 
 /*
- * A function to read the temperature and humidity from the DHT sensor and return a Reading struct
- */
-Reading getReadings() {
-  Reading measurements;
-  while (true) {
-    float h1 = dhtAvian.readHumidity();
-    float t1 = dhtAvian.readTemperature();
-    float h2 = dhtReptilian.readHumidity();
-    float t2 = dhtReptilian.readTemperature();
-    if (!isnan(h1) && !isnan(t1) && !isnan(h2) && !isnan(t2)) {
-      measurements.avianTemp = t1;
-      measurements.avianHumidity = h1;
-      measurements.reptileTemp = t2;
-      measurements.reptileHumidity = h2;
-      break;
-    }
-  }
+ * Time between readings, it can be changed with the "set interval" command
+ */
+unsigned long readInterval = 15000;
 
-  reading avian_unit;
-  reading reptilian_unit;
-  avian_unit.temperature = measurements.avianTemp;
-  avian_unit.humidity = measurements.avianHumidity;
-  reptilian_unit.temperature = measurements.reptileTemp;
-  reptilian_unit.humidity = measurements.reptileHumidity;
-  application_reading.set_reading(&avian_unit, &reptilian_unit);
-  return measurements;
-}
+/*
+ * Flags set by the command handlers and acted on in the loop
+ * The handlers run inside client.loop() where publishing would overwrite the payload being parsed
+ */
+bool sampleRequested = false;
+bool statsRequested = false;
+
+/*
+ * The alarm state last pushed to the live stream
+ */
+enclosureLevels streamedLevels = {LEVEL_IDEAL, LEVEL_IDEAL};
+bool streamedSiren = false;
+bool alarmStreamed = false;
+
+size_t write_packet(const uint8_t *packet, size_t length);
 
 /*
  *Initialize the PubSubClient class by passing in the WiFiClient object
+ *The WiFiClient is wrapped so the PUBACKs PubSubClient ignores are handed to the QoS 1 publisher
+ *Readings and alarm events go through reliable_publisher, everything else is published by the client at QoS 0
  */
 WiFiClient espClient;
-PubSubClient client(espClient);
+ReliablePublisher reliable_publisher(write_packet);
+AckSniffingClient ackClient(espClient, &reliable_publisher);
+PubSubClient client(ackClient);
+
+/*
+ * A function to write a QoS 1 packet built by reliable_publisher to the broker
+ * It goes through the client so the keep alive timer knows the connection is in use
+ */
+size_t write_packet(const uint8_t *packet, size_t length) {
+  if (!client.connected()) {
+    return 0;
+  }
+  return client.write(packet, length);
+}
+
+/*
+ * A function to publish a reading or an alarm event at QoS 1
+ * If all the slots of the window are waiting for a PUBACK the oldest message is given up for this one, see the dropped count in the stats
+ * The message is dropped and logged if it does not fit in a packet
+ */
+void publish_reliably(deviceTopic topic, const char *payload) {
+  if (!reliable_publisher.publish(application_identity.topic(topic), payload, millis())) {
+    LOG_WARN("Message on %s does not fit in a QoS 1 packet, dropped", application_identity.topic(topic));
+  }
+}
+
+/*
+ * Command handlers
+ * Each one parses the payload in place and returns true if the command was accepted
+ */
+
+/*
+ * "siren on" turns on the siren and "siren off" turns it off unless one of the enclosures is critical, see AlarmController::siren_command
+ */
+bool handle_siren(const uint8_t *payload, unsigned int length) {
+  if (!alarm_controller.siren_command(payload, length)) {
+    return false;
+  }
+  bool on = alarm_controller.siren_on();
+  LOG_INFO("Siren %s", on ? "on" : "off");
+  digitalWrite(Board::siren, on ? HIGH : LOW);
+  return true;
+}
+
+/*
+ * Take a reading on the next pass of the loop instead of waiting for the interval
+ * A DHT read less than 2 seconds before is not woken again, the reading repeats its last result
+ */
+bool handle_sample_now(const uint8_t *payload, unsigned int length) {
+  sampleRequested = true;
+  return true;
+}
+
+/*
+ * The payload is the new interval between readings in seconds, see parse_read_interval
+ */
+bool handle_set_interval(const uint8_t *payload, unsigned int length) {
+  uint32_t interval;
+  if (!parse_read_interval(payload, length, &interval)) {
+    return false;
+  }
+  readInterval = interval;
+  reading_cycle.set_interval(readInterval);
+  return true;
+}
+
+bool handle_publish_stats(const uint8_t *payload, unsigned int length) {
+  statsRequested = true;
+  return true;
+}
+
+/*
+ * Read the limits from limits.json again e.g after the file was replaced
+ */
+bool handle_reload_limits(const uint8_t *payload, unsigned int length) {
+  if (!limits_file_exists()) {
+    return false;
+  }
+  Limits limits = read_limits_from_file();
+  if (!validate_limits(&limits)) {
+    return false;
+  }
+  application_limits.set_limits(&limits);
+  return true;
+}
+
+/*
+ * The payload is the limits in the same format as limits.json
+ * They are validated, saved and used from the next reading without pausing the monitoring
+ * The topic is retained on the broker so a device that was offline gets the latest limits when it connects
+ */
+bool handle_set_limits(const uint8_t *payload, unsigned int length) {
+  Limits limits;
+  if (!parse_limits_json(payload, length, &limits)) {
+    return false;
+  }
+  return apply_limits(&limits);
+}
+
+/*
+ * The topics the device listens on and their handlers
+ * "siren" is kept for the server which sends "siren on" on it
+ * The topic strings are filled in at boot, their addresses are fixed so the table is built before that
+ */
+const CommandRoute command_routes[] = {
+    {application_identity.topic(TOPIC_SIREN), handle_siren},
+    {application_identity.topic(TOPIC_COMMAND_SIREN), handle_siren},
+    {application_identity.topic(TOPIC_COMMAND_SAMPLE), handle_sample_now},
+    {application_identity.topic(TOPIC_COMMAND_INTERVAL), handle_set_interval},
+    {application_identity.topic(TOPIC_COMMAND_STATS), handle_publish_stats},
+    {application_identity.topic(TOPIC_COMMAND_LIMITS_RELOAD), handle_reload_limits},
+    {application_identity.topic(TOPIC_LIMITS_SET), handle_set_limits},
+};
+const size_t command_route_count = sizeof(command_routes) / sizeof(command_routes[0]);
 
 /*
  * A function to handle MQTT messages
  * It takes three arguments: a pointer to a char array representing the topic of the message,
  * a byte array representing the payload of the message,
  * and an unsigned integer representing the length of the payload.
+ * The payload is handed to the handler for the topic without copying it out of the client buffer
+ * and the result is acknowledged on the command ack topic as "<topic> <ok|rejected|unknown>"
  */
 void callback(char *topic, byte *payload, unsigned int length) {
-  // Check if message says "siren on" and turn on led
+  LOG_DEBUG("Message arrived on topic: %s", topic);
 
-  Serial.print("Message arrived on topic: ");
-  Serial.println(topic);
+  unsigned long start = micros();
+  commandResult result = dispatch_command(command_routes, command_route_count, topic, payload, length);
+  application_stats.record_command(micros() - start);
 
-  String message = "";
-  for (int i = 0; i < length; i++) {
-    message += (char)payload[i];
-  }
-  if (message == "siren on") {
-    Serial.println("Siren on");
-    digitalWrite(sirenPin, HIGH);
+  // The payload is not used after this point so it is safe to publish from the client buffer
+  char ack[TOPIC_SIZE + 16];
+  format_command_ack(ack, sizeof(ack), topic, result);
+  client.publish(application_identity.topic(TOPIC_COMMAND_ACK), ack);
+}
+
+/*
+ * A function to publish a forwarded log message
+ */
+bool publish_log(const char *text) {
+  return client.publish(application_identity.topic(TOPIC_LOGS), text);
+}
+
+/*
+ * A function to get the name of the reason of the last reset
+ */
+const char *reset_reason_name(esp_reset_reason_t reason) {
+  switch (reason) {
+  case ESP_RST_POWERON:
+    return "power_on";
+  case ESP_RST_EXT:
+    return "external";
+  case ESP_RST_SW:
+    return "software";
+  case ESP_RST_PANIC:
+    return "panic";
+  case ESP_RST_INT_WDT:
+    return "int_wdt";
+  case ESP_RST_TASK_WDT:
+    return "task_wdt";
+  case ESP_RST_WDT:
+    return "wdt";
+  case ESP_RST_DEEPSLEEP:
+    return "deep_sleep";
+  case ESP_RST_BROWNOUT:
+    return "brownout";
+  default:
+    return "unknown";
   }
 }
 
 /*
- * A function to set the reading property of the application_reading object
- *The status object looks like this:
- * {
- *  "decision": "ideal",
- * "enclosure": [
- *  "avian",
- * "temperature"
- * ],
- * }
- * It takes five arguments: a pointer to a char array representing the enclosure,
- * a pointer to a char array representing the measurement,
- * a boolean representing if the reading is a warning,
- * a boolean representing if the reading is critical,
- * and a pointer to an unsigned integer representing the severity of the reading.
- */
-void set_reading_status(char *enclosure, char *measurement, bool warning, bool critical, uint8_t *severity) {
-  readingStatus status;
-  if (!warning && !critical && *severity == 0) {
-    *severity = 0;
-    char ideal[] = "ideal";
-    Serial.println(ideal);
-    char empty[] = "";
-    status.decision = ideal;
-    status.enclosure[0] = empty;
-    status.enclosure[1] = empty;
-    application_reading.set_status(&status);
-  } else if (warning && !critical && *severity <= 1) {
-    *severity = 1;
-    char warning[] = "warning";
-    Serial.println(warning);
-    status.decision = warning;
-    status.enclosure[0] = enclosure;
-    status.enclosure[1] = measurement;
-    application_reading.set_status(&status);
-  } else if (critical && *severity <= 2) {
-    *severity = 2;
-    char critical[] = "critical";
-    Serial.println(critical);
-    status.decision = critical;
-    status.enclosure[0] = enclosure;
-    status.enclosure[1] = measurement;
-    application_reading.set_status(&status);
-  }
-  Serial.print("decision: ");
-  Serial.println(status.decision);
+ * A function to publish on the diagnostics topic why the previous boot ended
+ * It is published when a stage was running at the reset or went over its deadline, or when the device reset after a crash
+ */
+void publish_stall_report() {
+  esp_reset_reason_t reason = esp_reset_reason();
+  stallReport report;
+  bool stalled = stall_monitor.get_report(&report);
+  bool crashed = reason == ESP_RST_PANIC || reason == ESP_RST_INT_WDT || reason == ESP_RST_TASK_WDT || reason == ESP_RST_WDT || reason == ESP_RST_BROWNOUT;
+  if (!stalled && !crashed) {
+    return;
+  }
+  if (!stalled) {
+    report = stallReport{STAGE_NONE, false, 0, 0, 0, 0};
+  }
+  char json[STALL_REPORT_SIZE];
+  if (format_stall_report(json, sizeof(json), &report, reset_reason_name(reason)) > 0) {
+    LOG_WARN("Previous boot: %s", json);
+    publish_reliably(TOPIC_DIAGNOSTICS, json);
+  }
 }
 
 /*
- *A function to check a reading and return if it's "ideal","warning" or "critical"
- *It takes a float as an argument and a string to indicate the enclosure which can be "avian" or "reptile"
- *It also takes a reading type that can be "temperature" or "humidity"
- *It also takes a pointer to a uint8_t to indicate the severity of the reading
- *severity ensures that the status is not downgraded and only set to the highest severity
- */
-String analyzeReading(float reading, char *enclosure, char *readingType, uint8_t *severity) {
-  bool warning = false;
-  bool critical = false;
-  Limits limits = application_limits.get_limits();
-  if (strcmp(enclosure, "avian") == 0) {
-    uint16_t lowest_temp = limits.avian_temp_limits[0];
-    uint16_t ideal_lowest_temp = limits.avian_temp_limits[1];
-    uint16_t ideal_highest_temp = limits.avian_temp_limits[2];
-    uint16_t highest_temp = limits.avian_temp_limits[3];
-    uint16_t lowest_humidity = limits.avian_humid_limits[0];
-    uint16_t ideal_lowest_humidity = limits.avian_humid_limits[1];
-    uint16_t ideal_highest_humidity = limits.avian_humid_limits[2];
-    uint16_t highest_humidity = limits.avian_humid_limits[3];
-    if (strcmp(readingType, "temperature") == 0) {
-      warning = reading < ideal_lowest_temp && reading >= lowest_temp || reading > ideal_highest_temp && reading <= highest_temp;
-      critical = reading < lowest_temp || reading > highest_temp;
-      set_reading_status(enclosure, readingType, warning, critical, severity);
-    } else {
-      warning = reading < ideal_lowest_humidity && reading >= lowest_humidity || reading > ideal_highest_humidity && reading <= highest_humidity;
-      critical = reading < lowest_humidity || reading > highest_humidity;
-      set_reading_status(enclosure, readingType, warning, critical, severity);
+ * A function to make one attempt to connect to the MQTT server
+ * The loop calls it again every mqttRetryInterval, so the enclosures are still monitored while the broker cannot be reached
+ */
+void connectMqtt() {
+  stall_monitor.enter(STAGE_MQTT_CONNECT);
+  LOG_INFO("Attempting MQTT connection...");
+  if (client.connect(application_identity.mqtt_client_id(), mqtt_user, mqtt_password)) {
+    LOG_INFO("MQTT connected as %s", application_identity.mqtt_client_id());
+    // subscribe to the siren and command topics
+    for (uint8_t i = 0; i < SUBSCRIBED_TOPIC_COUNT; i++) {
+      client.subscribe(application_identity.topic(subscribed_topics[i]));
     }
-  } else {
-    uint16_t lowest_temp = limits.reptile_temp_limits[0];
-    uint16_t ideal_lowest_temp = limits.reptile_temp_limits[1];
-    uint16_t ideal_highest_temp = limits.reptile_temp_limits[2];
-    uint16_t highest_temp = limits.reptile_temp_limits[3];
-    uint16_t lowest_humidity = limits.reptile_humid_limits[0];
-    uint16_t ideal_lowest_humidity = limits.reptile_humid_limits[1];
-    uint16_t ideal_highest_humidity = limits.reptile_humid_limits[2];
-    uint16_t highest_humidity = limits.reptile_humid_limits[3];
-    if (strcmp(readingType, "temperature") == 0) {
-      warning = reading < ideal_lowest_temp && reading >= lowest_temp || reading > ideal_highest_temp && reading <= highest_temp;
-      critical = reading < lowest_temp || reading > highest_temp;
-      set_reading_status(enclosure, readingType, warning, critical, severity);
-    } else {
-      warning = reading < ideal_lowest_humidity && reading >= lowest_humidity || reading > ideal_highest_humidity && reading <= highest_humidity;
-      critical = reading < lowest_humidity || reading > highest_humidity;
-      set_reading_status(enclosure, readingType, warning, critical, severity);
+    // The broker does not keep a session, so the messages still waiting for a PUBACK are sent again
+    reliable_publisher.resend(millis());
+    // publish a reset message and the report of the previous boot at startup
+    if (reset == false) {
+      publish_reliably(TOPIC_SIREN_OFF, "reset");
+      publish_stall_report();
+      reset = true;
     }
-  }
-  if (critical == true) {
-    return "critical";
-  } else if (warning == true) {
-    return "warning";
   } else {
-    return "ideal";
+    LOG_WARN("MQTT connection failed, rc=%d try again in %lu seconds", client.state(), mqttRetryInterval / 1000);
   }
+  stall_monitor.leave();
 }
 
 /*
- * A function to connect to the MQTT server
+ * A function to push the siren and the enclosure levels to the live stream when one of them changes
+ * The siren can change in the loop, in a command handler or with the stop button so it is checked once per pass
  */
-void connectMqtt() {
-  // Loop until the connection is established
-  String id = "esp_client";
-  id.concat(millis());
-  while (!client.connected()) {
-    Serial.print("Attempting MQTT connection...");
-    // Attempt to connect
-    if (client.connect(id.c_str(), mqtt_user, mqtt_password)) {
-      Serial.println("connected");
-      // subscribe to the siren topic
-      client.subscribe("siren");
-      // publish a reset message at startup to reset server state
-      if (reset == false) {
-        client.publish("/siren/off", "reset");
-        reset = true;
-      }
-    } else {
-      Serial.print("failed, rc=");
-      Serial.print(client.state());
-      Serial.println(" try again in 5 seconds");
-      // Wait 5 seconds before retrying
-      delay(5000);
-    }
+void stream_alarm_transitions() {
+  // The levels are not known until the first reading
+  if (lastRead == 0) {
+    return;
   }
+  bool siren = alarm_controller.siren_on();
+  enclosureLevels currentLevels = alarm_controller.get_levels();
+  bool changed = siren != streamedSiren || currentLevels.avian != streamedLevels.avian || currentLevels.reptilian != streamedLevels.reptilian;
+  if (alarmStreamed && !changed) {
+    return;
+  }
+  char alarm[96];
+  if (format_alarm(alarm, sizeof(alarm), siren, currentLevels) > 0) {
+    live_stream.publish(STREAM_ALARM, alarm);
+  }
+  streamedSiren = siren;
+  streamedLevels = currentLevels;
+  alarmStreamed = true;
+}
+
+/*
+ * A function called by the SNTP task each time the system time is synchronized
+ */
+void time_synced(struct timeval *time) {
+  sample_clock.sync(static_cast<uint64_t>(time->tv_sec) * 1000 + time->tv_usec / 1000);
+  LOG_INFO("Clock synchronized, corrected by %ld ms", static_cast<long>(sample_clock.get_last_correction()));
 }
 
 /*
@@ -335,12 +561,52 @@ void connectMqtt() {
  */
 void setup() {
   Serial.begin(115200);
+  log_begin(forward_logs);
+  loop_task = xTaskGetCurrentTaskHandle();
+  // Watch the loop task, the record of the previous boot is picked up before the new boot starts writing to it
+  esp_task_wdt_init(WATCHDOG_TIMEOUT_S, true);
+  esp_task_wdt_add(NULL);
+  stall_monitor.begin();
+  esp_timer_create_args_t stall_timer_args = {};
+  stall_timer_args.callback = check_stages;
+  stall_timer_args.name = "stages";
+  esp_timer_create(&stall_timer_args, &stall_timer);
+  esp_timer_start_periodic(stall_timer, 1000000);
+  if (!application_identity.begin(ESP.getEfuseMac(), MQTT_TOPIC_ROOT)) {
+    LOG_ERROR("MQTT_TOPIC_ROOT is too long, topics are truncated");
+  }
+  LOG_INFO("Device id: %s", application_identity.device_id());
+  sample_clock.begin(esp_random());
+  stall_monitor.enter(STAGE_WIFI);
   wifi_config();
-  dhtAvian.begin();
-  dhtReptilian.begin();
+  stall_monitor.leave();
+  sntp_set_time_sync_notification_cb(time_synced);
+  configTime(0, 0, ntp_server);
+  live_stream.begin();
+  if (uses_i2c<Board>()) {
+    Wire.begin(Board::i2c_sda, Board::i2c_scl, 400000);
+  }
+  sensors.attach(ENCLOSURE_AVIAN, &avian_sensor);
+  sensors.attach(ENCLOSURE_REPTILE, &reptile_sensor);
+  if (!sensors.begin()) {
+    LOG_WARN("A sensor did not answer at startup (%s, %s)", sensors.driver_name(ENCLOSURE_AVIAN), sensors.driver_name(ENCLOSURE_REPTILE));
+  }
   initPins();
+  attach_button_interrupts<Board>(wake_on_button);
+  WiFi.onEvent(wake_on_network, ARDUINO_EVENT_WIFI_STA_DISCONNECTED);
+  WiFi.onEvent(wake_on_network, ARDUINO_EVENT_WIFI_STA_GOT_IP);
+  // The first reading is taken straight away
+  reading_cycle.begin(readInterval);
+  commandEvent = scheduler.add(1000);
+  mqttEvent = scheduler.add(mqttRetryInterval);
+  application_reading.publish_raw(publish_raw_readings);
   client.setServer(mqtt_server, mqtt_port);
+  // The default buffer of 256 bytes is too small for a namespaced topic and a reading with the raw values
+  // The statistics need the most room
+  client.setBufferSize(768);
   client.setCallback(callback);
+  // Give up on a broker that does not answer before the MQTT stage goes over its deadline
+  client.setSocketTimeout(5);
   delay(1000);
   connectMqtt();
   setLimits();
@@ -350,132 +616,133 @@ void setup() {
  *Loop function that runs continuously
  */
 void loop() {
+  unsigned long loopStart = micros();
+  stall_monitor.feed();
+
   // Reconnect to WiFi if connection is lost
   if (WiFi.status() != WL_CONNECTED) {
     if (!server_running) {
+      stall_monitor.enter(STAGE_WIFI);
       wifi_config();
+      stall_monitor.leave();
     }
     delay(3500);
     return;
   }
 
-  if (!client.connected()) {
+  // The connection attempts only wake the loop while the client is disconnected
+  // They wait while the sensors convert, a DHT is held low until it is polled and a connect can block for seconds
+  scheduler.set_enabled(mqttEvent, !client.connected() && !sensors.converting());
+  if (scheduler.due(mqttEvent)) {
     connectMqtt();
   }
 
   if (application_limits.limits_are_set() == false) {
+    // The limits can also arrive on the retained limits/set topic while waiting for the limits page
+    stall_monitor.enter(STAGE_COMMANDS);
+    client.loop();
+    stall_monitor.leave();
     setLimits();
     return;
   }
 
-  if (digitalRead(setLimitsPin) == LOW) {
-    turn_off_leds();
-    delete_file_abstraction("/limits.json");
-    application_limits.reset_limits();
-    setLimits();
-    return;
+  // Serve the limits page while the monitoring carries on, submitted limits are used as soon as they are saved
+  if (digitalRead(Board::set_limits) == LOW && !server_running) {
+    get_limits();
   }
 
-  if (digitalRead(reset_wifi_pin) == LOW) {
+  if (digitalRead(Board::reset_wifi) == LOW) {
     turn_off_leds();
     delete_file_abstraction("/wifi.txt ");
     delete_file_abstraction("/password.txt");
+    stall_monitor.enter(STAGE_WIFI);
     wifi_config();
+    stall_monitor.leave();
     return;
   }
 
   // Check for MQTT messages every second
-  if (millis() - lastCheck >= 1000) {
+  // This also sends the keep alive pings
+  if (scheduler.due(commandEvent)) {
+    stall_monitor.enter(STAGE_COMMANDS);
     client.loop();
-    lastCheck = millis();
-  }
-
-  // Read temperature and humidity from DHT sensor every 15 seconds
-  if (millis() - lastRead >= 15000) {
-    Reading reading = getReadings();
-    char avian_char[] = "avian";
-    char reptile_char[] = "reptilian";
-    char temperature_char[] = "temperature";
-    char humidity_char[] = "humidity";
-    uint8_t severity = 0; // 0 = ideal, 1 = warning, 2 = critical
-    String avianTempStatus = analyzeReading(reading.avianTemp, avian_char, temperature_char, &severity);
-    String avianHumidityStatus = analyzeReading(reading.avianHumidity, avian_char, humidity_char, &severity);
-    String reptileTempStatus = analyzeReading(reading.reptileTemp, reptile_char, temperature_char, &severity);
-    String reptileHumidityStatus = analyzeReading(reading.reptileHumidity, reptile_char, humidity_char, &severity);
-
-    if (avianTempStatus == "critical" || avianHumidityStatus == "critical") {
-      // Serial.println("Avian critical");
-      digitalWrite(avianIdealPin, LOW);
-      digitalWrite(avianWarning, LOW);
-      digitalWrite(avianCritical, HIGH);
-    } else if (avianTempStatus == "warning" || avianHumidityStatus == "warning") {
-      // Serial.println("Avian warning");
-      digitalWrite(avianIdealPin, LOW);
-      digitalWrite(avianWarning, HIGH);
-      digitalWrite(avianCritical, LOW);
-    } else {
-      // Serial.println("Avian ideal");
-      digitalWrite(avianWarning, LOW);
-      digitalWrite(avianCritical, LOW);
-      digitalWrite(avianIdealPin, HIGH);
-    }
+    stall_monitor.leave();
+  }
 
-    if (reptileTempStatus == "critical" || reptileHumidityStatus == "critical") {
-      // Serial.println("Reptile critical");
-      digitalWrite(reptileIdealPin, LOW);
-      digitalWrite(reptileWarning, LOW);
-      digitalWrite(reptileCritical, HIGH);
-    } else if (reptileTempStatus == "warning" || reptileHumidityStatus == "warning") {
-      // Serial.println("Reptile warning");
-      digitalWrite(reptileIdealPin, LOW);
-      digitalWrite(reptileWarning, HIGH);
-      digitalWrite(reptileCritical, LOW);
-    } else {
-      // Serial.println("Reptile ideal");
-      digitalWrite(reptileWarning, LOW);
-      digitalWrite(reptileCritical, LOW);
-      digitalWrite(reptileIdealPin, HIGH);
-    }
+  // Send again the QoS 1 messages whose PUBACK did not arrive in time
+  reliable_publisher.poll(millis());
 
-    /*
-     *Turn off the siren if the avian and reptile enclosures are ideal and the siren is on
-     *This automates the process of turning off the siren and does not require the user to press the off button
-     *Also turn on the siren if the avian or reptile enclosures are critical and the siren is off
-     */
-    bool sirenOn = digitalRead(sirenPin) == HIGH;
-    if (sirenOn) {
-      bool avianIdeal = digitalRead(avianIdealPin) == HIGH;
-      bool reptileIdeal = digitalRead(reptileIdealPin) == HIGH;
-      if (avianIdeal && reptileIdeal) {
-        client.publish("/siren/off", "reset");
-        Serial.println("Siren off");
-        digitalWrite(sirenPin, LOW);
-      }
+  if (forward_logs) {
+    log_publish(publish_log);
+  }
+
+  if (statsRequested) {
+    uint32_t rejected[FILTER_CHANNELS];
+    for (uint8_t i = 0; i < FILTER_CHANNELS; i++) {
+      rejected[i] = application_filter.rejected_samples(static_cast<filterChannel>(i));
     }
-    if (!sirenOn) {
-      bool avianEncCritical = digitalRead(avianCritical) == HIGH;
-      bool reptileEnvCritical = digitalRead(reptileCritical) == HIGH;
-      if (avianEncCritical || reptileEnvCritical) {
-        Serial.println("Siren on");
-        digitalWrite(sirenPin, HIGH);
-      }
+    application_stats.record_log_drops(log_dropped());
+    publisherCounters publishes = reliable_publisher.get_counters();
+    application_stats.record_publishes(publishes.retransmitted, publishes.dropped, publishes.expired);
+    application_stats.record_health(stall_monitor.get_stalls(), reading_cycle.get_failures());
+    sleepCounters sleeps = scheduler.get_counters();
+    application_stats.record_sleep(sleeps.wakes[WAKE_TIMER] + sleeps.wakes[WAKE_BUTTON] + sleeps.wakes[WAKE_NETWORK], scheduler.duty_cycle_permille());
+    char stats[STATS_JSON_SIZE];
+    application_stats.stringify_stats(stats, sizeof(stats), millis() / 1000, readInterval / 1000, rejected);
+    client.publish(application_identity.topic(TOPIC_STATS), stats);
+    statsRequested = false;
+  }
+
+  // Start the conversions of all the sensors every readInterval or when a reading is requested
+  // The loop sleeps while they convert and collects the results when the drivers expect them
+  stall_monitor.enter(STAGE_SENSORS);
+  if (reading_cycle.start(sampleRequested)) {
+    sampleRequested = false;
+  }
+  readingStep step = reading_cycle.poll();
+  stall_monitor.leave();
+  if (step == READING_FAILED) {
+    LOG_WARN("Failed to read the sensors, trying again in %lu ms", static_cast<unsigned long>(SENSOR_RETRY_MS));
+  }
+
+  if (step == READING_TAKEN) {
+    stall_monitor.enter(STAGE_PUBLISH);
+    // The limits are copied once per reading so all four checks use the same limits
+    Limits limits = application_limits.get_limits();
+    char payload[READING_JSON_SIZE];
+    readingOutcome outcome = reading_cycle.evaluate(&limits, payload, sizeof(payload));
+
+    show_level<Board, ENCLOSURE_AVIAN>(outcome.levels.avian);
+    show_level<Board, ENCLOSURE_REPTILE>(outcome.levels.reptilian);
+
+    // The siren goes off by itself once both enclosures are ideal again and on when one of them is critical
+    if (outcome.change == ALARM_RESET) {
+      publish_reliably(TOPIC_SIREN_OFF, "reset");
+      LOG_INFO("Siren off");
+      digitalWrite(Board::siren, LOW);
+    } else if (outcome.change == ALARM_RAISED) {
+      LOG_INFO("Siren on");
+      digitalWrite(Board::siren, HIGH);
     }
 
-    String stringifiedReading = application_reading.stringify_reading();
-    client.publish("readings", stringifiedReading.c_str());
-    application_reading.reset();
+    publish_reliably(TOPIC_READINGS, payload);
+    live_stream.publish(STREAM_READING, payload);
     lastRead = millis();
+    stall_monitor.leave();
   }
 
   // Turn off the siren if the stop button is pressed and the both enclosures are not critical
-  if (digitalRead(stop_siren) == LOW && digitalRead(sirenPin) == HIGH) {
-    Serial.println("Siren off");
-    bool avian_critical = digitalRead(avianCritical) == HIGH;
-    bool reptile_critical = digitalRead(reptileCritical) == HIGH;
-    if (!avian_critical && !reptile_critical) {
-      client.publish("/siren/off", "reset");
-      Serial.println("Siren off");
-      digitalWrite(sirenPin, LOW);
-    }
+  if (digitalRead(Board::stop_siren) == LOW && alarm_controller.stop_pressed() == ALARM_RESET) {
+    publish_reliably(TOPIC_SIREN_OFF, "reset");
+    LOG_INFO("Siren off");
+    digitalWrite(Board::siren, LOW);
   }
-}
\ No newline at end of file
+
+  stream_alarm_transitions();
+
+  // Time the pass was awake for, the time asleep is counted in the duty cycle
+  application_stats.record_loop(micros() - loopStart);
+
+  // Sleep until the next event is due, a button or a WiFi event wakes the loop early
+  scheduler.sleep();
+}
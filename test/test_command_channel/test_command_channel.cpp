@@ -0,0 +1,242 @@
+/*
+ * Tests of the command dispatch, the topics of the device and a broker stand-in that delivers what the device publishes
+ * to its own subscriptions, so an acknowledgement that comes back as a command is caught
+ * Run with: pio test -e native
+ */
+#include <CommandChannel.h>
+#include <DeviceIdentity.h>
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+#include <unity.h>
+
+static const uint64_t TEST_MAC = 0xd8c5b3124fa4ULL;
+
+static DeviceIdentity identity;
+static uint32_t handled = 0;
+static char last_payload[32];
+
+static bool handle_siren(const uint8_t *payload, unsigned int length) {
+  handled++;
+  return payload_equals(payload, length, "siren on") || payload_equals(payload, length, "siren off");
+}
+
+static bool handle_accept(const uint8_t *payload, unsigned int length) {
+  handled++;
+  size_t copied = length < sizeof(last_payload) - 1 ? length : sizeof(last_payload) - 1;
+  memcpy(last_payload, payload, copied);
+  last_payload[copied] = '\0';
+  return true;
+}
+
+static bool handle_interval(const uint8_t *payload, unsigned int length) {
+  uint32_t seconds;
+  handled++;
+  return payload_to_uint(payload, length, &seconds) && seconds >= 2 && seconds <= 3600;
+}
+
+/*
+ * The routes of main.cpp with handlers that only record the call
+ */
+static const CommandRoute routes[] = {
+    {identity.topic(TOPIC_SIREN), handle_siren},
+    {identity.topic(TOPIC_COMMAND_SIREN), handle_siren},
+    {identity.topic(TOPIC_COMMAND_SAMPLE), handle_accept},
+    {identity.topic(TOPIC_COMMAND_INTERVAL), handle_interval},
+    {identity.topic(TOPIC_COMMAND_STATS), handle_accept},
+    {identity.topic(TOPIC_COMMAND_LIMITS_RELOAD), handle_accept},
+    {identity.topic(TOPIC_LIMITS_SET), handle_accept},
+};
+static const size_t route_count = sizeof(routes) / sizeof(routes[0]);
+
+/*
+ * A broker that holds the messages published by the device and delivers those that match one of its subscriptions back to it
+ */
+#define BROKER_QUEUE_SIZE 16
+
+struct brokerMessage {
+  char topic[TOPIC_SIZE];
+  char payload[TOPIC_SIZE + 16];
+};
+
+static brokerMessage queue[BROKER_QUEUE_SIZE];
+static size_t queued = 0;
+static uint32_t published = 0;
+static uint32_t delivered = 0;
+
+static void broker_publish(const char *topic, const char *payload) {
+  published++;
+  for (uint8_t i = 0; i < SUBSCRIBED_TOPIC_COUNT; i++) {
+    if (topic_matches(identity.topic(subscribed_topics[i]), topic) && queued < BROKER_QUEUE_SIZE) {
+      snprintf(queue[queued].topic, TOPIC_SIZE, "%s", topic);
+      snprintf(queue[queued].payload, sizeof(queue[queued].payload), "%s", payload);
+      queued++;
+      return;
+    }
+  }
+}
+
+/*
+ * callback() of main.cpp, the command is dispatched and acknowledged through the broker
+ */
+static void device_callback(const char *topic, const char *payload) {
+  commandResult result = dispatch_command(routes, route_count, topic, reinterpret_cast<const uint8_t *>(payload), strlen(payload));
+  char ack[TOPIC_SIZE + 16];
+  format_command_ack(ack, sizeof(ack), topic, result);
+  broker_publish(identity.topic(TOPIC_COMMAND_ACK), ack);
+}
+
+/*
+ * Deliver messages until the broker has nothing left for the device, as client.loop() would over a number of passes
+ */
+static void broker_run(uint32_t passes) {
+  for (uint32_t pass = 0; pass < passes && queued > 0; pass++) {
+    brokerMessage message = queue[0];
+    memmove(queue, queue + 1, (queued - 1) * sizeof(queue[0]));
+    queued--;
+    delivered++;
+    device_callback(message.topic, message.payload);
+  }
+}
+
+void setUp() {
+  identity.begin(TEST_MAC, "");
+  handled = 0;
+  queued = 0;
+  published = 0;
+  delivered = 0;
+  last_payload[0] = '\0';
+}
+
+void tearDown() {}
+
+void test_payload_equals() {
+  const uint8_t payload[] = {'s', 'i', 'r', 'e', 'n', ' ', 'o', 'n'};
+  TEST_ASSERT_TRUE(payload_equals(payload, sizeof(payload), "siren on"));
+  TEST_ASSERT_FALSE(payload_equals(payload, sizeof(payload) - 1, "siren on"));
+  TEST_ASSERT_FALSE(payload_equals(payload, sizeof(payload), "siren of"));
+}
+
+void test_payload_to_uint() {
+  uint32_t value = 0;
+  TEST_ASSERT_TRUE(payload_to_uint(reinterpret_cast<const uint8_t *>("4294967295"), 10, &value));
+  TEST_ASSERT_EQUAL_UINT32(4294967295UL, value);
+  TEST_ASSERT_FALSE(payload_to_uint(reinterpret_cast<const uint8_t *>("4294967296"), 10, &value));
+  TEST_ASSERT_FALSE(payload_to_uint(reinterpret_cast<const uint8_t *>("12a"), 3, &value));
+  TEST_ASSERT_FALSE(payload_to_uint(reinterpret_cast<const uint8_t *>(""), 0, &value));
+}
+
+void test_dispatch_results() {
+  const uint8_t on[] = {'s', 'i', 'r', 'e', 'n', ' ', 'o', 'n'};
+  const uint8_t bad[] = {'1'};
+  TEST_ASSERT_EQUAL(COMMAND_ACCEPTED, dispatch_command(routes, route_count, "command/siren", on, sizeof(on)));
+  TEST_ASSERT_EQUAL(COMMAND_REJECTED, dispatch_command(routes, route_count, "command/interval", bad, sizeof(bad)));
+  TEST_ASSERT_EQUAL(COMMAND_UNKNOWN, dispatch_command(routes, route_count, "command/reboot", on, sizeof(on)));
+  TEST_ASSERT_EQUAL(2, handled);
+}
+
+void test_payload_is_not_null_terminated() {
+  const uint8_t payload[] = {'n', 'o', 'w', 'X'};
+  TEST_ASSERT_EQUAL(COMMAND_ACCEPTED, dispatch_command(routes, route_count, "command/sample", payload, 3));
+  TEST_ASSERT_EQUAL_STRING("now", last_payload);
+}
+
+void test_format_command_ack() {
+  char ack[32];
+  TEST_ASSERT_EQUAL(23, format_command_ack(ack, sizeof(ack), "command/sample", COMMAND_REJECTED));
+  TEST_ASSERT_EQUAL_STRING("command/sample rejected", ack);
+  char small[8];
+  TEST_ASSERT_EQUAL(0, format_command_ack(small, sizeof(small), "command/sample", COMMAND_ACCEPTED));
+}
+
+void test_topic_matches() {
+  TEST_ASSERT_TRUE(topic_matches("command/#", "command/siren"));
+  TEST_ASSERT_TRUE(topic_matches("command/#", "command/limits/reload"));
+  TEST_ASSERT_TRUE(topic_matches("command/#", "command"));
+  TEST_ASSERT_TRUE(topic_matches("a/+/c", "a/b/c"));
+  TEST_ASSERT_TRUE(topic_matches("siren", "siren"));
+  TEST_ASSERT_FALSE(topic_matches("command/#", "ack/command"));
+  TEST_ASSERT_FALSE(topic_matches("command/#", "commands"));
+  TEST_ASSERT_FALSE(topic_matches("a/+/c", "a/b/d"));
+  TEST_ASSERT_FALSE(topic_matches("siren", "/siren/off"));
+}
+
+/*
+ * Every route can be reached through a subscription and nothing the device publishes comes back to it, with and without a topic root
+ */
+static void check_topics() {
+  for (size_t i = 0; i < route_count; i++) {
+    bool subscribed = false;
+    for (uint8_t j = 0; j < SUBSCRIBED_TOPIC_COUNT; j++) {
+      subscribed = subscribed || topic_matches(identity.topic(subscribed_topics[j]), routes[i].topic);
+    }
+    TEST_ASSERT_TRUE_MESSAGE(subscribed, routes[i].topic);
+  }
+  const deviceTopic published_topics[] = {TOPIC_READINGS, TOPIC_SIREN_OFF, TOPIC_COMMAND_ACK, TOPIC_STATS, TOPIC_LOGS, TOPIC_DIAGNOSTICS};
+  for (deviceTopic topic : published_topics) {
+    for (uint8_t j = 0; j < SUBSCRIBED_TOPIC_COUNT; j++) {
+      TEST_ASSERT_FALSE(topic_matches(identity.topic(subscribed_topics[j]), identity.topic(topic)));
+    }
+  }
+}
+
+void test_topics_without_root() {
+  check_topics();
+}
+
+void test_topics_with_root() {
+  TEST_ASSERT_TRUE(identity.begin(TEST_MAC, "hatchery"));
+  TEST_ASSERT_EQUAL_STRING("hatchery/a44f12b3c5d8/ack/command", identity.topic(TOPIC_COMMAND_ACK));
+  check_topics();
+}
+
+/*
+ * A command is delivered once and its acknowledgement is not, however many passes the client makes
+ */
+void test_ack_does_not_come_back() {
+  broker_publish(identity.topic(TOPIC_COMMAND_SAMPLE), "now");
+  broker_run(100);
+  TEST_ASSERT_EQUAL_UINT32(1, delivered);
+  TEST_ASSERT_EQUAL_UINT32(1, handled);
+  TEST_ASSERT_EQUAL_UINT32(2, published);
+
+  broker_publish(identity.topic(TOPIC_COMMAND_INTERVAL), "1");
+  broker_run(100);
+  TEST_ASSERT_EQUAL_UINT32(2, delivered);
+  TEST_ASSERT_EQUAL_UINT32(0, queued);
+}
+
+/*
+ * The time to find and run the handler of the last route, the one that walks the whole table
+ */
+void test_dispatch_latency() {
+  const uint32_t runs = 100000;
+  const uint8_t payload[] = {'{', '}'};
+  const char *topic = identity.topic(TOPIC_LIMITS_SET);
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < runs; i++) {
+    dispatch_command(routes, route_count, topic, payload, sizeof(payload));
+  }
+  std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - start;
+  double ns = static_cast<double>(elapsed.count()) / runs;
+  char message[64];
+  snprintf(message, sizeof(message), "dispatch of the last route: %.1f ns", ns);
+  TEST_MESSAGE(message);
+  TEST_ASSERT_EQUAL_UINT32(runs, handled);
+  TEST_ASSERT_TRUE(ns < 10000);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_payload_equals);
+  RUN_TEST(test_payload_to_uint);
+  RUN_TEST(test_dispatch_results);
+  RUN_TEST(test_payload_is_not_null_terminated);
+  RUN_TEST(test_format_command_ack);
+  RUN_TEST(test_topic_matches);
+  RUN_TEST(test_topics_without_root);
+  RUN_TEST(test_topics_with_root);
+  RUN_TEST(test_ack_does_not_come_back);
+  RUN_TEST(test_dispatch_latency);
+  return UNITY_END();
+}
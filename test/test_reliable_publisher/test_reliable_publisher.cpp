@@ -0,0 +1,136 @@
+/*
+ * Tests of the QoS 1 publisher, with a connection stand-in that can be taken down
+ * Run with: pio test -e native
+ */
+#include <ReliablePublisher.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <unity.h>
+#include <vector>
+
+static bool link_up = true;
+static std::vector<std::string> written;
+
+static size_t write_packet(const uint8_t *packet, size_t length) {
+  if (!link_up) {
+    return 0;
+  }
+  written.push_back(std::string(reinterpret_cast<const char *>(packet), length));
+  return length;
+}
+
+static uint16_t packet_id_of(const std::string &packet, size_t topic_length) {
+  // Fixed header of 2 bytes for these sizes, then the topic length, the topic and the packet id
+  size_t position = 2 + 2 + topic_length;
+  return static_cast<uint16_t>(static_cast<uint8_t>(packet[position]) << 8 | static_cast<uint8_t>(packet[position + 1]));
+}
+
+static std::string payload_of(const std::string &packet, size_t topic_length) {
+  return packet.substr(2 + 2 + topic_length + 2);
+}
+
+void setUp() {
+  link_up = true;
+  written.clear();
+}
+
+void tearDown() {}
+
+void test_publish_builds_a_qos1_packet() {
+  ReliablePublisher publisher(write_packet);
+  TEST_ASSERT_TRUE(publisher.publish("a/b", "hello", 0));
+  TEST_ASSERT_EQUAL(1, written.size());
+  const std::string &packet = written[0];
+  TEST_ASSERT_EQUAL(0x32, static_cast<uint8_t>(packet[0]));
+  TEST_ASSERT_EQUAL(2 + 3 + 2 + 5, static_cast<uint8_t>(packet[1]));
+  TEST_ASSERT_EQUAL_STRING("hello", payload_of(packet, 3).c_str());
+  TEST_ASSERT_EQUAL(1, publisher.in_flight());
+  TEST_ASSERT_TRUE(publisher.acknowledge(packet_id_of(packet, 3)));
+  TEST_ASSERT_EQUAL(0, publisher.in_flight());
+  TEST_ASSERT_FALSE(publisher.acknowledge(packet_id_of(packet, 3)));
+}
+
+void test_message_too_large_is_dropped() {
+  ReliablePublisher publisher(write_packet);
+  std::string payload(PUBLISH_PACKET_SIZE, 'x');
+  TEST_ASSERT_FALSE(publisher.publish("a/b", payload.c_str(), 0));
+  TEST_ASSERT_EQUAL_UINT32(1, publisher.get_counters().dropped);
+  TEST_ASSERT_EQUAL(0, publisher.in_flight());
+}
+
+/*
+ * A broker that never acknowledges gets the message PUBLISH_MAX_ATTEMPTS times and then it is given up
+ */
+void test_unacknowledged_message_expires() {
+  ReliablePublisher publisher(write_packet, 1, 1000);
+  publisher.publish("a/b", "1", 0);
+  for (uint32_t now = 0; now <= 10000; now += 100) {
+    publisher.poll(now);
+  }
+  TEST_ASSERT_EQUAL(PUBLISH_MAX_ATTEMPTS, written.size());
+  TEST_ASSERT_EQUAL(0x08, static_cast<uint8_t>(written.back()[0]) & 0x08);
+  TEST_ASSERT_EQUAL_UINT32(1, publisher.get_counters().expired);
+  TEST_ASSERT_EQUAL(0, publisher.in_flight());
+}
+
+/*
+ * Through an outage the messages are not given up for failed sends, the window keeps the newest ones
+ * and they are all sent once the connection is back
+ */
+void test_outage_keeps_the_newest_messages() {
+  ReliablePublisher publisher(write_packet, PUBLISH_WINDOW_SIZE, 1000);
+  link_up = false;
+  const uint32_t messages = PUBLISH_WINDOW_SIZE + 6;
+  uint32_t now = 0;
+  for (uint32_t i = 0; i < messages; i++) {
+    char payload[8];
+    snprintf(payload, sizeof(payload), "%u", i);
+    TEST_ASSERT_TRUE(publisher.publish("a/b", payload, now));
+    for (uint32_t step = 0; step < 150; step++) {
+      now += 100;
+      publisher.poll(now);
+    }
+  }
+  publisherCounters counters = publisher.get_counters();
+  TEST_ASSERT_EQUAL_UINT32(0, counters.expired);
+  TEST_ASSERT_EQUAL_UINT32(messages - PUBLISH_WINDOW_SIZE, counters.dropped);
+  TEST_ASSERT_EQUAL(PUBLISH_WINDOW_SIZE, publisher.in_flight());
+  TEST_ASSERT_EQUAL(0, written.size());
+
+  link_up = true;
+  publisher.resend(now);
+  TEST_ASSERT_EQUAL(PUBLISH_WINDOW_SIZE, written.size());
+  std::vector<bool> seen(messages, false);
+  for (const std::string &packet : written) {
+    seen[atoi(payload_of(packet, 3).c_str())] = true;
+    TEST_ASSERT_TRUE(publisher.acknowledge(packet_id_of(packet, 3)));
+  }
+  for (uint32_t i = 0; i < messages; i++) {
+    TEST_ASSERT_EQUAL(i >= messages - PUBLISH_WINDOW_SIZE, seen[i]);
+  }
+}
+
+void test_puback_parser_skips_other_packets() {
+  PubackParser parser;
+  // PINGRESP, a SUBACK and then a PUBACK for packet 0x1234
+  const uint8_t bytes[] = {0xd0, 0x00, 0x90, 0x03, 0x00, 0x01, 0x00, 0x40, 0x02, 0x12, 0x34};
+  uint16_t packet_id = 0;
+  uint8_t found = 0;
+  for (uint8_t byte : bytes) {
+    found += parser.feed(byte, &packet_id) ? 1 : 0;
+  }
+  TEST_ASSERT_EQUAL(1, found);
+  TEST_ASSERT_EQUAL(0x1234, packet_id);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_publish_builds_a_qos1_packet);
+  RUN_TEST(test_message_too_large_is_dropped);
+  RUN_TEST(test_unacknowledged_message_expires);
+  RUN_TEST(test_outage_keeps_the_newest_messages);
+  RUN_TEST(test_puback_parser_skips_other_packets);
+  return UNITY_END();
+}
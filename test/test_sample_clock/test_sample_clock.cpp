@@ -0,0 +1,182 @@
+/*
+ * Tests of the sample clock against a simulated monotonic timer that drifts from true time and an SNTP server that answers with jitter,
+ * stops answering for a while or steps its time. Each scenario checks the stamps the clock hands out:
+ * the sequence has no gaps, synchronized timestamps never go backwards unless the step is larger than CLOCK_MAX_HOLD_MS,
+ * the error stays within what the drift and jitter allow and the quality turns stale when the synchronizations stop.
+ * Run with: pio test -e native
+ */
+#include <SampleClock.h>
+#include <unity.h>
+
+static const uint64_t EPOCH_MS = 1700000000000ULL;
+static const uint64_t HOUR_MS = 60ULL * 60 * 1000;
+static const uint64_t FIRST_SYNC_MS = 5000;
+
+struct Scenario {
+  double drift_ppm;         // how much faster the monotonic timer runs than true time
+  uint32_t jitter_ms;       // the SNTP answer is off by up to this much either way
+  uint64_t sync_every_ms;
+  uint64_t sample_every_ms;
+  uint64_t outage_start_ms; // no synchronizations between these times, 0 for none
+  uint64_t outage_end_ms;
+  uint64_t step_at_ms;      // from this time the SNTP server is off by step_ms, 0 for none
+  int64_t step_ms;
+  uint64_t duration_ms;
+};
+
+/*
+ * What the stamps of a run looked like
+ */
+struct ClockRun {
+  uint32_t samples;
+  uint32_t sequence_gaps;
+  uint32_t unsynced_late; // stamps still unsynchronized a second after the first SNTP answer
+  uint32_t went_back;     // synchronized stamps older than the one before, outside a large step back
+  uint64_t max_error_ms;
+  bool saw_stale;
+};
+
+/*
+ * True time since boot, the monotonic timer is derived from it
+ */
+static uint64_t true_ms = 0;
+static double drift_ppm = 0;
+
+static uint64_t simulated_monotonic() {
+  return static_cast<uint64_t>(true_ms * (1.0 + drift_ppm / 1e6));
+}
+
+static uint32_t random_state = 1;
+
+static uint32_t next_random() {
+  uint32_t x = random_state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  random_state = x;
+  return x;
+}
+
+static ClockRun run(const Scenario &scenario) {
+  true_ms = 0;
+  drift_ppm = scenario.drift_ppm;
+  random_state = 12345;
+  SampleClock clock(simulated_monotonic);
+  clock.begin(0xb007);
+
+  ClockRun result = {0, 0, 0, 0, 0, false};
+  uint64_t next_sync = FIRST_SYNC_MS;
+  uint64_t next_sample = 0;
+  uint32_t expected_sequence = 0;
+  uint64_t last_time = 0;
+  bool last_synced = false;
+
+  for (true_ms = 0; true_ms <= scenario.duration_ms; true_ms += 250) {
+    bool in_outage = scenario.outage_end_ms != 0 && true_ms >= scenario.outage_start_ms && true_ms < scenario.outage_end_ms;
+    if (true_ms >= next_sync) {
+      if (!in_outage) {
+        int64_t jitter = scenario.jitter_ms == 0 ? 0 : static_cast<int64_t>(next_random() % (2 * scenario.jitter_ms + 1)) - scenario.jitter_ms;
+        int64_t step = scenario.step_at_ms != 0 && true_ms >= scenario.step_at_ms ? scenario.step_ms : 0;
+        clock.sync(EPOCH_MS + true_ms + jitter + step);
+      }
+      next_sync += scenario.sync_every_ms;
+    }
+    if (true_ms < next_sample) {
+      continue;
+    }
+    next_sample += scenario.sample_every_ms;
+
+    sampleStamp stamp = clock.stamp();
+    result.samples++;
+    if (stamp.sequence != expected_sequence || stamp.boot_id != 0xb007) {
+      result.sequence_gaps++;
+    }
+    expected_sequence = stamp.sequence + 1;
+
+    if (stamp.quality == CLOCK_UNSYNCED) {
+      if (true_ms >= FIRST_SYNC_MS + 1000) {
+        result.unsynced_late++;
+      }
+      continue;
+    }
+    result.saw_stale |= stamp.quality == CLOCK_STALE;
+
+    bool large_step_back = scenario.step_ms < -static_cast<int64_t>(CLOCK_MAX_HOLD_MS);
+    if (last_synced && stamp.time_ms < last_time && !large_step_back) {
+      result.went_back++;
+    }
+    last_time = stamp.time_ms;
+    last_synced = true;
+
+    // The error is measured against the time the server gives, a step is the server's time from then on
+    int64_t step = scenario.step_at_ms != 0 && true_ms >= scenario.step_at_ms ? scenario.step_ms : 0;
+    int64_t error = static_cast<int64_t>(stamp.time_ms - (EPOCH_MS + true_ms)) - step;
+    uint64_t magnitude = error < 0 ? -error : error;
+    // Just after a step or an outage the clock has not been synchronized yet
+    bool settling = scenario.step_at_ms != 0 && true_ms >= scenario.step_at_ms && true_ms < scenario.step_at_ms + scenario.sync_every_ms;
+    settling |= scenario.outage_end_ms != 0 && true_ms >= scenario.outage_end_ms && true_ms < scenario.outage_end_ms + scenario.sync_every_ms;
+    if (!in_outage && !settling && magnitude > result.max_error_ms) {
+      result.max_error_ms = magnitude;
+    }
+  }
+  return result;
+}
+
+/*
+ * The checks every scenario shares, the error allowed is the drift over one sync interval plus the jitter of the last sync
+ */
+static void check(const ClockRun &result, uint64_t max_error_ms, bool expect_stale) {
+  TEST_ASSERT_GREATER_THAN_UINT32(0, result.samples);
+  TEST_ASSERT_EQUAL_UINT32_MESSAGE(0, result.sequence_gaps, "the sequence has a gap");
+  TEST_ASSERT_EQUAL_UINT32_MESSAGE(0, result.unsynced_late, "still unsynced after the first answer");
+  TEST_ASSERT_EQUAL_UINT32_MESSAGE(0, result.went_back, "a timestamp went back");
+  TEST_ASSERT_TRUE_MESSAGE(result.max_error_ms <= max_error_ms, "the error is over what the drift and jitter allow");
+  TEST_ASSERT_EQUAL_MESSAGE(expect_stale, result.saw_stale, "the quality turned stale or never did");
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_no_drift_hourly_sync() {
+  check(run({0, 0, HOUR_MS, 15000, 0, 0, 0, 0, 6 * HOUR_MS}), 1, false);
+}
+
+void test_fast_timer_with_jitter() {
+  check(run({50, 200, HOUR_MS, 15000, 0, 0, 0, 0, 12 * HOUR_MS}), 180 + 200 + 1, false);
+}
+
+void test_slow_timer_with_jitter() {
+  check(run({-120, 50, HOUR_MS, 15000, 0, 0, 0, 0, 12 * HOUR_MS}), 432 + 50 + 1, false);
+}
+
+void test_outage_turns_stale() {
+  check(run({50, 0, HOUR_MS, 15000, 2 * HOUR_MS, 6 * HOUR_MS, 0, 0, 10 * HOUR_MS}), 180 + 1, true);
+}
+
+/*
+ * A step back smaller than CLOCK_MAX_HOLD_MS is absorbed by holding the time, the samples taken meanwhile are off by up to the step
+ */
+void test_small_step_back_is_held() {
+  check(run({0, 0, HOUR_MS, 500, 0, 0, 3 * HOUR_MS, -1500, 6 * HOUR_MS}), 1500, false);
+}
+
+void test_large_step_back_is_followed() {
+  check(run({0, 0, HOUR_MS, 15000, 0, 0, 3 * HOUR_MS, -600000, 6 * HOUR_MS}), 1, false);
+}
+
+void test_step_forward_is_followed() {
+  check(run({0, 0, HOUR_MS, 15000, 0, 0, 3 * HOUR_MS, 300000, 6 * HOUR_MS}), 1, false);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_no_drift_hourly_sync);
+  RUN_TEST(test_fast_timer_with_jitter);
+  RUN_TEST(test_slow_timer_with_jitter);
+  RUN_TEST(test_outage_turns_stale);
+  RUN_TEST(test_small_step_back_is_held);
+  RUN_TEST(test_large_step_back_is_followed);
+  RUN_TEST(test_step_forward_is_followed);
+  return UNITY_END();
+}
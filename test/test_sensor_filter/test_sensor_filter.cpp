@@ -0,0 +1,170 @@
+/*
+ * Tests of the outlier filter that sits between reading the sensors and analyzing the readings
+ * Run with: pio test -e native
+ */
+#include <SensorFilter.h>
+#include <unity.h>
+
+static FilterConfig hampel_only() {
+  FilterConfig config;
+  config.median = false;
+  config.hampel = true;
+  config.hampel_k = 300;
+  config.ewma = false;
+  config.ewma_alpha = 30;
+  return config;
+}
+
+static ChannelFilter filter;
+static FilterConfig config;
+
+void setUp() {
+  filter.reset();
+  config = hampel_only();
+}
+
+void tearDown() {}
+
+static centi_t feed(centi_t sample, bool *rejected) {
+  return filter.apply(sample, &config, rejected);
+}
+
+/*
+ * A noisy temperature trace in whole degrees as a DHT11 reports it, with a read glitch to 0 and one to 99 degrees
+ * The clean trace is the same without the two glitches
+ */
+static const centi_t noisy_trace[] = {2400, 2400, 2500, 2400, 2400, 2500, 2500, 0,    2500, 2500, 2600, 2500, 2600, 2600,
+                                      2600, 2700, 9900, 2600, 2700, 2700, 2700, 2800, 2700, 2800, 2800, 2800, 2900, 2800};
+static const size_t glitch_index[] = {7, 16};
+
+void test_median_of_odd_and_even_counts() {
+  const centi_t odd[] = {300, -100, 200};
+  const centi_t even[] = {400, 100, 300, 200};
+  TEST_ASSERT_EQUAL_INT16(200, median_of(odd, 3));
+  TEST_ASSERT_EQUAL_INT16(250, median_of(even, 4));
+}
+
+void test_single_spike_is_rejected() {
+  bool rejected;
+  for (uint8_t i = 0; i < 4; i++) {
+    TEST_ASSERT_EQUAL_INT16(2500, feed(2500, &rejected));
+    TEST_ASSERT_FALSE(rejected);
+  }
+  TEST_ASSERT_EQUAL_INT16(2500, feed(4000, &rejected));
+  TEST_ASSERT_TRUE(rejected);
+  TEST_ASSERT_EQUAL_INT16(2500, feed(2500, &rejected));
+  TEST_ASSERT_FALSE(rejected);
+}
+
+void test_first_samples_pass_through() {
+  bool rejected;
+  // The hampel identifier needs three samples, the first two are passed on whatever they are
+  TEST_ASSERT_EQUAL_INT16(2500, feed(2500, &rejected));
+  TEST_ASSERT_EQUAL_INT16(9000, feed(9000, &rejected));
+  TEST_ASSERT_FALSE(rejected);
+}
+
+/*
+ * A real step is held back while it is a minority of the window and followed once it fills half of it
+ */
+void test_step_is_followed() {
+  bool rejected;
+  for (uint8_t i = 0; i < FILTER_WINDOW_SIZE; i++) {
+    feed(2500, &rejected);
+  }
+  TEST_ASSERT_EQUAL_INT16(2500, feed(2900, &rejected));
+  TEST_ASSERT_TRUE(rejected);
+  TEST_ASSERT_EQUAL_INT16(2500, feed(2900, &rejected));
+  TEST_ASSERT_TRUE(rejected);
+  TEST_ASSERT_EQUAL_INT16(2900, feed(2900, &rejected));
+  TEST_ASSERT_FALSE(rejected);
+  TEST_ASSERT_EQUAL_INT16(2900, feed(2900, &rejected));
+}
+
+/*
+ * A steady window has a MAD of zero, the minimum deviation keeps a change of one unit from being rejected
+ */
+void test_zero_mad_accepts_one_unit() {
+  bool rejected;
+  for (uint8_t i = 0; i < FILTER_WINDOW_SIZE; i++) {
+    feed(2500, &rejected);
+  }
+  TEST_ASSERT_EQUAL_INT16(2600, feed(2600, &rejected));
+  TEST_ASSERT_FALSE(rejected);
+  TEST_ASSERT_EQUAL_INT16(2400, feed(2400, &rejected));
+  TEST_ASSERT_FALSE(rejected);
+}
+
+void test_zero_mad_rejects_two_units() {
+  bool rejected;
+  for (uint8_t i = 0; i < FILTER_WINDOW_SIZE; i++) {
+    feed(2500, &rejected);
+  }
+  TEST_ASSERT_EQUAL_INT16(2500, feed(2700, &rejected));
+  TEST_ASSERT_TRUE(rejected);
+}
+
+/*
+ * Only the two glitches of the trace are rejected and the output follows the clean trace within one unit
+ */
+void test_noisy_trace() {
+  bool rejected;
+  size_t count = sizeof(noisy_trace) / sizeof(noisy_trace[0]);
+  uint8_t glitches = 0;
+  for (size_t i = 0; i < count; i++) {
+    centi_t value = feed(noisy_trace[i], &rejected);
+    bool glitch = i == glitch_index[0] || i == glitch_index[1];
+    TEST_ASSERT_EQUAL(glitch, rejected);
+    glitches += rejected ? 1 : 0;
+    centi_t clean = glitch ? noisy_trace[i - 1] : noisy_trace[i];
+    TEST_ASSERT_INT_WITHIN(100, clean, value);
+  }
+  TEST_ASSERT_EQUAL(2, glitches);
+}
+
+void test_median_stage_outputs_window_median() {
+  bool rejected;
+  config.hampel = false;
+  config.median = true;
+  feed(2500, &rejected);
+  feed(2700, &rejected);
+  TEST_ASSERT_EQUAL_INT16(2600, feed(2600, &rejected));
+  TEST_ASSERT_FALSE(rejected);
+}
+
+void test_ewma_is_primed_by_first_sample() {
+  bool rejected;
+  config.hampel = false;
+  config.ewma = true;
+  config.ewma_alpha = 50;
+  TEST_ASSERT_EQUAL_INT16(2000, feed(2000, &rejected));
+  TEST_ASSERT_EQUAL_INT16(2100, feed(2200, &rejected));
+  TEST_ASSERT_EQUAL_INT16(2150, feed(2200, &rejected));
+}
+
+void test_application_filter_counts_rejections() {
+  ApplicationFilter application_filter;
+  for (uint8_t i = 0; i < FILTER_WINDOW_SIZE; i++) {
+    application_filter.filter(AVIAN_HUMIDITY, 5000);
+  }
+  application_filter.filter(AVIAN_HUMIDITY, 9500);
+  TEST_ASSERT_EQUAL_UINT32(1, application_filter.rejected_samples(AVIAN_HUMIDITY));
+  TEST_ASSERT_EQUAL_UINT32(0, application_filter.rejected_samples(AVIAN_TEMPERATURE));
+  application_filter.reset();
+  TEST_ASSERT_EQUAL_UINT32(0, application_filter.rejected_samples(AVIAN_HUMIDITY));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_median_of_odd_and_even_counts);
+  RUN_TEST(test_single_spike_is_rejected);
+  RUN_TEST(test_first_samples_pass_through);
+  RUN_TEST(test_step_is_followed);
+  RUN_TEST(test_zero_mad_accepts_one_unit);
+  RUN_TEST(test_zero_mad_rejects_two_units);
+  RUN_TEST(test_noisy_trace);
+  RUN_TEST(test_median_stage_outputs_window_median);
+  RUN_TEST(test_ewma_is_primed_by_first_sample);
+  RUN_TEST(test_application_filter_counts_rejections);
+  return UNITY_END();
+}
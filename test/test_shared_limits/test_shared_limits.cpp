@@ -0,0 +1,251 @@
+/*
+ * Stress tests of the double buffered limits
+ * Writer threads replace the limits with sets built from a counter while reader threads copy them.
+ * The avian limits all hold the low 15 bits of the counter and the reptile limits all hold the next 15 bits,
+ * a copy where the limits of one enclosure differ is a torn read.
+ * update_limits() is checked to run the commit of one writer at a time and only for limits that changed.
+ * Run with: pio test -e native
+ */
+#include <SharedLimits.h>
+#include <atomic>
+#include <chrono>
+#include <stdio.h>
+#include <thread>
+#include <unity.h>
+#include <vector>
+
+static const std::chrono::milliseconds RUN_TIME(300);
+static const uint8_t READERS = 3;
+static const uint32_t WRITER_RANGE = 1UL << 28;
+
+static Limits limits_of(uint32_t counter) {
+  centi_t low = static_cast<centi_t>(counter & 0x7fff);
+  centi_t high = static_cast<centi_t>((counter >> 15) & 0x7fff);
+  Limits limits;
+  for (uint8_t i = 0; i < 4; i++) {
+    limits.avian_temp_limits[i] = low;
+    limits.avian_humid_limits[i] = low;
+    limits.reptile_temp_limits[i] = high;
+    limits.reptile_humid_limits[i] = high;
+  }
+  return limits;
+}
+
+/*
+ * Get the counter the limits were built from, it returns false if the copy is torn
+ */
+static bool counter_of(const Limits *limits, uint32_t *counter) {
+  centi_t low = limits->avian_temp_limits[0];
+  centi_t high = limits->reptile_temp_limits[0];
+  for (uint8_t i = 0; i < 4; i++) {
+    if (limits->avian_temp_limits[i] != low || limits->avian_humid_limits[i] != low || limits->reptile_temp_limits[i] != high ||
+        limits->reptile_humid_limits[i] != high) {
+      return false;
+    }
+  }
+  *counter = static_cast<uint32_t>(low) | (static_cast<uint32_t>(high) << 15);
+  return true;
+}
+
+struct readerResult {
+  uint32_t reads;
+  uint32_t torn;
+  uint32_t backwards;
+};
+
+static ApplicationLimits *shared;
+static std::atomic<bool> writing;
+
+/*
+ * Copy the limits until the writers are done, a single writer only counts up so a reader must never see an older value
+ */
+static void reader(readerResult *result, bool ordered) {
+  uint32_t last = 0;
+  do {
+    Limits limits = shared->get_limits();
+    uint32_t counter;
+    result->reads++;
+    if (!counter_of(&limits, &counter)) {
+      result->torn++;
+    } else if (ordered && counter < last) {
+      result->backwards++;
+    } else {
+      last = counter;
+    }
+  } while (writing.load(std::memory_order_acquire));
+}
+
+/*
+ * Count up from first for RUN_TIME, long enough that on a single core the readers are preempted in the middle of a copy many times
+ */
+static void writer(uint32_t first) {
+  std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now() + RUN_TIME;
+  uint32_t counter = first;
+  while (std::chrono::steady_clock::now() < end) {
+    Limits limits = limits_of(counter++);
+    shared->set_limits(&limits);
+  }
+}
+
+static void run(uint8_t writers, bool ordered) {
+  ApplicationLimits limits;
+  Limits initial = limits_of(0);
+  limits.set_limits(&initial);
+  shared = &limits;
+  writing.store(true);
+
+  std::vector<readerResult> results(READERS, readerResult{0, 0, 0});
+  std::vector<std::thread> threads;
+  for (uint8_t i = 0; i < READERS; i++) {
+    threads.emplace_back(reader, &results[i], ordered);
+  }
+  std::vector<std::thread> writer_threads;
+  for (uint8_t i = 0; i < writers; i++) {
+    writer_threads.emplace_back(writer, 1 + i * WRITER_RANGE);
+  }
+  for (std::thread &thread : writer_threads) {
+    thread.join();
+  }
+  writing.store(false, std::memory_order_release);
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+
+  uint32_t reads = 0;
+  for (const readerResult &result : results) {
+    TEST_ASSERT_EQUAL_UINT32(0, result.torn);
+    TEST_ASSERT_EQUAL_UINT32(0, result.backwards);
+    reads += result.reads;
+  }
+  char message[64];
+  snprintf(message, sizeof(message), "%u writers, %lu reads", writers, static_cast<unsigned long>(reads));
+  TEST_MESSAGE(message);
+  TEST_ASSERT_TRUE(limits.limits_are_set());
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_starts_unset() {
+  ApplicationLimits limits;
+  TEST_ASSERT_FALSE(limits.limits_are_set());
+  Limits copy = limits.get_limits();
+  uint32_t counter;
+  TEST_ASSERT_TRUE(counter_of(&copy, &counter));
+  TEST_ASSERT_EQUAL_UINT32(0, counter);
+}
+
+void test_set_get_and_reset() {
+  ApplicationLimits limits;
+  Limits set = limits_of(3750);
+  set.reptile_humid_limits[3] = 9000;
+  limits.set_limits(&set);
+  TEST_ASSERT_TRUE(limits.limits_are_set());
+  Limits copy = limits.get_limits();
+  TEST_ASSERT_EQUAL_INT16(3750, copy.avian_temp_limits[0]);
+  TEST_ASSERT_EQUAL_INT16(9000, copy.reptile_humid_limits[3]);
+  limits.reset_limits();
+  TEST_ASSERT_FALSE(limits.limits_are_set());
+}
+
+/*
+ * A commit that stands in for saving limits.json, it records what was saved and whether two saves overlapped
+ */
+static std::atomic<uint32_t> commits(0);
+static std::atomic<uint32_t> committing(0);
+static std::atomic<bool> overlapped(false);
+static Limits saved;
+static bool commit_result = true;
+
+static bool commit(const Limits *limits) {
+  if (committing.fetch_add(1) != 0) {
+    overlapped.store(true);
+  }
+  commits++;
+  saved = *limits;
+  // Long enough for the other writer to get to its own commit if the updates were not serialized
+  std::this_thread::sleep_for(std::chrono::microseconds(50));
+  committing.fetch_sub(1);
+  return commit_result;
+}
+
+static void reset_commits() {
+  commits.store(0);
+  committing.store(0);
+  overlapped.store(false);
+  commit_result = true;
+}
+
+void test_update_commits_only_changed_limits() {
+  reset_commits();
+  ApplicationLimits limits;
+  Limits first = limits_of(100);
+  TEST_ASSERT_TRUE(limits.update_limits(&first, commit));
+  TEST_ASSERT_EQUAL_UINT32(1, commits.load());
+  TEST_ASSERT_TRUE(limits.update_limits(&first, commit));
+  TEST_ASSERT_EQUAL_UINT32(1, commits.load());
+  Limits second = limits_of(200);
+  TEST_ASSERT_TRUE(limits.update_limits(&second, commit));
+  TEST_ASSERT_EQUAL_UINT32(2, commits.load());
+  Limits copy = limits.get_limits();
+  uint32_t counter;
+  TEST_ASSERT_TRUE(counter_of(&copy, &counter));
+  TEST_ASSERT_EQUAL_UINT32(200, counter);
+}
+
+void test_update_keeps_limits_when_commit_fails() {
+  reset_commits();
+  ApplicationLimits limits;
+  Limits first = limits_of(100);
+  limits.set_limits(&first);
+  commit_result = false;
+  Limits second = limits_of(200);
+  TEST_ASSERT_FALSE(limits.update_limits(&second, commit));
+  Limits copy = limits.get_limits();
+  uint32_t counter;
+  TEST_ASSERT_TRUE(counter_of(&copy, &counter));
+  TEST_ASSERT_EQUAL_UINT32(100, counter);
+}
+
+static void updater(ApplicationLimits *limits, uint32_t first) {
+  for (uint32_t i = 0; i < 200; i++) {
+    Limits next = limits_of(first + i % 2);
+    limits->update_limits(&next, commit);
+  }
+}
+
+/*
+ * Two tasks applying limits as the web server and the MQTT callback do, the saves never overlap and the last save is what is in use
+ */
+void test_updates_are_serialized() {
+  reset_commits();
+  ApplicationLimits limits;
+  std::thread web(updater, &limits, 10);
+  std::thread mqtt(updater, &limits, 20);
+  web.join();
+  mqtt.join();
+  TEST_ASSERT_FALSE(overlapped.load());
+  Limits copy = limits.get_limits();
+  TEST_ASSERT_EQUAL_MEMORY(&saved, &copy, sizeof(Limits));
+}
+
+void test_one_writer_readers_never_torn_or_stale() {
+  run(1, true);
+}
+
+void test_two_writers_readers_never_torn() {
+  run(2, false);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_starts_unset);
+  RUN_TEST(test_set_get_and_reset);
+  RUN_TEST(test_update_commits_only_changed_limits);
+  RUN_TEST(test_update_keeps_limits_when_commit_fails);
+  RUN_TEST(test_updates_are_serialized);
+  RUN_TEST(test_one_writer_readers_never_torn_or_stale);
+  RUN_TEST(test_two_writers_readers_never_torn);
+  return UNITY_END();
+}
@@ -0,0 +1,236 @@
+/*
+ * Tests of the stall monitor on a virtual clock with a simulated task watchdog and a timer that calls check() every second, like main.cpp does.
+ * Each scenario runs the stages of the loop for a while and injects stalls: a stage that takes longer than its deadline
+ * or one that never returns until the watchdog resets the device. After the run the device boots again on the same record,
+ * as RTC_NOINIT memory survives the reset, and the report of the previous boot is checked against the stall that was injected.
+ * Run with: pio test -e native
+ */
+#include <StallMonitor.h>
+#include <stdint.h>
+#include <unity.h>
+
+/*
+ * The same as WATCHDOG_TIMEOUT_S in main.cpp
+ */
+static const uint32_t WATCHDOG_MS = 30000;
+static const uint32_t CHECK_EVERY_MS = 1000;
+static const uint32_t HANG = UINT32_MAX;
+static const uint32_t HOUR_MS = 60UL * 60 * 1000;
+
+/*
+ * The hardware abstraction the monitor runs on, a virtual clock and a watchdog that remembers when it was fed
+ */
+static uint32_t now_ms = 0;
+static uint32_t last_feed = 0;
+static uint32_t next_check = CHECK_EVERY_MS;
+static bool watchdog_fired = false;
+static uint32_t overdue_checks = 0;
+static stallRecord record;
+
+static uint32_t virtual_uptime() {
+  return now_ms;
+}
+
+static void virtual_feed() {
+  last_feed = now_ms;
+}
+
+struct Stall {
+  loopStage stage;      // STAGE_NONE for no stall
+  uint32_t at_ms;       // the first time the stage runs after this it takes duration_ms
+  uint32_t duration_ms; // HANG for a stage that never returns
+};
+
+static const Stall NO_STALL = {STAGE_NONE, 0, 0};
+
+/*
+ * What the next boot found
+ */
+struct StallRun {
+  bool reset;
+  bool has_report;
+  stallReport report;
+  uint32_t stalls_after_boot;
+};
+
+/*
+ * Moves the virtual clock forward, the check timer runs and the watchdog fires on the way
+ */
+static void advance(StallMonitor *monitor, uint32_t duration_ms) {
+  uint32_t end = duration_ms == HANG ? UINT32_MAX : now_ms + duration_ms;
+  while (now_ms < end && !watchdog_fired) {
+    uint32_t step = end - now_ms;
+    if (next_check - now_ms < step) {
+      step = next_check - now_ms;
+    }
+    if (last_feed + WATCHDOG_MS + 1 - now_ms < step) {
+      step = last_feed + WATCHDOG_MS + 1 - now_ms;
+    }
+    now_ms += step;
+    if (now_ms == next_check) {
+      overdue_checks += monitor->check() ? 1 : 0;
+      next_check += CHECK_EVERY_MS;
+    }
+    if (now_ms - last_feed > WATCHDOG_MS) {
+      watchdog_fired = true;
+    }
+  }
+}
+
+/*
+ * Runs a stage for its normal duration or for the stall injected into it
+ */
+static void run_stage(StallMonitor *monitor, Stall *stalls, loopStage stage, uint32_t duration_ms) {
+  monitor->enter(stage);
+  for (uint8_t i = 0; i < 2; i++) {
+    if (stalls[i].stage == stage && now_ms >= stalls[i].at_ms) {
+      duration_ms = stalls[i].duration_ms;
+      stalls[i].stage = STAGE_NONE;
+      break;
+    }
+  }
+  advance(monitor, duration_ms);
+  if (!watchdog_fired) {
+    monitor->leave();
+  }
+}
+
+/*
+ * Runs the loop for an hour with the stalls injected, then boots again on the record that is left
+ * With power_on the record is random at the next boot as after a power on
+ */
+static StallRun run(Stall first, Stall second, bool power_on) {
+  now_ms = 0;
+  last_feed = 0;
+  next_check = CHECK_EVERY_MS;
+  watchdog_fired = false;
+  overdue_checks = 0;
+  Stall stalls[2] = {first, second};
+
+  StallMonitor monitor(&record, virtual_uptime, virtual_feed);
+  monitor.begin();
+  run_stage(&monitor, stalls, STAGE_WIFI, 1200);
+  run_stage(&monitor, stalls, STAGE_MQTT_CONNECT, 300);
+
+  // A pass of the loop every 100 ms, the commands every second and a reading every 15 seconds
+  uint32_t last_read = 0;
+  uint32_t last_commands = 0;
+  while (now_ms < HOUR_MS && !watchdog_fired) {
+    monitor.feed();
+    if (now_ms - last_commands >= 1000) {
+      last_commands = now_ms;
+      run_stage(&monitor, stalls, STAGE_COMMANDS, 15);
+    }
+    if (!watchdog_fired && now_ms - last_read >= 15000) {
+      last_read = now_ms;
+      run_stage(&monitor, stalls, STAGE_SENSORS, 50);
+      if (!watchdog_fired) {
+        run_stage(&monitor, stalls, STAGE_PUBLISH, 30);
+      }
+    }
+    if (!watchdog_fired) {
+      advance(&monitor, 100);
+    }
+  }
+
+  if (power_on) {
+    for (size_t i = 0; i < sizeof(record); i++) {
+      reinterpret_cast<uint8_t *>(&record)[i] = static_cast<uint8_t>(i * 37 + 11);
+    }
+  }
+
+  // The next boot, on the record the previous one left behind
+  now_ms = 0;
+  StallMonitor next(&record, virtual_uptime, virtual_feed);
+  StallRun result;
+  result.reset = watchdog_fired;
+  result.has_report = next.begin();
+  next.get_report(&result.report);
+  result.stalls_after_boot = next.get_stalls();
+  return result;
+}
+
+/*
+ * The report of a stall, elapsed_ms is checked against the range the injected stall allows
+ */
+static void check_report(const StallRun &result, loopStage stage, bool in_progress, uint32_t min_elapsed_ms, uint32_t max_elapsed_ms, uint32_t stalls) {
+  TEST_ASSERT_TRUE(result.has_report);
+  TEST_ASSERT_EQUAL(stage, result.report.stage);
+  TEST_ASSERT_EQUAL(in_progress, result.report.in_progress);
+  TEST_ASSERT_TRUE(result.report.elapsed_ms >= min_elapsed_ms && result.report.elapsed_ms <= max_elapsed_ms);
+  TEST_ASSERT_EQUAL_UINT32(stalls, result.report.stalls);
+  // A stage that ran a whole timer period past its deadline is seen by the timer while it is still running
+  if (result.report.elapsed_ms > result.report.deadline_ms + CHECK_EVERY_MS) {
+    TEST_ASSERT_GREATER_THAN_UINT32(0, overdue_checks);
+  }
+  TEST_ASSERT_EQUAL_UINT32(0, result.stalls_after_boot);
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_no_stall() {
+  StallRun result = run(NO_STALL, NO_STALL, false);
+  TEST_ASSERT_FALSE(result.reset);
+  TEST_ASSERT_FALSE(result.has_report);
+}
+
+void test_slow_sensor_read_recovers() {
+  StallRun result = run({STAGE_SENSORS, 600000, 1800}, NO_STALL, false);
+  TEST_ASSERT_FALSE(result.reset);
+  check_report(result, STAGE_SENSORS, false, 1800, 1800, 1);
+}
+
+void test_slow_wifi_reconnect() {
+  StallRun result = run({STAGE_WIFI, 0, 20000}, NO_STALL, false);
+  TEST_ASSERT_FALSE(result.reset);
+  check_report(result, STAGE_WIFI, false, 20000, 20000, 1);
+}
+
+void test_mqtt_connect_hangs() {
+  StallRun result = run({STAGE_MQTT_CONNECT, 0, HANG}, NO_STALL, false);
+  TEST_ASSERT_TRUE(result.reset);
+  check_report(result, STAGE_MQTT_CONNECT, true, WATCHDOG_MS - CHECK_EVERY_MS, WATCHDOG_MS, 0);
+}
+
+void test_slow_publish_then_commands_hang() {
+  StallRun result = run({STAGE_PUBLISH, 300000, 700}, {STAGE_COMMANDS, 900000, HANG}, false);
+  TEST_ASSERT_TRUE(result.reset);
+  check_report(result, STAGE_COMMANDS, true, WATCHDOG_MS - CHECK_EVERY_MS, WATCHDOG_MS, 1);
+}
+
+void test_sensor_read_hangs() {
+  StallRun result = run({STAGE_SENSORS, 1200000, HANG}, NO_STALL, false);
+  TEST_ASSERT_TRUE(result.reset);
+  check_report(result, STAGE_SENSORS, true, WATCHDOG_MS - CHECK_EVERY_MS, WATCHDOG_MS, 0);
+}
+
+void test_power_on_discards_the_record() {
+  StallRun result = run({STAGE_SENSORS, 600000, 1800}, NO_STALL, true);
+  TEST_ASSERT_FALSE(result.reset);
+  TEST_ASSERT_FALSE(result.has_report);
+  TEST_ASSERT_EQUAL_UINT32(0, result.stalls_after_boot);
+}
+
+void test_report_json() {
+  stallReport report = {STAGE_MQTT_CONNECT, true, 10000, 30004, 61230, 1};
+  char json[STALL_REPORT_SIZE];
+  TEST_ASSERT_GREATER_THAN(0, format_stall_report(json, sizeof(json), &report, "task_wdt"));
+  TEST_ASSERT_EQUAL_STRING("{\"reset\":\"task_wdt\",\"stage\":\"mqtt_connect\",\"in_progress\":true,\"elapsed_ms\":30004,\"deadline_ms\":10000,"
+                           "\"uptime_ms\":61230,\"stalls\":1}",
+                           json);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_no_stall);
+  RUN_TEST(test_slow_sensor_read_recovers);
+  RUN_TEST(test_slow_wifi_reconnect);
+  RUN_TEST(test_mqtt_connect_hangs);
+  RUN_TEST(test_slow_publish_then_commands_hang);
+  RUN_TEST(test_sensor_read_hangs);
+  RUN_TEST(test_power_on_discards_the_record);
+  RUN_TEST(test_report_json);
+  return UNITY_END();
+}
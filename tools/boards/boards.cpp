@@ -0,0 +1,55 @@
+/*
+ * Board profiles
+ * Checks every board profile at compile time and prints the pin map the compiler generated for each one,
+ * so a new revision can be compared with the others before it is flashed.
+ *
+ * Build and run with: pio run -e native && .pio/build/native/program
+ */
+#include <BoardProfile.h>
+#include <stdio.h>
+#include <type_traits>
+
+static_assert(BoardCheck<BoardRev1>::checked, "rev1");
+static_assert(BoardCheck<BoardRev2>::checked, "rev2");
+static_assert(BoardCheck<BoardRev2I2c>::checked, "rev2-i2c");
+static_assert(BoardCheck<BoardNative>::checked, "native");
+
+static const char *const pin_functions[BOARD_PIN_COUNT] = {
+    "siren",
+    "avian ideal",
+    "avian warning",
+    "avian critical",
+    "reptile ideal",
+    "reptile warning",
+    "reptile critical",
+    "set limits",
+    "reset wifi",
+    "stop siren",
+    "dht avian",
+    "dht reptile",
+    "i2c sda",
+    "i2c scl",
+};
+
+static const char *const pin_uses[] = {"output", "input pull-up", "sensor"};
+static const char *const sensor_kinds[] = {"dht", "sht3x", "bme280"};
+
+template <typename B>
+static void print_profile() {
+  printf("%s%s, DHT%u\n", B::name, std::is_same<B, Board>::value ? " (selected)" : "", static_cast<unsigned>(B::dht_type));
+  printf("  avian sensor %s, reptile sensor %s%s\n", sensor_kinds[B::avian_sensor], sensor_kinds[B::reptile_sensor],
+         uses_i2c<B>() ? ", I2C bus used" : "");
+  for (uint8_t i = 0; i < BOARD_PIN_COUNT; i++) {
+    const boardPin pin = BoardPins<B>::table[i];
+    printf("  GPIO%-3u %-17s %s\n", static_cast<unsigned>(pin.pin), pin_functions[i], pin_uses[pin.use]);
+  }
+  printf("  output mask 0x%010llx\n", static_cast<unsigned long long>(output_mask<B>()));
+}
+
+int main() {
+  print_profile<BoardRev1>();
+  print_profile<BoardRev2>();
+  print_profile<BoardRev2I2c>();
+  print_profile<BoardNative>();
+  return 0;
+}
@@ -0,0 +1,100 @@
+/*
+ * Filter benchmark
+ * Times the filter per sample for each combination of its stages, on a noisy trace in the shape of DHT11 readings
+ * with a read glitch every 50 samples on average, and prints how many samples each combination replaced.
+ *
+ * Build and run with: pio run -e filterbench && .pio/build/filterbench/program --samples 1000000
+ */
+#include <SensorFilter.h>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+static uint32_t random_state = 1;
+
+static uint32_t next_random() {
+  uint32_t x = random_state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  random_state = x;
+  return x;
+}
+
+/*
+ * A slow drift between 20 and 30 degrees in whole degrees, with glitches to 0 or to a value far above the trend
+ */
+static std::vector<centi_t> noisy_trace(size_t count) {
+  std::vector<centi_t> trace(count);
+  int32_t trend = 2500;
+  for (size_t i = 0; i < count; i++) {
+    if (next_random() % 8 == 0) {
+      trend += next_random() % 2 == 0 ? 100 : -100;
+      trend = trend < 2000 ? 2000 : (trend > 3000 ? 3000 : trend);
+    }
+    int32_t sample = trend + (next_random() % 3 == 0 ? 100 : 0);
+    if (next_random() % 50 == 0) {
+      sample = next_random() % 2 == 0 ? 0 : 9900;
+    }
+    trace[i] = static_cast<centi_t>(sample);
+  }
+  return trace;
+}
+
+struct benchCase {
+  const char *name;
+  FilterConfig config;
+};
+
+int main(int argc, char **argv) {
+  size_t samples = 1000000;
+  for (int i = 1; i < argc; i += 2) {
+    if (strcmp(argv[i], "--samples") == 0 && i + 1 < argc) {
+      samples = strtoul(argv[i + 1], NULL, 10);
+    } else {
+      fprintf(stderr, "usage: filterbench [--samples N]\n");
+      return 1;
+    }
+  }
+  if (samples == 0) {
+    fprintf(stderr, "usage: filterbench [--samples N]\n");
+    return 1;
+  }
+
+  std::vector<centi_t> trace = noisy_trace(samples);
+  const benchCase cases[] = {
+      {"none", {false, false, 300, false, 30}},
+      {"hampel (default)", {false, true, 300, false, 30}},
+      {"median", {true, false, 300, false, 30}},
+      {"ewma", {false, false, 300, true, 30}},
+      {"hampel + ewma", {false, true, 300, true, 30}},
+      {"median + hampel + ewma", {true, true, 300, true, 30}},
+  };
+
+  size_t glitches = 0;
+  for (centi_t sample : trace) {
+    glitches += sample == 0 || sample == 9900 ? 1 : 0;
+  }
+  printf("%lu samples with %lu glitches, window of %d\n\n", static_cast<unsigned long>(samples), static_cast<unsigned long>(glitches), FILTER_WINDOW_SIZE);
+  printf("%-24s %10s %10s\n", "stages", "ns/sample", "replaced");
+  for (const benchCase &bench : cases) {
+    ChannelFilter filter;
+    uint32_t replaced = 0;
+    int64_t checksum = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < samples; i++) {
+      bool rejected;
+      checksum += filter.apply(trace[i], &bench.config, &rejected);
+      replaced += rejected ? 1 : 0;
+    }
+    std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - start;
+    // The checksum keeps the compiler from dropping the loop
+    if (checksum == 0) {
+      printf("checksum 0\n");
+    }
+    printf("%-24s %10.1f %10lu\n", bench.name, static_cast<double>(elapsed.count()) / samples, static_cast<unsigned long>(replaced));
+  }
+  return 0;
+}
@@ -0,0 +1,240 @@
+/*
+ * Fixed-point benchmark
+ * Compares the cost per sample of filtering, classifying and formatting a reading in hundredths with the float code the firmware
+ * used before, kept here as a reference, and prints the memory each of them takes per channel.
+ * The float reference is the hampel filter, the limit checks and the "%g" formatting of the readings as they were with floats.
+ * Both run on the same noisy trace and the levels they give are compared.
+ *
+ * Build and run with: pio run -e fixedbench && .pio/build/fixedbench/program --samples 1000000
+ */
+#include <Classifier.h>
+#include <FixedPoint.h>
+#include <SensorFilter.h>
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+/*
+ * The float filter of the firmware before the readings were carried in hundredths
+ */
+struct floatFilterConfig {
+  bool hampel;
+  float hampel_k;
+};
+
+static float float_median_of(const float *values, size_t count) {
+  float sorted[FILTER_WINDOW_SIZE];
+  for (size_t i = 0; i < count; i++) {
+    float value = values[i];
+    size_t j = i;
+    while (j > 0 && sorted[j - 1] > value) {
+      sorted[j] = sorted[j - 1];
+      j--;
+    }
+    sorted[j] = value;
+  }
+  if (count % 2 == 1) {
+    return sorted[count / 2];
+  }
+  return (sorted[count / 2 - 1] + sorted[count / 2]) / 2;
+}
+
+class FloatChannelFilter {
+  private:
+  float window[FILTER_WINDOW_SIZE];
+  uint8_t head;
+  uint8_t count;
+  float smoothed;
+  bool smoothed_primed;
+
+  public:
+  FloatChannelFilter() {
+    memset(this->window, 0, sizeof(this->window));
+    this->head = 0;
+    this->count = 0;
+    this->smoothed = 0;
+    this->smoothed_primed = false;
+  }
+
+  float apply(float sample, const floatFilterConfig *config, bool *rejected) {
+    *rejected = false;
+    this->window[this->head] = sample;
+    this->head = (this->head + 1) % FILTER_WINDOW_SIZE;
+    if (this->count < FILTER_WINDOW_SIZE) {
+      this->count++;
+    }
+    float value = sample;
+    if (config->hampel && this->count >= 3) {
+      float median = float_median_of(this->window, this->count);
+      float deviations[FILTER_WINDOW_SIZE];
+      for (uint8_t i = 0; i < this->count; i++) {
+        deviations[i] = fabsf(this->window[i] - median);
+      }
+      float threshold = config->hampel_k * 1.4826f * float_median_of(deviations, this->count);
+      if (threshold < 1.0f) {
+        threshold = 1.0f;
+      }
+      if (fabsf(sample - median) > threshold) {
+        value = median;
+        *rejected = true;
+      }
+    }
+    return value;
+  }
+};
+
+static readingLevel float_classify(float reading, const float *limits) {
+  if (reading < limits[0] || reading > limits[3]) {
+    return LEVEL_CRITICAL;
+  }
+  if (reading < limits[1] || reading > limits[2]) {
+    return LEVEL_WARNING;
+  }
+  return LEVEL_IDEAL;
+}
+
+struct floatLimits {
+  float avian_temp_limits[4];
+  float avian_humid_limits[4];
+  float reptile_temp_limits[4];
+  float reptile_humid_limits[4];
+};
+
+struct floatReading {
+  float temperature;
+  float humidity;
+};
+
+static uint32_t random_state = 1;
+
+static uint32_t next_random() {
+  uint32_t x = random_state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  random_state = x;
+  return x;
+}
+
+/*
+ * Temperatures between 15 and 40 degrees in tenths, as a DHT22 reports them, with a read glitch every 50 samples on average
+ */
+static std::vector<float> noisy_trace(size_t count) {
+  std::vector<float> trace(count);
+  int32_t trend = 275;
+  for (size_t i = 0; i < count; i++) {
+    trend += static_cast<int32_t>(next_random() % 3) - 1;
+    trend = trend < 150 ? 150 : (trend > 400 ? 400 : trend);
+    int32_t tenths = trend;
+    if (next_random() % 50 == 0) {
+      tenths = next_random() % 2 == 0 ? 0 : 990;
+    }
+    trace[i] = tenths / 10.0f;
+  }
+  return trace;
+}
+
+static double ns_per(std::chrono::nanoseconds elapsed, size_t count) {
+  return static_cast<double>(elapsed.count()) / count;
+}
+
+int main(int argc, char **argv) {
+  size_t samples = 1000000;
+  for (int i = 1; i < argc; i += 2) {
+    if (strcmp(argv[i], "--samples") == 0 && i + 1 < argc) {
+      samples = strtoul(argv[i + 1], NULL, 10);
+    } else {
+      fprintf(stderr, "usage: fixedbench [--samples N]\n");
+      return 1;
+    }
+  }
+  if (samples == 0) {
+    fprintf(stderr, "usage: fixedbench [--samples N]\n");
+    return 1;
+  }
+
+  std::vector<float> trace = noisy_trace(samples);
+  // The sensor floats are converted once when they are read, that is not part of the pipeline that is timed
+  std::vector<centi_t> centi_trace(samples);
+  for (size_t i = 0; i < samples; i++) {
+    centi_trace[i] = centi_from_float(trace[i]);
+  }
+
+  const float float_limits[4] = {18.0f, 24.5f, 32.0f, 37.5f};
+  const centi_t limits[4] = {1800, 2450, 3200, 3750};
+  floatFilterConfig float_config = {true, 3.0f};
+  FilterConfig config = {false, true, 300, false, 30};
+
+  std::vector<float> float_values(samples);
+  std::vector<centi_t> values(samples);
+  std::vector<readingLevel> float_levels(samples);
+  std::vector<readingLevel> levels(samples);
+  char text[16];
+  size_t float_chars = 0;
+  size_t chars = 0;
+
+  // Float: filter, classify and format
+  FloatChannelFilter float_filter;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < samples; i++) {
+    bool rejected;
+    float_values[i] = float_filter.apply(trace[i], &float_config, &rejected);
+  }
+  std::chrono::nanoseconds float_filter_time = std::chrono::steady_clock::now() - start;
+  start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < samples; i++) {
+    float_levels[i] = float_classify(float_values[i], float_limits);
+  }
+  std::chrono::nanoseconds float_classify_time = std::chrono::steady_clock::now() - start;
+  start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < samples; i++) {
+    float_chars += snprintf(text, sizeof(text), "%g", float_values[i]);
+  }
+  std::chrono::nanoseconds float_format_time = std::chrono::steady_clock::now() - start;
+
+  // Fixed point: the same steps with the firmware code
+  ChannelFilter filter;
+  start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < samples; i++) {
+    bool rejected;
+    values[i] = filter.apply(centi_trace[i], &config, &rejected);
+  }
+  std::chrono::nanoseconds filter_time = std::chrono::steady_clock::now() - start;
+  start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < samples; i++) {
+    levels[i] = classify_reading(values[i], limits);
+  }
+  std::chrono::nanoseconds classify_time = std::chrono::steady_clock::now() - start;
+  start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < samples; i++) {
+    chars += format_centi(values[i], text, sizeof(text));
+  }
+  std::chrono::nanoseconds format_time = std::chrono::steady_clock::now() - start;
+
+  size_t different = 0;
+  for (size_t i = 0; i < samples; i++) {
+    different += levels[i] != float_levels[i] ? 1 : 0;
+  }
+
+  printf("%lu samples\n\n", static_cast<unsigned long>(samples));
+  printf("%-14s %12s %12s\n", "ns/sample", "float", "fixed point");
+  printf("%-14s %12.1f %12.1f\n", "filter", ns_per(float_filter_time, samples), ns_per(filter_time, samples));
+  printf("%-14s %12.1f %12.1f\n", "classify", ns_per(float_classify_time, samples), ns_per(classify_time, samples));
+  printf("%-14s %12.1f %12.1f\n", "format", ns_per(float_format_time, samples), ns_per(format_time, samples));
+  printf("%-14s %12.1f %12.1f\n", "total", ns_per(float_filter_time + float_classify_time + float_format_time, samples),
+         ns_per(filter_time + classify_time + format_time, samples));
+  printf("%-14s %12.2f %12.2f\n", "chars/value", static_cast<double>(float_chars) / samples, static_cast<double>(chars) / samples);
+
+  printf("\n%-22s %8s %12s\n", "bytes", "float", "fixed point");
+  printf("%-22s %8lu %12lu\n", "filter window", static_cast<unsigned long>(FILTER_WINDOW_SIZE * sizeof(float)),
+         static_cast<unsigned long>(FILTER_WINDOW_SIZE * sizeof(centi_t)));
+  printf("%-22s %8lu %12lu\n", "filter per channel", static_cast<unsigned long>(sizeof(FloatChannelFilter)), static_cast<unsigned long>(sizeof(ChannelFilter)));
+  printf("%-22s %8lu %12lu\n", "reading per enclosure", static_cast<unsigned long>(sizeof(floatReading)), static_cast<unsigned long>(2 * sizeof(centi_t)));
+  printf("%-22s %8lu %12lu\n", "limits", static_cast<unsigned long>(sizeof(floatLimits)), static_cast<unsigned long>(sizeof(Limits)));
+
+  printf("\n%lu of %lu samples got a different level with floats\n", static_cast<unsigned long>(different), static_cast<unsigned long>(samples));
+  return 0;
+}
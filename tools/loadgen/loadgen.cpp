@@ -0,0 +1,562 @@
+/*
+ * Fleet load generator
+ * Runs the acquisition, filter, classify, serialize and publish path of the firmware for many virtual devices in one process.
+ * The devices share one event loop on a virtual clock. Each one publishes its readings at QoS 1 through its own ReliablePublisher
+ * to a broker stand-in that counts packets and bytes and returns a PUBACK after the link latency.
+ * The broker can be taken down for a while. As in the firmware the devices keep taking readings while they are disconnected,
+ * make one connection attempt every MQTT_RETRY_MS and send the messages still in their window again once they are back.
+ *
+ * Build and run with: pio run -e loadgen && .pio/build/loadgen/program --devices 5000 --outage-at 600 --outage-for 60
+ */
+#include <Classifier.h>
+#include <DeviceIdentity.h>
+#include <FixedPoint.h>
+#include <ReadingController.h>
+#include <ReliablePublisher.h>
+#include <SampleClock.h>
+#include <SensorFilter.h>
+#include <chrono>
+#include <memory>
+#include <queue>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+/*
+ * The firmware waits this long after a failed MQTT connection before trying again, mqttRetryInterval in main.cpp
+ */
+static const uint64_t MQTT_RETRY_MS = 5000;
+
+/*
+ * The loop of the firmware wakes at least this often for the commands, the QoS 1 retries are checked on those passes
+ */
+static const uint64_t LOOP_TICK_MS = 1000;
+
+/*
+ * Size of a PUBACK, the broker sends one for each QoS 1 PUBLISH
+ */
+static const uint64_t PUBACK_SIZE = 4;
+
+/*
+ * The bit of the first byte of a PUBLISH that marks a message sent again
+ */
+static const uint8_t PUBLISH_DUP_FLAG = 0x08;
+
+struct Options {
+  uint32_t devices = 1000;
+  uint32_t duration_s = 3600;
+  uint32_t interval_ms = 15000;
+  uint32_t outage_at_s = 0;
+  uint32_t outage_for_s = 0;
+  uint32_t accept_rate = 0; // connections the broker accepts per second, 0 = no limit
+  uint32_t latency_ms = 50;  // from a PUBLISH leaving a device to its PUBACK arriving
+  bool boot_together = false;
+  const char *root = "fleet";
+  uint32_t seed = 1;
+};
+
+/*
+ * The virtual time the devices stamp their samples with, the Unix time is where the run starts on the wall clock
+ */
+static const uint64_t VIRTUAL_EPOCH_MS = 1700000000000ULL;
+static uint64_t virtual_now = 0;
+
+static uint64_t virtual_clock() {
+  return virtual_now;
+}
+
+/*
+ * A small deterministic random number generator so that runs can be compared
+ */
+static uint32_t next_random(uint32_t *state) {
+  uint32_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  *state = x;
+  return x;
+}
+
+/*
+ * The packet id of a QoS 1 PUBLISH, after the fixed header, the remaining length and the topic
+ */
+static uint16_t publish_packet_id(const uint8_t *packet, size_t length) {
+  size_t position = 1;
+  while (position < length && packet[position] & 0x80) {
+    position++;
+  }
+  position++;
+  if (position + 2 > length) {
+    return 0;
+  }
+  position += 2 + (packet[position] << 8 | packet[position + 1]);
+  if (position + 2 > length) {
+    return 0;
+  }
+  return static_cast<uint16_t>(packet[position] << 8 | packet[position + 1]);
+}
+
+/*
+ * A stand-in for the broker
+ * It counts what the devices send and can limit how many connections it accepts per second like an overloaded broker
+ */
+class BrokerStandIn {
+  public:
+  bool up = true;
+  uint32_t accept_rate = 0;
+  uint64_t messages = 0;
+  uint64_t duplicates = 0; // PUBLISH packets sent again with the DUP flag
+  uint64_t bytes = 0;
+  uint64_t ack_bytes = 0;
+  uint64_t accepted_connects = 0;
+  uint64_t rejected_connects = 0;
+  uint32_t connected = 0;
+  std::vector<uint32_t> attempts_per_second;
+  std::vector<uint32_t> publishes_per_second;
+  uint64_t window_start = 0;
+  uint32_t accepted_in_window = 0;
+
+  bool connect(uint64_t now) {
+    uint64_t second = now / 1000;
+    if (second < this->attempts_per_second.size()) {
+      this->attempts_per_second[second]++;
+    }
+    if (now - this->window_start >= 1000) {
+      this->window_start = now - now % 1000;
+      this->accepted_in_window = 0;
+    }
+    if (!this->up || (this->accept_rate != 0 && this->accepted_in_window >= this->accept_rate)) {
+      this->rejected_connects++;
+      return false;
+    }
+    this->accepted_in_window++;
+    this->accepted_connects++;
+    this->connected++;
+    return true;
+  }
+
+  /*
+   * A QoS 1 PUBLISH written by a device, the broker answers it with a PUBACK
+   */
+  void publish(uint64_t now, const uint8_t *packet, size_t length) {
+    uint64_t second = now / 1000;
+    if (second < this->publishes_per_second.size()) {
+      this->publishes_per_second[second]++;
+    }
+    this->messages++;
+    this->duplicates += packet[0] & PUBLISH_DUP_FLAG ? 1 : 0;
+    this->bytes += length;
+    this->ack_bytes += PUBACK_SIZE;
+  }
+
+  void subscribe(const char *topic) {
+    // SUBSCRIBE with one topic filter: fixed header, packet id, topic length, topic and QoS
+    this->bytes += 2 + 2 + 2 + strlen(topic) + 1;
+  }
+};
+
+/*
+ * One virtual board, it holds the same objects the firmware has one of
+ */
+static size_t write_packet(const uint8_t *packet, size_t length);
+
+struct VirtualDevice {
+  DeviceIdentity identity;
+  ApplicationFilter filter;
+  ApplicationReading reading;
+  SampleClock clock;
+  ReliablePublisher publisher;
+  centi_t sensor[FILTER_CHANNELS];
+  uint32_t random;
+  bool connected;
+  bool reset_sent;
+  bool tick_scheduled;
+  uint32_t session; // the PUBACKs of an earlier connection are lost with it
+
+  VirtualDevice() : clock(virtual_clock), publisher(write_packet) {
+  }
+};
+
+enum eventType {
+  EVENT_SAMPLE,
+  EVENT_CONNECT,
+  EVENT_TICK,
+  EVENT_PUBACK,
+  EVENT_OUTAGE_START,
+  EVENT_OUTAGE_END
+};
+
+struct Event {
+  uint64_t time;
+  uint64_t order; // keeps events at the same time in the order they were scheduled
+  uint32_t device;
+  eventType type;
+  uint16_t packet_id;
+  uint32_t session;
+  bool operator>(const Event &other) const {
+    return time != other.time ? time > other.time : order > other.order;
+  }
+};
+
+class Simulation {
+  private:
+  Options options;
+  BrokerStandIn broker;
+  std::unique_ptr<VirtualDevice[]> devices;
+  std::priority_queue<Event, std::vector<Event>, std::greater<Event>> events;
+  uint64_t scheduled = 0;
+  Limits limits;
+  uint64_t readings = 0;
+  uint64_t offline_readings = 0;
+  uint64_t outage_end = 0;
+  uint64_t all_reconnected_at = 0;
+  double core_seconds = 0;
+
+  void schedule(uint64_t time, uint32_t device, eventType type, uint16_t packet_id = 0, uint32_t session = 0) {
+    this->events.push(Event{time, this->scheduled++, device, type, packet_id, session});
+  }
+
+  /*
+   * While a device has messages waiting for a PUBACK, the passes of its loop check them for a retry
+   */
+  void schedule_tick(uint64_t now, uint32_t index) {
+    VirtualDevice *device = &this->devices[index];
+    if (!device->tick_scheduled && device->publisher.in_flight() > 0) {
+      device->tick_scheduled = true;
+      this->schedule(now + LOOP_TICK_MS, index, EVENT_TICK);
+    }
+  }
+
+  /*
+   * The sensors drift slowly and now and then return a spike like the DHT11 does
+   */
+  void acquire(VirtualDevice *device, reading *avian, reading *reptilian) {
+    for (uint8_t i = 0; i < FILTER_CHANNELS; i++) {
+      int32_t step = static_cast<int32_t>(next_random(&device->random) % 21) - 10;
+      device->sensor[i] = static_cast<centi_t>(device->sensor[i] + step);
+    }
+    centi_t samples[FILTER_CHANNELS];
+    for (uint8_t i = 0; i < FILTER_CHANNELS; i++) {
+      samples[i] = device->sensor[i];
+      if (next_random(&device->random) % 100 == 0) {
+        samples[i] = static_cast<centi_t>(samples[i] + 1500);
+      }
+    }
+    avian->temperature = samples[AVIAN_TEMPERATURE];
+    avian->humidity = samples[AVIAN_HUMIDITY];
+    reptilian->temperature = samples[REPTILE_TEMPERATURE];
+    reptilian->humidity = samples[REPTILE_HUMIDITY];
+  }
+
+  /*
+   * The same steps as the reading branch of loop() in the firmware
+   * The reading goes into the window of the publisher also while the device is disconnected
+   */
+  void sample(uint64_t now, uint32_t index) {
+    VirtualDevice *device = &this->devices[index];
+    this->schedule(now + this->options.interval_ms, index, EVENT_SAMPLE);
+    this->offline_readings += device->connected ? 0 : 1;
+
+    auto start = std::chrono::steady_clock::now();
+    reading raw_avian;
+    reading raw_reptilian;
+    this->acquire(device, &raw_avian, &raw_reptilian);
+    sampleStamp stamp = device->clock.stamp();
+    device->reading.set_stamp(&stamp);
+    device->reading.set_raw_reading(&raw_avian, &raw_reptilian);
+
+    reading avian;
+    reading reptilian;
+    avian.temperature = device->filter.filter(AVIAN_TEMPERATURE, raw_avian.temperature);
+    avian.humidity = device->filter.filter(AVIAN_HUMIDITY, raw_avian.humidity);
+    reptilian.temperature = device->filter.filter(REPTILE_TEMPERATURE, raw_reptilian.temperature);
+    reptilian.humidity = device->filter.filter(REPTILE_HUMIDITY, raw_reptilian.humidity);
+    device->reading.set_reading(&avian, &reptilian);
+    device->reading.analyze(&this->limits);
+
+    char payload[READING_JSON_SIZE];
+    size_t length = device->reading.stringify_reading(payload, sizeof(payload));
+    device->reading.reset();
+    this->core_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    this->publish(now, index, TOPIC_READINGS, reinterpret_cast<const uint8_t *>(payload), length);
+    this->readings++;
+  }
+
+  void publish(uint64_t now, uint32_t index, deviceTopic topic, const uint8_t *payload, size_t length) {
+    VirtualDevice *device = &this->devices[index];
+    this->writing = index;
+    device->publisher.publish(device->identity.topic(topic), payload, length, static_cast<uint32_t>(now));
+    this->schedule_tick(now, index);
+  }
+
+  /*
+   * A pass of the loop of a device with messages in flight, reliable_publisher.poll() sends again the ones whose PUBACK is late
+   */
+  void tick(uint64_t now, uint32_t index) {
+    VirtualDevice *device = &this->devices[index];
+    device->tick_scheduled = false;
+    this->writing = index;
+    device->publisher.poll(static_cast<uint32_t>(now));
+    this->schedule_tick(now, index);
+  }
+
+  void puback(const Event &event) {
+    VirtualDevice *device = &this->devices[event.device];
+    if (device->connected && device->session == event.session) {
+      device->publisher.acknowledge(event.packet_id);
+    }
+  }
+
+  /*
+   * The same steps as connectMqtt() in the firmware, one attempt and the next one MQTT_RETRY_MS later
+   */
+  void connect(uint64_t now, uint32_t index) {
+    VirtualDevice *device = &this->devices[index];
+    if (device->connected) {
+      return;
+    }
+    if (!this->broker.connect(now)) {
+      this->schedule(now + MQTT_RETRY_MS, index, EVENT_CONNECT);
+      return;
+    }
+    device->connected = true;
+    device->session++;
+    // SNTP answers once the network is up
+    device->clock.sync(VIRTUAL_EPOCH_MS + now);
+    for (uint8_t i = 0; i < SUBSCRIBED_TOPIC_COUNT; i++) {
+      this->broker.subscribe(device->identity.topic(subscribed_topics[i]));
+    }
+    // The broker does not keep a session, the messages still in the window are sent again
+    this->writing = index;
+    device->publisher.resend(static_cast<uint32_t>(now));
+    if (!device->reset_sent) {
+      this->publish(now, index, TOPIC_SIREN_OFF, reinterpret_cast<const uint8_t *>("reset"), strlen("reset"));
+      device->reset_sent = true;
+    }
+    this->schedule_tick(now, index);
+    if (this->outage_end != 0 && this->all_reconnected_at == 0 && this->broker.connected == this->options.devices) {
+      this->all_reconnected_at = now;
+    }
+  }
+
+  /*
+   * The broker goes away, every device notices on its next pass of the loop and tries to connect straight away
+   */
+  void outage_start(uint64_t now) {
+    this->broker.up = false;
+    this->broker.connected = 0;
+    for (uint32_t i = 0; i < this->options.devices; i++) {
+      this->devices[i].connected = false;
+      this->schedule(now + next_random(&this->devices[i].random) % 1000, i, EVENT_CONNECT);
+    }
+  }
+
+  public:
+  uint32_t writing = 0; // the device whose publisher is writing
+
+  /*
+   * A packet written by the publisher of a device, it reaches the broker only while the device is connected
+   */
+  size_t write(const uint8_t *packet, size_t length) {
+    VirtualDevice *device = &this->devices[this->writing];
+    if (!device->connected) {
+      return 0;
+    }
+    this->broker.publish(virtual_now, packet, length);
+    this->schedule(virtual_now + this->options.latency_ms, this->writing, EVENT_PUBACK, publish_packet_id(packet, length), device->session);
+    return length;
+  }
+
+  Simulation(const Options &options) : options(options) {
+    const centi_t temperature[4] = {2000, 2400, 3000, 3500};
+    const centi_t humidity[4] = {3000, 4000, 6000, 7000};
+    memcpy(this->limits.avian_temp_limits, temperature, sizeof(temperature));
+    memcpy(this->limits.reptile_temp_limits, temperature, sizeof(temperature));
+    memcpy(this->limits.avian_humid_limits, humidity, sizeof(humidity));
+    memcpy(this->limits.reptile_humid_limits, humidity, sizeof(humidity));
+    this->broker.accept_rate = options.accept_rate;
+    this->broker.attempts_per_second.assign(options.duration_s + 1, 0);
+    this->broker.publishes_per_second.assign(options.duration_s + 1, 0);
+
+    this->devices.reset(new VirtualDevice[options.devices]);
+    uint32_t random = options.seed == 0 ? 1 : options.seed;
+    for (uint32_t i = 0; i < options.devices; i++) {
+      VirtualDevice *device = &this->devices[i];
+      // A locally administered MAC address so the ids look like real ones and never clash
+      uint64_t mac = 0x02 | (static_cast<uint64_t>(i + 1) << 16);
+      device->identity.begin(mac, options.root);
+      device->clock.begin(next_random(&random));
+      device->reading.publish_raw(false);
+      device->random = next_random(&random) | 1;
+      device->sensor[AVIAN_TEMPERATURE] = 2700;
+      device->sensor[AVIAN_HUMIDITY] = 5000;
+      device->sensor[REPTILE_TEMPERATURE] = 2800;
+      device->sensor[REPTILE_HUMIDITY] = 4500;
+      device->connected = false;
+      device->reset_sent = false;
+      device->tick_scheduled = false;
+      device->session = 0;
+
+      // Boards boot together after a power cut or spread out over one interval
+      uint64_t boot = options.boot_together ? 0 : next_random(&random) % options.interval_ms;
+      this->schedule(boot, i, EVENT_CONNECT);
+      this->schedule(boot + options.interval_ms, i, EVENT_SAMPLE);
+    }
+    if (options.outage_for_s != 0) {
+      this->schedule(static_cast<uint64_t>(options.outage_at_s) * 1000, 0, EVENT_OUTAGE_START);
+      this->schedule(static_cast<uint64_t>(options.outage_at_s + options.outage_for_s) * 1000, 0, EVENT_OUTAGE_END);
+    }
+  }
+
+  void run() {
+    uint64_t end = static_cast<uint64_t>(this->options.duration_s) * 1000;
+    auto start = std::chrono::steady_clock::now();
+    while (!this->events.empty() && this->events.top().time <= end) {
+      Event event = this->events.top();
+      this->events.pop();
+      virtual_now = event.time;
+      switch (event.type) {
+      case EVENT_SAMPLE:
+        this->sample(event.time, event.device);
+        break;
+      case EVENT_CONNECT:
+        this->connect(event.time, event.device);
+        break;
+      case EVENT_TICK:
+        this->tick(event.time, event.device);
+        break;
+      case EVENT_PUBACK:
+        this->puback(event);
+        break;
+      case EVENT_OUTAGE_START:
+        this->outage_start(event.time);
+        break;
+      case EVENT_OUTAGE_END:
+        this->broker.up = true;
+        this->outage_end = event.time;
+        break;
+      }
+    }
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    this->report(wall);
+  }
+
+  void report(double wall) {
+    double simulated = this->options.duration_s;
+    uint32_t peak_attempts = 0;
+    uint32_t peak_second = 0;
+    for (uint32_t i = 0; i < this->broker.attempts_per_second.size(); i++) {
+      if (this->broker.attempts_per_second[i] > peak_attempts) {
+        peak_attempts = this->broker.attempts_per_second[i];
+        peak_second = i;
+      }
+    }
+    uint32_t peak_publishes = 0;
+    uint32_t peak_publish_second = 0;
+    for (uint32_t i = 0; i < this->broker.publishes_per_second.size(); i++) {
+      if (this->broker.publishes_per_second[i] > peak_publishes) {
+        peak_publishes = this->broker.publishes_per_second[i];
+        peak_publish_second = i;
+      }
+    }
+    uint64_t acknowledged = 0;
+    uint64_t dropped = 0;
+    uint64_t expired = 0;
+    uint64_t in_flight = 0;
+    for (uint32_t i = 0; i < this->options.devices; i++) {
+      publisherCounters counters = this->devices[i].publisher.get_counters();
+      acknowledged += counters.acknowledged;
+      dropped += counters.dropped;
+      expired += counters.expired;
+      in_flight += this->devices[i].publisher.in_flight();
+    }
+
+    printf("devices            %u (topic root \"%s\", e.g %s)\n", this->options.devices, this->options.root, this->devices[0].identity.topic(TOPIC_READINGS));
+    printf("simulated          %.0f s in %.3f s wall time (%.1f simulated hours per second)\n", simulated, wall, wall > 0 ? simulated / 3600 / wall : 0);
+    printf("publishes          %llu QoS 1 (%.1f msg/s), %llu of them with the DUP flag, peak %u/s at %u s\n", static_cast<unsigned long long>(this->broker.messages),
+           this->broker.messages / simulated, static_cast<unsigned long long>(this->broker.duplicates), peak_publishes, peak_publish_second);
+    printf("bytes              %llu to the broker (%.1f B/s, %.1f B per message), %llu of PUBACKs back\n", static_cast<unsigned long long>(this->broker.bytes),
+           this->broker.bytes / simulated, this->broker.messages ? static_cast<double>(this->broker.bytes) / this->broker.messages : 0,
+           static_cast<unsigned long long>(this->broker.ack_bytes));
+    printf("readings           %llu taken, %llu of them while disconnected\n", static_cast<unsigned long long>(this->readings),
+           static_cast<unsigned long long>(this->offline_readings));
+    printf("delivery           %llu acknowledged, %llu given up for a newer message, %llu expired, %llu still in flight\n",
+           static_cast<unsigned long long>(acknowledged), static_cast<unsigned long long>(dropped), static_cast<unsigned long long>(expired),
+           static_cast<unsigned long long>(in_flight));
+    printf("core cost          %.0f ns per reading (filter, classify and serialize)\n", this->readings ? this->core_seconds * 1e9 / this->readings : 0);
+    printf("connects           %llu accepted, %llu rejected, peak %u attempts/s at %u s\n", static_cast<unsigned long long>(this->broker.accepted_connects),
+           static_cast<unsigned long long>(this->broker.rejected_connects), peak_attempts, peak_second);
+    if (this->outage_end != 0) {
+      if (this->all_reconnected_at != 0) {
+        printf("reconnect storm    all devices back %.1f s after the broker returned\n", (this->all_reconnected_at - this->outage_end) / 1000.0);
+      } else {
+        printf("reconnect storm    %u of %u devices back by the end of the run\n", this->broker.connected, this->options.devices);
+      }
+    }
+  }
+};
+
+/*
+ * The publishers of the devices write through the simulation that is running
+ */
+static Simulation *running = NULL;
+
+static size_t write_packet(const uint8_t *packet, size_t length) {
+  return running->write(packet, length);
+}
+
+static void usage() {
+  fprintf(stderr,
+          "usage: loadgen [--devices N] [--duration S] [--interval MS] [--outage-at S --outage-for S]\n"
+          "               [--accept-rate N] [--latency MS] [--boot-together] [--root TOPIC_ROOT] [--seed N]\n");
+}
+
+int main(int argc, char **argv) {
+  Options options;
+  for (int i = 1; i < argc; i++) {
+    const char *argument = argv[i];
+    const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+    if (strcmp(argument, "--boot-together") == 0) {
+      options.boot_together = true;
+      continue;
+    }
+    if (value == NULL) {
+      usage();
+      return 1;
+    }
+    if (strcmp(argument, "--devices") == 0) {
+      options.devices = strtoul(value, NULL, 10);
+    } else if (strcmp(argument, "--duration") == 0) {
+      options.duration_s = strtoul(value, NULL, 10);
+    } else if (strcmp(argument, "--interval") == 0) {
+      options.interval_ms = strtoul(value, NULL, 10);
+    } else if (strcmp(argument, "--outage-at") == 0) {
+      options.outage_at_s = strtoul(value, NULL, 10);
+    } else if (strcmp(argument, "--outage-for") == 0) {
+      options.outage_for_s = strtoul(value, NULL, 10);
+    } else if (strcmp(argument, "--accept-rate") == 0) {
+      options.accept_rate = strtoul(value, NULL, 10);
+    } else if (strcmp(argument, "--latency") == 0) {
+      options.latency_ms = strtoul(value, NULL, 10);
+    } else if (strcmp(argument, "--root") == 0) {
+      options.root = value;
+    } else if (strcmp(argument, "--seed") == 0) {
+      options.seed = strtoul(value, NULL, 10);
+    } else {
+      usage();
+      return 1;
+    }
+    i++;
+  }
+  if (options.devices == 0 || options.interval_ms == 0 || options.duration_s == 0) {
+    usage();
+    return 1;
+  }
+
+  Simulation simulation(options);
+  running = &simulation;
+  simulation.run();
+  return 0;
+}
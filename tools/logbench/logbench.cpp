@@ -0,0 +1,153 @@
+/*
+ * Logging benchmark
+ * Compares the time a loop pass spends logging with the synchronous Serial prints the firmware used before and with the deferred logger.
+ * Before: the prints of each pass are the ones of the firmware before the logger, replayed line by line. The Arduino core installs the UART
+ * driver without a transmit buffer, so a print waits for room in the 128 byte hardware FIFO and at 115200 baud each byte
+ * beyond the FIFO costs 10 bits on the wire. This column is that model, not a measurement.
+ * After: the messages the pass writes at the default level are formatted into a LogQueue as log_write does, the time is measured on the host.
+ * The same lines as before written through the queue are also timed, for the cost of keeping them at the debug level.
+ * The rest of the pass is the same code in both, on the device the loop time in the stats message gives the whole pass.
+ *
+ * Build and run with: pio run -e logbench && .pio/build/logbench/program --passes 100000
+ */
+#include <Logger.h>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#define UART_FIFO_SIZE 128
+#define UART_BAUD 115200
+
+static const double byte_time_us = 10.0 * 1000000.0 / UART_BAUD;
+
+struct logLine {
+  uint8_t level;
+  const char *text;
+};
+
+struct passCase {
+  const char *name;
+  // The Serial output of the pass before the logger, "\r\n" included
+  std::vector<const char *> before;
+  // The messages of the pass with the logger, only those at or below LOG_LEVEL are written
+  std::vector<logLine> after;
+};
+
+static LogQueue queue;
+
+/*
+ * Format a message into the benchmark queue the way log_write formats it into the log queue
+ */
+static void queue_write(uint8_t level, const char *format, ...) {
+  va_list args;
+  va_start(args, format);
+  queue.push(level, 0, format, args);
+  va_end(args);
+}
+
+static void queue_empty() {
+  char text[LOG_LINE_SIZE];
+  uint8_t level;
+  uint32_t timestamp;
+  while (queue.pop(&level, &timestamp, text)) {
+  }
+}
+
+/*
+ * The time the loop waits for the UART when the lines are printed one after another starting with an empty FIFO
+ */
+static double uart_wait_us(const std::vector<const char *> &lines, size_t *bytes) {
+  *bytes = 0;
+  for (const char *line : lines) {
+    *bytes += strlen(line);
+  }
+  return *bytes > UART_FIFO_SIZE ? (*bytes - UART_FIFO_SIZE) * byte_time_us : 0;
+}
+
+/*
+ * The mean time in nanoseconds to write the messages of one pass, the queue is emptied between passes outside the timing
+ * If every_level is false only the messages at or below LOG_LEVEL are written, as the LOG_* macros would compile them
+ */
+static double queue_ns(const std::vector<logLine> &lines, uint32_t passes, bool every_level) {
+  std::chrono::nanoseconds elapsed(0);
+  for (uint32_t pass = 0; pass < passes; pass++) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (const logLine &line : lines) {
+      if (every_level || line.level <= LOG_LEVEL) {
+        queue_write(line.level, "%s", line.text);
+      }
+    }
+    elapsed += std::chrono::steady_clock::now() - start;
+    queue_empty();
+  }
+  return static_cast<double>(elapsed.count()) / passes;
+}
+
+/*
+ * The lines before the logger written through the queue at the debug level, without their line ending
+ */
+static std::vector<logLine> as_debug(const std::vector<const char *> &lines, std::vector<std::string> *storage) {
+  std::vector<logLine> debug;
+  storage->reserve(lines.size());
+  for (const char *line : lines) {
+    std::string text(line);
+    while (!text.empty() && (text.back() == '\n' || text.back() == '\r')) {
+      text.pop_back();
+    }
+    storage->push_back(text);
+  }
+  for (const std::string &text : *storage) {
+    debug.push_back({LOG_LEVEL_DEBUG, text.c_str()});
+  }
+  return debug;
+}
+
+int main(int argc, char **argv) {
+  uint32_t passes = 100000;
+  for (int i = 1; i < argc; i += 2) {
+    if (strcmp(argv[i], "--passes") == 0 && i + 1 < argc) {
+      passes = strtoul(argv[i + 1], NULL, 10);
+    } else {
+      fprintf(stderr, "usage: logbench [--passes N]\n");
+      return 1;
+    }
+  }
+  if (passes == 0) {
+    fprintf(stderr, "usage: logbench [--passes N]\n");
+    return 1;
+  }
+
+  // The four readings of a pass each printed the level, the two lines of set_status and the decision
+  std::vector<const char *> ideal_before;
+  std::vector<const char *> critical_before;
+  for (uint8_t i = 0; i < 4; i++) {
+    ideal_before.insert(ideal_before.end(), {"ideal\r\n", "Setting status,decision: ideal\r\n", "Status.decision set to: ideal\r\n", "decision: ideal\r\n"});
+    critical_before.insert(critical_before.end(),
+                           {"critical\r\n", "Setting status,decision: critical\r\n", "Status.decision set to: critical\r\n", "decision: critical\r\n"});
+  }
+  critical_before.push_back("Siren on\r\n");
+
+  const passCase cases[] = {
+      {"reading, all ideal", ideal_before, {}},
+      {"reading, all critical", critical_before, {{LOG_LEVEL_INFO, "Siren on"}}},
+      {"command, siren on", {"Message arrived on topic: siren\r\n", "Siren on\r\n"}, {{LOG_LEVEL_DEBUG, "Message arrived on topic: siren"}, {LOG_LEVEL_INFO, "Siren on"}}},
+      {"no message", {}, {}},
+  };
+
+  printf("%lu passes, UART at %d baud with a %d byte FIFO, LOG_LEVEL %d\n\n", static_cast<unsigned long>(passes), UART_BAUD, UART_FIFO_SIZE, LOG_LEVEL);
+  printf("%-22s %6s %16s %16s %18s\n", "pass", "bytes", "before us", "after ns", "same lines ns");
+  printf("%-22s %6s %16s %16s %18s\n", "", "", "(UART model)", "(host)", "(host, debug)");
+  for (const passCase &bench : cases) {
+    size_t bytes;
+    double before_us = uart_wait_us(bench.before, &bytes);
+    double after_ns = queue_ns(bench.after, passes, false);
+    std::vector<std::string> storage;
+    double same_ns = queue_ns(as_debug(bench.before, &storage), passes, true);
+    printf("%-22s %6lu %16.1f %16.1f %18.1f\n", bench.name, static_cast<unsigned long>(bytes), before_us, after_ns, same_ns);
+  }
+  printf("\n%lu messages dropped\n", static_cast<unsigned long>(queue.dropped_count()));
+  return 0;
+}
@@ -0,0 +1,237 @@
+/*
+ * QoS 1 publisher benchmark
+ * Runs ReliablePublisher over a virtual link with a fixed latency to a broker stand-in that loses PUBLISH packets and PUBACKs.
+ * For each window size up to PUBLISH_WINDOW_SIZE, which the pubbench environment sets to 16, it reports how many distinct messages
+ * per second reach the broker and how many were sent again, and it checks that every acknowledged message really reached the broker.
+ *
+ * Build and run with: pio run -e pubbench && .pio/build/pubbench/program --latency 50 --ack-loss 10
+ */
+#include <ReliablePublisher.h>
+#include <deque>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+struct Options {
+  uint32_t latency_ms = 50; // one way
+  uint32_t ack_loss = 10;   // percent of PUBACKs the broker stand-in drops
+  uint32_t publish_loss = 0; // percent of PUBLISH packets lost on the way to the broker
+  uint32_t duration_s = 60;
+  uint32_t retry_ms = 1000;
+  uint32_t seed = 1;
+};
+
+struct Packet {
+  uint32_t arrives_at;
+  std::vector<uint8_t> bytes;
+};
+
+/*
+ * The state of one run, the packet writer is a plain function so it reaches the link through this
+ */
+struct Link {
+  uint32_t now;
+  uint32_t random;
+  std::deque<Packet> to_broker;
+  std::deque<Packet> to_device;
+  std::vector<uint32_t> received; // how many times the broker received each message
+  std::vector<uint32_t> message_of_id; // the message each packet id was last used for
+};
+
+static Options options;
+static Link link;
+
+static uint32_t next_random() {
+  uint32_t x = link.random;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  link.random = x;
+  return x;
+}
+
+static bool parse_publish(const uint8_t *bytes, size_t length, uint16_t *packet_id, uint32_t *message);
+
+static size_t write_packet(const uint8_t *packet, size_t length) {
+  uint16_t packet_id;
+  uint32_t message;
+  if (parse_publish(packet, length, &packet_id, &message)) {
+    link.message_of_id[packet_id] = message;
+  }
+  if (next_random() % 100 >= options.publish_loss) {
+    link.to_broker.push_back(Packet{link.now + options.latency_ms, std::vector<uint8_t>(packet, packet + length)});
+  }
+  return length;
+}
+
+/*
+ * A function to read the packet id and the message number out of a PUBLISH packet
+ */
+static bool parse_publish(const uint8_t *bytes, size_t length, uint16_t *packet_id, uint32_t *message) {
+  size_t position = 1;
+  uint32_t remaining = 0;
+  uint8_t shift = 0;
+  while (bytes[position] & 0x80) {
+    remaining |= static_cast<uint32_t>(bytes[position++] & 0x7f) << shift;
+    shift += 7;
+  }
+  remaining |= static_cast<uint32_t>(bytes[position++]) << shift;
+  if ((bytes[0] & 0xf6) != 0x32 || position + remaining != length) {
+    fprintf(stderr, "malformed PUBLISH packet\n");
+    return false;
+  }
+  size_t topic_length = (bytes[position] << 8) | bytes[position + 1];
+  position += 2 + topic_length;
+  *packet_id = static_cast<uint16_t>((bytes[position] << 8) | bytes[position + 1]);
+  position += 2;
+  std::string payload(bytes + position, bytes + length);
+  *message = strtoul(payload.c_str(), NULL, 10);
+  return true;
+}
+
+/*
+ * The broker stand-in counts the message and answers with a PUBACK unless the PUBACK is lost
+ */
+static bool broker_receive(const std::vector<uint8_t> &bytes) {
+  uint16_t packet_id;
+  uint32_t message;
+  if (!parse_publish(bytes.data(), bytes.size(), &packet_id, &message)) {
+    return false;
+  }
+  if (message >= link.received.size()) {
+    link.received.resize(message + 1, 0);
+  }
+  link.received[message]++;
+
+  if (next_random() % 100 >= options.ack_loss) {
+    uint8_t id_high = static_cast<uint8_t>(packet_id >> 8);
+    uint8_t id_low = static_cast<uint8_t>(packet_id & 0xff);
+    link.to_device.push_back(Packet{link.now + options.latency_ms, std::vector<uint8_t>{0x40, 0x02, id_high, id_low}});
+  }
+  return true;
+}
+
+struct Result {
+  double delivered_per_second;
+  uint32_t delivered;
+  publisherCounters counters;
+  bool consistent;
+};
+
+/*
+ * Publishes as fast as the window allows for the duration of the run
+ */
+static Result run(uint8_t window) {
+  link = Link();
+  link.random = options.seed == 0 ? 1 : options.seed;
+  link.message_of_id.assign(65536, UINT32_MAX);
+  ReliablePublisher publisher(write_packet, window, options.retry_ms);
+  PubackParser parser;
+  std::vector<bool> acknowledged;
+  uint32_t next_message = 0;
+  Result result;
+  result.consistent = true;
+
+  uint32_t end = options.duration_s * 1000;
+  for (link.now = 0; link.now < end; link.now++) {
+    while (!link.to_broker.empty() && link.to_broker.front().arrives_at <= link.now) {
+      result.consistent &= broker_receive(link.to_broker.front().bytes);
+      link.to_broker.pop_front();
+    }
+    while (!link.to_device.empty() && link.to_device.front().arrives_at <= link.now) {
+      for (uint8_t byte : link.to_device.front().bytes) {
+        uint16_t packet_id;
+        if (parser.feed(byte, &packet_id)) {
+          uint32_t message = link.message_of_id[packet_id];
+          if (publisher.acknowledge(packet_id) && message != UINT32_MAX) {
+            acknowledged[message] = true;
+          }
+        }
+      }
+      link.to_device.pop_front();
+    }
+    publisher.poll(link.now);
+
+    // Keep the window full, each message carries its number so the broker can tell duplicates apart
+    while (publisher.in_flight() < window) {
+      char payload[16];
+      snprintf(payload, sizeof(payload), "%lu", static_cast<unsigned long>(next_message));
+      if (!publisher.publish("bench/readings", payload, link.now)) {
+        break;
+      }
+      acknowledged.push_back(false);
+      next_message++;
+    }
+  }
+
+  result.delivered = 0;
+  for (uint32_t i = 0; i < link.received.size(); i++) {
+    if (link.received[i] > 0) {
+      result.delivered++;
+    }
+  }
+  for (uint32_t i = 0; i < acknowledged.size(); i++) {
+    if (acknowledged[i] && (i >= link.received.size() || link.received[i] == 0)) {
+      fprintf(stderr, "message %lu was acknowledged but never reached the broker\n", static_cast<unsigned long>(i));
+      result.consistent = false;
+    }
+  }
+  result.delivered_per_second = result.delivered / static_cast<double>(options.duration_s);
+  result.counters = publisher.get_counters();
+  return result;
+}
+
+static void usage() {
+  fprintf(stderr, "usage: pubbench [--latency MS] [--ack-loss PERCENT] [--publish-loss PERCENT] [--duration S] [--retry MS] [--seed N]\n");
+}
+
+int main(int argc, char **argv) {
+  for (int i = 1; i < argc; i += 2) {
+    if (i + 1 >= argc) {
+      usage();
+      return 1;
+    }
+    const char *argument = argv[i];
+    uint32_t value = strtoul(argv[i + 1], NULL, 10);
+    if (strcmp(argument, "--latency") == 0) {
+      options.latency_ms = value;
+    } else if (strcmp(argument, "--ack-loss") == 0) {
+      options.ack_loss = value;
+    } else if (strcmp(argument, "--publish-loss") == 0) {
+      options.publish_loss = value;
+    } else if (strcmp(argument, "--duration") == 0) {
+      options.duration_s = value;
+    } else if (strcmp(argument, "--retry") == 0) {
+      options.retry_ms = value;
+    } else if (strcmp(argument, "--seed") == 0) {
+      options.seed = value;
+    } else {
+      usage();
+      return 1;
+    }
+  }
+  if (options.duration_s == 0 || options.ack_loss > 100 || options.publish_loss > 100) {
+    usage();
+    return 1;
+  }
+
+  printf("latency %lu ms, %lu%% PUBACKs lost, %lu%% PUBLISHes lost, retry after %lu ms, %lu s per run\n",
+         static_cast<unsigned long>(options.latency_ms), static_cast<unsigned long>(options.ack_loss), static_cast<unsigned long>(options.publish_loss),
+         static_cast<unsigned long>(options.retry_ms), static_cast<unsigned long>(options.duration_s));
+  printf("%6s %12s %10s %10s %14s %8s\n", "window", "delivered/s", "delivered", "acked", "retransmitted", "expired");
+  bool consistent = true;
+  for (uint8_t window = 1; window <= PUBLISH_WINDOW_SIZE; window *= 2) {
+    Result result = run(window);
+    printf("%6u %12.1f %10lu %10lu %14lu %8lu\n", window, result.delivered_per_second, static_cast<unsigned long>(result.delivered),
+           static_cast<unsigned long>(result.counters.acknowledged), static_cast<unsigned long>(result.counters.retransmitted),
+           static_cast<unsigned long>(result.counters.expired));
+    consistent &= result.consistent;
+  }
+  if (!consistent) {
+    fprintf(stderr, "FAILED: the publisher lost track of a message\n");
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,505 @@
+/*
+ * Trace replay
+ * Feeds a recorded trace of sensor values, button presses and commands through the decisions the firmware makes on a virtual clock:
+ * the filter, the sample clock, analyze(), the siren of AlarmController, stringify_reading() and the alarm frames of the live stream.
+ * The passes of the loop are timed by SleepScheduler as on the device and commands are handled on the 1 second tick. The readings are taken
+ * by ReadingCycle as in main.cpp: the sensors of the trace convert for REPLAY_CONVERSION_MS, the sample is stamped once they are
+ * collected and a failed read is tried again after SENSOR_RETRY_MS. Every change of the LEDs or the siren and every message published is written to an event log
+ * that is the same on every run, so it can be compared with a golden log recorded before a change.
+ *
+ * Trace lines are <time_ms>,<event>,<arguments> and lines starting with # are ignored:
+ *   0,limits,<16 values>                  the four limits of the avian temperature, avian humidity, reptile temperature and reptile humidity
+ *   0,reading,<avian t>,<avian h>,<reptile t>,<reptile h>  what the sensors read from now on, nan for a sensor that does not answer
+ *   0,sync,<unix_ms>                      the clock is synchronized with SNTP
+ *   0,button,stop                         the stop siren button is pressed
+ *   0,command,<topic>,<payload>           a command arrives on MQTT e.g command/siren,siren off
+ *
+ * Build and run with: pio run -e replay && .pio/build/replay/program tools/replay/traces/incident.csv --golden tools/replay/traces/incident.log
+ */
+#include <AlarmController.h>
+#include <BoardProfile.h>
+#include <CommandChannel.h>
+#include <DeviceIdentity.h>
+#include <ReadingController.h>
+#include <ReadingCycle.h>
+#include <SampleClock.h>
+#include <SensorDriver.h>
+#include <SensorFilter.h>
+#include <SleepScheduler.h>
+#include <StreamPolicy.h>
+#include <chrono>
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+enum traceKind {
+  TRACE_LIMITS,
+  TRACE_READING,
+  TRACE_SYNC,
+  TRACE_BUTTON,
+  TRACE_COMMAND
+};
+
+struct traceEvent {
+  uint64_t time_ms;
+  traceKind kind;
+  float values[16];
+  uint64_t unix_ms;
+  char topic[TOPIC_SIZE];
+  char payload[64];
+};
+
+/*
+ * Split a line at the commas, the fields point into line
+ */
+static size_t split(char *line, char **fields, size_t count) {
+  size_t found = 0;
+  char *field = line;
+  while (found < count) {
+    fields[found++] = field;
+    char *comma = strchr(field, ',');
+    if (comma == NULL) {
+      break;
+    }
+    *comma = '\0';
+    field = comma + 1;
+  }
+  return found;
+}
+
+static bool parse_trace(const char *path, std::vector<traceEvent> *events) {
+  FILE *file = fopen(path, "r");
+  if (file == NULL) {
+    fprintf(stderr, "cannot open %s\n", path);
+    return false;
+  }
+  char line[512];
+  unsigned number = 0;
+  bool ok = true;
+  while (ok && fgets(line, sizeof(line), file) != NULL) {
+    number++;
+    line[strcspn(line, "\r\n")] = '\0';
+    if (line[0] == '#' || line[0] == '\0') {
+      continue;
+    }
+    char *fields[20];
+    size_t count = split(line, fields, 20);
+    traceEvent event;
+    memset(&event, 0, sizeof(event));
+    event.time_ms = strtoull(fields[0], NULL, 10);
+    if (count >= 2 && !events->empty() && event.time_ms < events->back().time_ms) {
+      fprintf(stderr, "%s:%u: events are not in time order\n", path, number);
+      ok = false;
+    } else if (count == 18 && strcmp(fields[1], "limits") == 0) {
+      event.kind = TRACE_LIMITS;
+      for (size_t i = 0; i < 16; i++) {
+        event.values[i] = strtof(fields[i + 2], NULL);
+      }
+    } else if (count == 6 && strcmp(fields[1], "reading") == 0) {
+      event.kind = TRACE_READING;
+      for (size_t i = 0; i < 4; i++) {
+        event.values[i] = strtof(fields[i + 2], NULL);
+      }
+    } else if (count == 3 && strcmp(fields[1], "sync") == 0) {
+      event.kind = TRACE_SYNC;
+      event.unix_ms = strtoull(fields[2], NULL, 10);
+    } else if (count == 3 && strcmp(fields[1], "button") == 0 && strcmp(fields[2], "stop") == 0) {
+      event.kind = TRACE_BUTTON;
+    } else if (count == 4 && strcmp(fields[1], "command") == 0) {
+      event.kind = TRACE_COMMAND;
+      snprintf(event.topic, sizeof(event.topic), "%s", fields[2]);
+      snprintf(event.payload, sizeof(event.payload), "%s", fields[3]);
+    } else {
+      fprintf(stderr, "%s:%u: cannot parse the event\n", path, number);
+      ok = false;
+    }
+    if (ok) {
+      events->push_back(event);
+    }
+  }
+  fclose(file);
+  return ok;
+}
+
+/*
+ * The event log, written to a file or compared line by line with a golden log
+ */
+static FILE *log_file = NULL;
+static FILE *golden_file = NULL;
+static unsigned log_lines = 0;
+static unsigned mismatches = 0;
+
+static uint64_t now_ms = 0;
+
+static void event_log(const char *format, ...) {
+  char line[512];
+  int length = snprintf(line, sizeof(line), "%llu ", static_cast<unsigned long long>(now_ms));
+  va_list args;
+  va_start(args, format);
+  vsnprintf(line + length, sizeof(line) - length, format, args);
+  va_end(args);
+  log_lines++;
+  if (log_file != NULL) {
+    fprintf(log_file, "%s\n", line);
+  }
+  if (golden_file != NULL && mismatches == 0) {
+    char expected[512];
+    if (fgets(expected, sizeof(expected), golden_file) == NULL) {
+      expected[0] = '\0';
+    }
+    expected[strcspn(expected, "\r\n")] = '\0';
+    if (strcmp(expected, line) != 0) {
+      fprintf(stderr, "line %u differs from the golden log\n  expected: %s\n  replayed: %s\n", log_lines, expected[0] ? expected : "(end of log)", line);
+      mismatches++;
+    }
+  }
+}
+
+/*
+ * The simulated device, the same objects main.cpp has
+ */
+static uint64_t virtual_monotonic() {
+  return now_ms;
+}
+
+static uint32_t virtual_uptime() {
+  return static_cast<uint32_t>(now_ms);
+}
+
+static const std::vector<traceEvent> *trace = NULL;
+static size_t next_event = 0;
+static uint64_t trace_offset = 0;
+
+/*
+ * The sleep backend, the clock moves to the end of the sleep or to the next button press of the trace
+ */
+static wakeReason virtual_sleep(uint32_t duration_ms) {
+  uint64_t end = now_ms + duration_ms;
+  for (size_t i = next_event; i < trace->size(); i++) {
+    uint64_t at = (*trace)[i].time_ms + trace_offset;
+    if (at > end) {
+      break;
+    }
+    if ((*trace)[i].kind == TRACE_BUTTON) {
+      now_ms = at > now_ms ? at : now_ms;
+      return WAKE_BUTTON;
+    }
+  }
+  now_ms = end;
+  return WAKE_TIMER;
+}
+
+/*
+ * A conversion of the sensors of the trace takes as long as the start of the DHT11 of the first board revision
+ */
+#define REPLAY_CONVERSION_MS 20
+
+static float sensors[4] = {NAN, NAN, NAN, NAN};
+
+/*
+ * A sensor that reads what the trace says, the temperature and humidity at values[0] and values[1]
+ * A nan in the trace is a sensor that does not answer
+ */
+class TraceDriver : public SensorDriver {
+  private:
+  const float *values;
+  uint32_t ready_ms;
+
+  public:
+  TraceDriver(const float *values) {
+    this->values = values;
+    this->ready_ms = 0;
+  }
+  const char *name() {
+    return "trace";
+  }
+  bool begin() {
+    return true;
+  }
+  bool start(uint32_t now_ms) {
+    this->ready_ms = now_ms + REPLAY_CONVERSION_MS;
+    return true;
+  }
+  sensorPoll poll(uint32_t now_ms, sensorSample *sample) {
+    if (static_cast<int32_t>(now_ms - this->ready_ms) < 0) {
+      return SENSOR_PENDING;
+    }
+    if (isnan(this->values[0]) || isnan(this->values[1])) {
+      return SENSOR_FAILED;
+    }
+    sample->temperature = centi_from_float(this->values[0]);
+    sample->humidity = centi_from_float(this->values[1]);
+    return SENSOR_DONE;
+  }
+  uint32_t ready_in(uint32_t now_ms) {
+    int32_t left = static_cast<int32_t>(this->ready_ms - now_ms);
+    return left > 0 ? left : 1;
+  }
+};
+
+static DeviceIdentity identity;
+static ApplicationFilter application_filter;
+static ApplicationReading application_reading;
+static SampleClock sample_clock(virtual_monotonic);
+static AlarmController alarm_controller;
+static SleepScheduler scheduler(virtual_uptime, virtual_sleep);
+static TraceDriver avian_sensor(&sensors[0]);
+static TraceDriver reptile_sensor(&sensors[2]);
+static SensorSet sensor_set(virtual_uptime);
+static ReadingCycle reading_cycle(&sensor_set, &scheduler, &application_filter, &sample_clock, &application_reading, &alarm_controller, NULL);
+static int8_t command_event = -1;
+
+static Limits limits;
+static bool sample_requested = false;
+static bool stop_pressed = false;
+static std::vector<const traceEvent *> pending_commands;
+static bool leds_shown = false;
+static enclosureLevels shown_levels = {LEVEL_IDEAL, LEVEL_IDEAL};
+static bool alarm_streamed = false;
+static bool streamed_siren = false;
+static enclosureLevels streamed_levels = {LEVEL_IDEAL, LEVEL_IDEAL};
+
+static void publish(deviceTopic topic, const char *payload) {
+  event_log("publish %s %s", identity.topic(topic), payload);
+}
+
+static void set_siren(bool on) {
+  event_log("siren %s", on ? "on" : "off");
+}
+
+/*
+ * The command handlers of main.cpp that change what the replay checks
+ */
+static bool handle_siren(const uint8_t *payload, unsigned int length) {
+  if (!alarm_controller.siren_command(payload, length)) {
+    return false;
+  }
+  set_siren(alarm_controller.siren_on());
+  return true;
+}
+
+static bool handle_sample_now(const uint8_t *payload, unsigned int length) {
+  sample_requested = true;
+  return true;
+}
+
+static bool handle_set_interval(const uint8_t *payload, unsigned int length) {
+  uint32_t interval;
+  if (!parse_read_interval(payload, length, &interval)) {
+    return false;
+  }
+  reading_cycle.set_interval(interval);
+  return true;
+}
+
+/*
+ * The statistics are not replayed, the command is only acknowledged
+ */
+static bool handle_publish_stats(const uint8_t *payload, unsigned int length) {
+  return true;
+}
+
+static const CommandRoute command_routes[] = {
+    {identity.topic(TOPIC_SIREN), handle_siren},
+    {identity.topic(TOPIC_COMMAND_SIREN), handle_siren},
+    {identity.topic(TOPIC_COMMAND_SAMPLE), handle_sample_now},
+    {identity.topic(TOPIC_COMMAND_INTERVAL), handle_set_interval},
+    {identity.topic(TOPIC_COMMAND_STATS), handle_publish_stats},
+};
+static const size_t command_route_count = sizeof(command_routes) / sizeof(command_routes[0]);
+
+static void apply_trace_events() {
+  while (next_event < trace->size() && (*trace)[next_event].time_ms + trace_offset <= now_ms) {
+    const traceEvent *event = &(*trace)[next_event++];
+    switch (event->kind) {
+    case TRACE_LIMITS:
+      for (size_t i = 0; i < 4; i++) {
+        limits.avian_temp_limits[i] = centi_from_float(event->values[i]);
+        limits.avian_humid_limits[i] = centi_from_float(event->values[i + 4]);
+        limits.reptile_temp_limits[i] = centi_from_float(event->values[i + 8]);
+        limits.reptile_humid_limits[i] = centi_from_float(event->values[i + 12]);
+      }
+      break;
+    case TRACE_READING:
+      memcpy(sensors, event->values, sizeof(sensors));
+      break;
+    case TRACE_SYNC:
+      sample_clock.sync(event->unix_ms + trace_offset);
+      break;
+    case TRACE_BUTTON:
+      stop_pressed = true;
+      break;
+    case TRACE_COMMAND:
+      pending_commands.push_back(event);
+      break;
+    }
+  }
+}
+
+/*
+ * One pass of loop() from the commands tick to the alarm frames of the live stream
+ */
+static void run_pass() {
+  apply_trace_events();
+
+  if (scheduler.due(command_event)) {
+    for (const traceEvent *command : pending_commands) {
+      const uint8_t *payload = reinterpret_cast<const uint8_t *>(command->payload);
+      unsigned int length = strlen(command->payload);
+      commandResult result = dispatch_command(command_routes, command_route_count, command->topic, payload, length);
+      char ack[TOPIC_SIZE + 16];
+      format_command_ack(ack, sizeof(ack), command->topic, result);
+      publish(TOPIC_COMMAND_ACK, ack);
+    }
+    pending_commands.clear();
+  }
+
+  if (reading_cycle.start(sample_requested)) {
+    sample_requested = false;
+  }
+  readingStep step = reading_cycle.poll();
+  if (step == READING_FAILED) {
+    event_log("sensors failed");
+  }
+
+  if (step == READING_TAKEN) {
+    char payload[READING_JSON_SIZE];
+    readingOutcome outcome = reading_cycle.evaluate(&limits, payload, sizeof(payload));
+    enclosureLevels levels = outcome.levels;
+    if (!leds_shown || levels.avian != shown_levels.avian || levels.reptilian != shown_levels.reptilian) {
+      event_log("leds avian=%s reptilian=%s", level_name(levels.avian), level_name(levels.reptilian));
+      shown_levels = levels;
+      leds_shown = true;
+    }
+    if (outcome.change == ALARM_RESET) {
+      publish(TOPIC_SIREN_OFF, "reset");
+      set_siren(false);
+    } else if (outcome.change == ALARM_RAISED) {
+      set_siren(true);
+    }
+    publish(TOPIC_READINGS, payload);
+  }
+
+  if (stop_pressed) {
+    if (alarm_controller.stop_pressed() == ALARM_RESET) {
+      publish(TOPIC_SIREN_OFF, "reset");
+      set_siren(false);
+    } else if (alarm_controller.siren_on()) {
+      event_log("stop ignored, an enclosure is critical");
+    }
+  }
+  stop_pressed = false;
+
+  if (alarm_controller.levels_known()) {
+    bool siren = alarm_controller.siren_on();
+    enclosureLevels levels = alarm_controller.get_levels();
+    if (!alarm_streamed || siren != streamed_siren || levels.avian != streamed_levels.avian || levels.reptilian != streamed_levels.reptilian) {
+      char alarm[96];
+      format_alarm(alarm, sizeof(alarm), siren, levels);
+      event_log("stream alarm %s", alarm);
+      streamed_siren = siren;
+      streamed_levels = levels;
+      alarm_streamed = true;
+    }
+  }
+}
+
+static void usage() {
+  fprintf(stderr, "usage: replay <trace.csv> [--log FILE] [--golden FILE] [--repeat N]\n");
+}
+
+int main(int argc, char **argv) {
+  const char *trace_path = NULL;
+  const char *log_path = NULL;
+  const char *golden_path = NULL;
+  unsigned long repeat = 1;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--log") == 0 && i + 1 < argc) {
+      log_path = argv[++i];
+    } else if (strcmp(argv[i], "--golden") == 0 && i + 1 < argc) {
+      golden_path = argv[++i];
+    } else if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc) {
+      repeat = strtoul(argv[++i], NULL, 10);
+    } else if (argv[i][0] != '-' && trace_path == NULL) {
+      trace_path = argv[i];
+    } else {
+      usage();
+      return 1;
+    }
+  }
+  if (trace_path == NULL || repeat == 0) {
+    usage();
+    return 1;
+  }
+
+  std::vector<traceEvent> events;
+  if (!parse_trace(trace_path, &events) || events.empty()) {
+    return 1;
+  }
+  trace = &events;
+
+  if (log_path != NULL && strcmp(log_path, "-") == 0) {
+    log_file = stdout;
+  } else if (log_path != NULL) {
+    log_file = fopen(log_path, "w");
+  } else if (golden_path == NULL) {
+    log_file = stdout;
+  }
+  if (golden_path != NULL) {
+    golden_file = fopen(golden_path, "r");
+    if (golden_file == NULL) {
+      fprintf(stderr, "cannot open %s\n", golden_path);
+      return 1;
+    }
+  }
+
+  // A fixed device and boot so the topics and the readings are the same on every run
+  identity.begin(0xa4cf12b3c5d8ULL, MQTT_TOPIC_ROOT);
+  sample_clock.begin(0x5eed0001);
+  memset(&limits, 0, sizeof(limits));
+  sensor_set.attach(ENCLOSURE_AVIAN, &avian_sensor);
+  sensor_set.attach(ENCLOSURE_REPTILE, &reptile_sensor);
+  sensor_set.begin();
+  reading_cycle.begin(15000);
+  command_event = scheduler.add(1000);
+
+  // The trace is replayed back to back, each copy starts where the previous one ended
+  uint64_t trace_length = events.back().time_ms;
+  uint64_t passes = 0;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (unsigned long copy = 0; copy < repeat; copy++) {
+    trace_offset = copy * trace_length;
+    next_event = 0;
+    uint64_t end = trace_offset + trace_length;
+    while (now_ms <= end && mismatches == 0) {
+      run_pass();
+      passes++;
+      scheduler.sleep();
+    }
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  if (golden_file != NULL && mismatches == 0) {
+    char extra[512];
+    if (fgets(extra, sizeof(extra), golden_file) != NULL) {
+      extra[strcspn(extra, "\r\n")] = '\0';
+      fprintf(stderr, "the golden log goes on after line %u\n  expected: %s\n", log_lines, extra);
+      mismatches++;
+    }
+  }
+  if (log_file != NULL && log_file != stdout) {
+    fclose(log_file);
+  }
+
+  double simulated_hours = now_ms / 3600000.0;
+  fprintf(stderr, "%.1f simulated hours, %llu passes, %u events in %.3f s: %.0f simulated hours per second\n", simulated_hours,
+          static_cast<unsigned long long>(passes), log_lines, seconds, seconds > 0 ? simulated_hours / seconds : 0.0);
+  if (golden_file != NULL) {
+    fprintf(stderr, "%s\n", mismatches == 0 ? "matches the golden log" : "does not match the golden log");
+    return mismatches == 0 ? 0 : 1;
+  }
+  return 0;
+}
@@ -0,0 +1,283 @@
+/*
+ * Sensor driver benchmark
+ * Runs the SHT3x and BME280 drivers against the mock I2C bus on a virtual clock and measures, per acquisition cycle of each driver,
+ * the I2C transactions and bytes, the time they hold the CPU on the wire at 100 and 400 kHz (Wire waits for the transfer on the ESP32),
+ * the time spent in the driver code, which includes the mock sensor answering, and how long the conversion takes. The values read are checked against the values the mock
+ * sensors were given. Then the sensors of both enclosures are acquired one after the other and all at once through a SensorSet.
+ * The DHT rows are worked out from the timing of the protocol as the pin cannot be simulated.
+ *
+ * Build and run with: pio run -e sensorbench && .pio/build/sensorbench/program --cycles 20000
+ */
+#include <Bme280Driver.h>
+#include <MockSensorBus.h>
+#include <SensorDriver.h>
+#include <Sht3xDriver.h>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static uint32_t now_ms = 0;
+
+static uint32_t virtual_clock() {
+  return now_ms;
+}
+
+static SensorBus bus(mock_bus_write, mock_bus_read);
+static uint32_t random_state = 1;
+static uint32_t mismatches = 0;
+
+static uint32_t next_random() {
+  uint32_t x = random_state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  random_state = x;
+  return x;
+}
+
+/*
+ * A temperature between 15 and 40 degrees and a humidity between 20 and 90 percent
+ */
+static sensorSample random_sample() {
+  sensorSample sample;
+  sample.temperature = static_cast<centi_t>(1500 + next_random() % 2500);
+  sample.humidity = static_cast<centi_t>(2000 + next_random() % 7000);
+  return sample;
+}
+
+/*
+ * The mock sensors of one run, set to the same values the driver is expected to read
+ */
+struct mockSensors {
+  MockSht3x *sht[2];
+  MockBme280 *bme[2];
+};
+
+static void set_mock(MockI2cDevice *device, sensorSample sample) {
+  MockSht3x *sht = dynamic_cast<MockSht3x *>(device);
+  if (sht != NULL) {
+    sht->set(sample.temperature, sample.humidity);
+  } else {
+    static_cast<MockBme280 *>(device)->set(sample.temperature, sample.humidity);
+  }
+}
+
+/*
+ * Compare a sample with the expected one, the BME280 compensation can be one hundredth off
+ */
+static void check(const sensorSample *expected, const sensorSample *got) {
+  int32_t t = got->temperature - expected->temperature;
+  int32_t h = got->humidity - expected->humidity;
+  if (t < -1 || t > 1 || h < -1 || h > 1) {
+    if (mismatches < 5) {
+      fprintf(stderr, "expected %d/%d, read %d/%d\n", expected->temperature, expected->humidity, got->temperature, got->humidity);
+    }
+    mismatches++;
+  }
+}
+
+struct driverResult {
+  double transactions;
+  double bytes;
+  double wire_us;
+  double compute_ns;
+  double conversion_ms;
+};
+
+/*
+ * Run one driver alone for cycles acquisitions, the clock moves to the time the driver expects the result after each poll
+ */
+static driverResult run_driver(SensorDriver *driver, MockI2cDevice *device, uint32_t frequency_hz, uint32_t cycles) {
+  mock_bus_begin(virtual_clock, frequency_hz);
+  mock_bus_attach(device);
+  driver->begin();
+  busCounters before = bus.get_counters();
+  uint64_t wire_before = mock_bus_wire_ns();
+  uint64_t conversion = 0;
+  std::chrono::nanoseconds compute(0);
+
+  for (uint32_t i = 0; i < cycles; i++) {
+    sensorSample expected = random_sample();
+    set_mock(device, expected);
+    now_ms += 2000;
+    uint32_t started = now_ms;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    driver->start(now_ms);
+    compute += std::chrono::steady_clock::now() - start;
+    sensorSample sample;
+    sensorPoll result = SENSOR_PENDING;
+    while (result == SENSOR_PENDING) {
+      now_ms += driver->ready_in(now_ms);
+      start = std::chrono::steady_clock::now();
+      result = driver->poll(now_ms, &sample);
+      compute += std::chrono::steady_clock::now() - start;
+    }
+    if (result == SENSOR_DONE) {
+      check(&expected, &sample);
+    } else {
+      mismatches++;
+    }
+    conversion += now_ms - started;
+  }
+
+  busCounters after = bus.get_counters();
+  driverResult r;
+  r.transactions = static_cast<double>(after.transactions - before.transactions) / cycles;
+  r.bytes = static_cast<double>(after.bytes - before.bytes) / cycles;
+  r.wire_us = (mock_bus_wire_ns() - wire_before) / 1000.0 / cycles;
+  r.compute_ns = static_cast<double>(compute.count()) / cycles;
+  r.conversion_ms = static_cast<double>(conversion) / cycles;
+  return r;
+}
+
+/*
+ * Acquire both channels, one sensor after the other or all of them at once, and return the time from the first start to the last result
+ */
+static double run_set(SensorDriver *avian, SensorDriver *reptile, MockI2cDevice *avian_device, MockI2cDevice *reptile_device, bool parallel,
+                      uint32_t cycles, double *polls) {
+  mock_bus_begin(virtual_clock, 400000);
+  mock_bus_attach(avian_device);
+  mock_bus_attach(reptile_device);
+  SensorSet sets[2] = {SensorSet(virtual_clock), SensorSet(virtual_clock)};
+  if (parallel) {
+    sets[0].attach(0, avian);
+    sets[0].attach(1, reptile);
+  } else {
+    sets[0].attach(0, avian);
+    sets[1].attach(1, reptile);
+  }
+  sets[0].begin();
+  sets[1].begin();
+  uint64_t elapsed = 0;
+  uint64_t poll_count = 0;
+
+  for (uint32_t i = 0; i < cycles; i++) {
+    sensorSample expected[2] = {random_sample(), random_sample()};
+    set_mock(avian_device, expected[0]);
+    set_mock(reptile_device, expected[1]);
+    now_ms += 2000;
+    uint32_t started = now_ms;
+    for (uint8_t s = 0; s < (parallel ? 1 : 2); s++) {
+      sets[s].start();
+      while (!sets[s].poll()) {
+        poll_count++;
+        now_ms += sets[s].next_poll_in();
+      }
+      poll_count++;
+    }
+    elapsed += now_ms - started;
+    for (uint8_t channel = 0; channel < 2; channel++) {
+      sensorSample sample;
+      SensorSet *set = &sets[parallel ? 0 : channel];
+      if (set->get_sample(channel, &sample)) {
+        check(&expected[channel], &sample);
+      } else {
+        mismatches++;
+      }
+    }
+  }
+  *polls = static_cast<double>(poll_count) / cycles;
+  return static_cast<double>(elapsed) / cycles;
+}
+
+/*
+ * The DHT timing of the datasheet
+ * Each bit is a 50 us low and a high of 26 us for a zero or 70 us for a one, half of the bits are ones on average
+ */
+static const double DHT_ANSWER_US = 55 + 160 + 40 * (50 + (26 + 70) / 2.0);
+static const double DHT11_START_US = 20000;
+static const double DHT_LIBRARY_WAKE_US = 1000; // the DHT library waits 1 ms with the line high before starting
+
+int main(int argc, char **argv) {
+  uint32_t cycles = 20000;
+  for (int i = 1; i < argc; i += 2) {
+    if (strcmp(argv[i], "--cycles") == 0 && i + 1 < argc) {
+      cycles = strtoul(argv[i + 1], NULL, 10);
+    } else {
+      fprintf(stderr, "usage: sensorbench [--cycles N]\n");
+      return 1;
+    }
+  }
+  if (cycles == 0) {
+    fprintf(stderr, "usage: sensorbench [--cycles N]\n");
+    return 1;
+  }
+
+  MockSht3x sht_avian(SHT3X_ADDRESS);
+  MockSht3x sht_reptile(SHT3X_ADDRESS_ALT);
+  MockBme280 bme_avian(BME280_ADDRESS);
+  MockBme280 bme_reptile(BME280_ADDRESS_ALT);
+  Sht3xDriver sht_avian_driver(&bus, SHT3X_ADDRESS);
+  Sht3xDriver sht_reptile_driver(&bus, SHT3X_ADDRESS_ALT);
+  Bme280Driver bme_avian_driver(&bus, BME280_ADDRESS);
+  Bme280Driver bme_reptile_driver(&bus, BME280_ADDRESS_ALT);
+
+  printf("%lu acquisition cycles per driver\n\n", static_cast<unsigned long>(cycles));
+  printf("CPU time per acquisition by driver\n");
+  printf("%-16s %13s %8s %14s %14s %12s %14s %16s\n", "driver", "transactions", "bytes", "wire 100k us", "wire 400k us", "code ns",
+         "conversion ms", "CPU 400k us");
+  struct {
+    const char *name;
+    SensorDriver *driver;
+    MockI2cDevice *device;
+  } drivers[] = {
+      {"sht3x", &sht_avian_driver, &sht_avian},
+      {"bme280", &bme_avian_driver, &bme_avian},
+  };
+  for (size_t i = 0; i < sizeof(drivers) / sizeof(drivers[0]); i++) {
+    driverResult slow = run_driver(drivers[i].driver, drivers[i].device, 100000, cycles);
+    driverResult fast = run_driver(drivers[i].driver, drivers[i].device, 400000, cycles);
+    printf("%-16s %13.1f %8.1f %14.1f %14.1f %12.0f %14.1f %16.1f\n", drivers[i].name, fast.transactions, fast.bytes, slow.wire_us, fast.wire_us,
+           fast.compute_ns, fast.conversion_ms, fast.wire_us + fast.compute_ns / 1000);
+  }
+  printf("%-16s %13s %8s %14s %14s %12s %14.1f %16.1f\n", "dht11 (model)", "-", "5", "-", "-", "-", (DHT11_START_US + DHT_ANSWER_US) / 1000,
+         DHT_ANSWER_US);
+  printf("%-16s %13s %8s %14s %14s %12s %14.1f %16.1f\n", "dht11 library", "-", "5", "-", "-", "-",
+         (DHT_LIBRARY_WAKE_US + DHT11_START_US + DHT_ANSWER_US) / 1000, DHT_LIBRARY_WAKE_US + DHT11_START_US + DHT_ANSWER_US);
+
+  printf("\nAcquisition of both enclosures at 400 kHz\n");
+  printf("%-20s %16s %14s %14s\n", "sensors", "one by one ms", "at once ms", "polls at once");
+  struct {
+    const char *name;
+    SensorDriver *avian;
+    SensorDriver *reptile;
+    MockI2cDevice *avian_device;
+    MockI2cDevice *reptile_device;
+  } sets[] = {
+      {"2 x sht3x", &sht_avian_driver, &sht_reptile_driver, &sht_avian, &sht_reptile},
+      {"2 x bme280", &bme_avian_driver, &bme_reptile_driver, &bme_avian, &bme_reptile},
+      {"sht3x + bme280", &sht_avian_driver, &bme_reptile_driver, &sht_avian, &bme_reptile},
+  };
+  for (size_t i = 0; i < sizeof(sets) / sizeof(sets[0]); i++) {
+    double polls;
+    double sequential = run_set(sets[i].avian, sets[i].reptile, sets[i].avian_device, sets[i].reptile_device, false, cycles, &polls);
+    double parallel = run_set(sets[i].avian, sets[i].reptile, sets[i].avian_device, sets[i].reptile_device, true, cycles, &polls);
+    printf("%-20s %16.1f %14.1f %14.1f\n", sets[i].name, sequential, parallel, polls);
+  }
+  printf("%-20s %16.1f %14.1f %14s\n", "2 x dht11 (model)", 2 * (DHT11_START_US + DHT_ANSWER_US) / 1000, (DHT11_START_US + 2 * DHT_ANSWER_US) / 1000,
+         "2.0");
+
+  // A sensor that does not answer fails its channel straight away and the other channel is still read
+  mock_bus_begin(virtual_clock, 400000);
+  mock_bus_attach(&sht_avian);
+  SensorSet missing(virtual_clock);
+  missing.attach(0, &sht_avian_driver);
+  missing.attach(1, &sht_reptile_driver);
+  missing.start();
+  while (!missing.poll()) {
+    now_ms += missing.next_poll_in();
+  }
+  sensorSample sample;
+  if (!missing.get_sample(0, &sample) || missing.get_sample(1, &sample)) {
+    fprintf(stderr, "a missing sensor was not reported as failed\n");
+    mismatches++;
+  }
+
+  if (mismatches > 0) {
+    fprintf(stderr, "%lu readings did not match the values of the mock sensors\n", static_cast<unsigned long>(mismatches));
+    return 1;
+  }
+  printf("\nevery reading matched the values of the mock sensors\n");
+  return 0;
+}
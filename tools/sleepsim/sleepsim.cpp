@@ -0,0 +1,229 @@
+/*
+ * Sleep scheduling simulation
+ * Runs SleepScheduler with a backend that moves a virtual clock forward instead of sleeping. A model of the loop does the same work
+ * as main.cpp on the same events: readings every interval, the MQTT client every second and connection attempts every 5 seconds
+ * while the broker is down. Each piece of work takes a fixed time, button presses and WiFi events arrive at random.
+ * For each scenario it reports the share of the time the loop was awake, the wakes by reason, how late the readings were
+ * and how long a button press waited, next to the loop spinning as it did before.
+ *
+ * Build and run with: pio run -e sleepsim && .pio/build/sleepsim/program --duration 86400
+ */
+#include <SleepScheduler.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * How long each piece of work keeps the loop awake
+ * These are assumed figures, not measurements: rough estimates for a nodemcu-32s at 240 MHz, the DHT11 reads and the
+ * connect timeout follow from the sensor and socket timeouts, the rest is a guess. The awake time in the stats message
+ * of a device gives the real figures to put here.
+ */
+static const uint32_t PASS_MS = 1;         // digitalRead of the buttons, QoS 1 poll, live stream check
+static const uint32_t COMMANDS_MS = 2;     // client.loop() with nothing to read
+static const uint32_t SENSORS_MS = 50;     // two DHT11 reads
+static const uint32_t PUBLISH_MS = 8;      // analyze, serialize and publish
+static const uint32_t CONNECT_OK_MS = 150;
+static const uint32_t CONNECT_FAIL_MS = 3000; // TCP connect timeout while the broker is down
+
+struct Options {
+  uint32_t duration_s = 24 * 60 * 60;
+  uint32_t interval_s = 15;
+  uint32_t button_every_s = 600; // mean time between button presses
+  uint32_t seed = 1;
+};
+
+struct Scenario {
+  const char *name;
+  bool spin;                 // the loop as it was, no sleeping
+  uint32_t broker_down_ms;   // the broker is unreachable from the start for this long
+  uint32_t sensor_failure;   // percent of sensor reads that fail
+  uint32_t wifi_drop_every_s; // mean time between WiFi disconnect events, 0 for none
+};
+
+static Options options;
+static uint32_t now_ms = 0;
+static uint32_t random_state = 1;
+static uint32_t next_button_ms = 0;
+static uint32_t next_network_ms = UINT32_MAX;
+static uint32_t wifi_drop_every_ms = 0;
+
+static uint32_t next_random() {
+  uint32_t x = random_state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  random_state = x;
+  return x;
+}
+
+/*
+ * A time between events with the given mean, uniform between a tenth and twice the mean
+ */
+static uint32_t random_gap(uint32_t mean_ms) {
+  return mean_ms / 10 + next_random() % (mean_ms * 19 / 10 + 1);
+}
+
+static uint32_t virtual_clock() {
+  return now_ms;
+}
+
+/*
+ * The sleep backend, the clock moves to the end of the sleep or to the next button press or WiFi event
+ */
+static wakeReason virtual_sleep(uint32_t duration_ms) {
+  uint32_t end = now_ms + duration_ms;
+  if (next_button_ms <= end && next_button_ms <= next_network_ms) {
+    now_ms = next_button_ms > now_ms ? next_button_ms : now_ms;
+    return WAKE_BUTTON;
+  }
+  if (next_network_ms <= end) {
+    now_ms = next_network_ms > now_ms ? next_network_ms : now_ms;
+    return WAKE_NETWORK;
+  }
+  now_ms = end;
+  return WAKE_TIMER;
+}
+
+struct Result {
+  double duty_cycle;
+  uint32_t passes;
+  sleepCounters counters;
+  uint32_t readings;
+  uint32_t max_reading_late_ms;
+  uint32_t max_button_wait_ms;
+};
+
+static Result run(const Scenario &scenario) {
+  now_ms = 0;
+  random_state = options.seed == 0 ? 1 : options.seed;
+  next_button_ms = random_gap(options.button_every_s * 1000);
+  wifi_drop_every_ms = scenario.wifi_drop_every_s * 1000;
+  next_network_ms = wifi_drop_every_ms == 0 ? UINT32_MAX : random_gap(wifi_drop_every_ms);
+
+  SleepScheduler scheduler(virtual_clock, virtual_sleep);
+  uint32_t interval_ms = options.interval_s * 1000;
+  int8_t sample_event = scheduler.add(interval_ms);
+  int8_t command_event = scheduler.add(1000);
+  int8_t mqtt_event = scheduler.add(5000);
+  scheduler.run_in(sample_event, 0);
+
+  Result result;
+  memset(&result, 0, sizeof(result));
+  bool connected = false;
+  uint32_t expected_reading = 0;
+  uint32_t end = options.duration_s * 1000;
+
+  while (now_ms < end) {
+    result.passes++;
+
+    // The buttons are read on every pass, a press is seen on the first pass after it
+    if (now_ms >= next_button_ms) {
+      uint32_t waited = now_ms - next_button_ms;
+      if (waited > result.max_button_wait_ms) {
+        result.max_button_wait_ms = waited;
+      }
+      next_button_ms = now_ms + random_gap(options.button_every_s * 1000);
+    }
+    // A WiFi event drops the broker connection, it comes back on the next attempt
+    if (now_ms >= next_network_ms) {
+      connected = false;
+      next_network_ms = now_ms + random_gap(wifi_drop_every_ms);
+    }
+    now_ms += PASS_MS;
+
+    scheduler.set_enabled(mqtt_event, !connected);
+    if (scheduler.due(mqtt_event)) {
+      if (now_ms >= scenario.broker_down_ms) {
+        now_ms += CONNECT_OK_MS;
+        connected = true;
+      } else {
+        now_ms += CONNECT_FAIL_MS;
+      }
+    }
+    if (scheduler.due(command_event)) {
+      now_ms += COMMANDS_MS;
+    }
+    if (scheduler.due(sample_event)) {
+      now_ms += SENSORS_MS;
+      if (next_random() % 100 < scenario.sensor_failure) {
+        scheduler.run_in(sample_event, 2500);
+      } else {
+        scheduler.restart(sample_event);
+        now_ms += PUBLISH_MS;
+        uint32_t late = now_ms > expected_reading ? now_ms - expected_reading : 0;
+        if (late > result.max_reading_late_ms && result.readings > 0) {
+          result.max_reading_late_ms = late;
+        }
+        result.readings++;
+        expected_reading = now_ms + interval_ms;
+      }
+    }
+
+    if (scenario.spin) {
+      // loop() is called again straight away, every call counts as a wake of the CPU
+      continue;
+    }
+    scheduler.sleep();
+  }
+
+  if (scenario.spin) {
+    result.duty_cycle = 1.0;
+    result.counters.wakes[WAKE_TIMER] = result.passes;
+  } else {
+    result.counters = scheduler.get_counters();
+    result.duty_cycle = scheduler.duty_cycle_permille() / 1000.0;
+  }
+  return result;
+}
+
+static void usage() {
+  fprintf(stderr, "usage: sleepsim [--duration S] [--interval S] [--button-every S] [--seed N]\n");
+}
+
+int main(int argc, char **argv) {
+  for (int i = 1; i < argc; i += 2) {
+    if (i + 1 >= argc) {
+      usage();
+      return 1;
+    }
+    uint32_t value = strtoul(argv[i + 1], NULL, 10);
+    if (strcmp(argv[i], "--duration") == 0) {
+      options.duration_s = value;
+    } else if (strcmp(argv[i], "--interval") == 0) {
+      options.interval_s = value;
+    } else if (strcmp(argv[i], "--button-every") == 0) {
+      options.button_every_s = value;
+    } else if (strcmp(argv[i], "--seed") == 0) {
+      options.seed = value;
+    } else {
+      usage();
+      return 1;
+    }
+  }
+  if (options.duration_s == 0 || options.interval_s < 2 || options.button_every_s == 0) {
+    usage();
+    return 1;
+  }
+
+  const Scenario scenarios[] = {
+      {"spinning loop", true, 0, 0, 0},
+      {"connected", false, 0, 0, 0},
+      {"connected, WiFi drops hourly", false, 0, 0, 3600},
+      {"broker down for the first hour", false, 3600000, 0, 0},
+      {"20% of sensor reads fail", false, 0, 20, 0},
+  };
+
+  printf("%lu s, a reading every %lu s, a button press every %lu s on average\n", static_cast<unsigned long>(options.duration_s),
+         static_cast<unsigned long>(options.interval_s), static_cast<unsigned long>(options.button_every_s));
+  printf("%-32s %8s %10s %10s %8s %8s %9s %12s %12s\n", "scenario", "duty", "passes", "timer", "button", "network", "readings",
+         "late max ms", "button max ms");
+  for (const Scenario &scenario : scenarios) {
+    Result result = run(scenario);
+    printf("%-32s %7.2f%% %10lu %10lu %8lu %8lu %9lu %12lu %12lu\n", scenario.name, result.duty_cycle * 100, static_cast<unsigned long>(result.passes),
+           static_cast<unsigned long>(result.counters.wakes[WAKE_TIMER]), static_cast<unsigned long>(result.counters.wakes[WAKE_BUTTON]),
+           static_cast<unsigned long>(result.counters.wakes[WAKE_NETWORK]), static_cast<unsigned long>(result.readings),
+           static_cast<unsigned long>(result.max_reading_late_ms), static_cast<unsigned long>(result.max_button_wait_ms));
+  }
+  return 0;
+}
@@ -0,0 +1,380 @@
+/*
+ * Allocation soak test
+ * Runs the steady state of the loop for millions of simulated cycles with every heap allocation counted:
+ * filter, stamp, analyze, serialize, QoS 1 publish and acknowledge, live stream framing, command dispatch, statistics and logging.
+ * After the warm-up no allocation is allowed, the program exits with an error at the end of the run if there was one.
+ * Only the code of the libraries above runs here, run_cycle calls them in the order of the loop but is not the loop itself.
+ * The live stream frames go through the same buffer pool as LiveStream, with simulated clients that hold a buffer until their message is sent.
+ * The Arduino side is not covered: PubSubClient and the WiFiClient under it, and the WebSocket of LiveStream,
+ * which still allocates a queue entry per client for every event sent while a client is connected.
+ * A reading or statistics message that serializes to nothing fails the run, so a JSON library that does not write cannot pass it.
+ *
+ * Build and run with: pio run -e soak && .pio/build/soak/program --cycles 2000000
+ */
+#include <Classifier.h>
+#include <CommandChannel.h>
+#include <DeviceIdentity.h>
+#include <Logger.h>
+#include <ReadingController.h>
+#include <ReliablePublisher.h>
+#include <SampleClock.h>
+#include <SensorFilter.h>
+#include <StreamPolicy.h>
+#include <atomic>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Allocation counting
+ * operator new is replaced everywhere, malloc and friends are wrapped where the C library allows it (glibc)
+ */
+static std::atomic<bool> counting(false);
+static std::atomic<uint64_t> allocations(0);
+static std::atomic<uint64_t> first_size(0);
+static uint64_t cycle = 0;
+static std::atomic<uint64_t> first_cycle(0);
+
+static void count_allocation(size_t size) {
+  if (!counting.load(std::memory_order_relaxed)) {
+    return;
+  }
+  if (allocations.fetch_add(1, std::memory_order_relaxed) == 0) {
+    first_size.store(size, std::memory_order_relaxed);
+    first_cycle.store(cycle, std::memory_order_relaxed);
+  }
+}
+
+#ifdef __GLIBC__
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *pointer, size_t size);
+void __libc_free(void *pointer);
+
+void *malloc(size_t size) {
+  count_allocation(size);
+  return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+  count_allocation(count * size);
+  return __libc_calloc(count, size);
+}
+
+void *realloc(void *pointer, size_t size) {
+  count_allocation(size);
+  return __libc_realloc(pointer, size);
+}
+
+void free(void *pointer) {
+  __libc_free(pointer);
+}
+}
+#endif
+
+void *operator new(size_t size) {
+  count_allocation(size);
+  void *pointer = malloc(size == 0 ? 1 : size);
+  if (pointer == NULL) {
+    throw std::bad_alloc();
+  }
+  return pointer;
+}
+
+void *operator new[](size_t size) {
+  return operator new(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+  count_allocation(size);
+  return malloc(size == 0 ? 1 : size);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept {
+  return operator new(size, std::nothrow);
+}
+
+void operator delete(void *pointer) noexcept {
+  free(pointer);
+}
+
+void operator delete[](void *pointer) noexcept {
+  free(pointer);
+}
+
+void operator delete(void *pointer, size_t) noexcept {
+  free(pointer);
+}
+
+void operator delete[](void *pointer, size_t) noexcept {
+  free(pointer);
+}
+
+/*
+ * The simulated device, the same objects main.cpp has
+ */
+static uint64_t now_ms = 0;
+
+static uint64_t simulated_monotonic() {
+  return now_ms;
+}
+
+static DeviceIdentity identity;
+static ApplicationFilter filter;
+static ApplicationReading application_reading;
+static ApplicationStats stats;
+static SampleClock sample_clock(simulated_monotonic);
+static StreamPolicy stream_policy;
+
+/*
+ * The connection to the broker, the packets the publisher writes are answered with a PUBACK on the next cycle
+ */
+static uint8_t pending_ack[4];
+static bool ack_waiting = false;
+static uint64_t bytes_written = 0;
+
+static size_t write_packet(const uint8_t *packet, size_t length) {
+  // The packet id follows the topic, the fixed header is 2 or 3 bytes for these sizes
+  size_t header = packet[1] & 0x80 ? 3 : 2;
+  size_t topic_length = (packet[header] << 8) | packet[header + 1];
+  size_t id_position = header + 2 + topic_length;
+  pending_ack[0] = 0x40;
+  pending_ack[1] = 0x02;
+  pending_ack[2] = packet[id_position];
+  pending_ack[3] = packet[id_position + 1];
+  ack_waiting = true;
+  bytes_written += length;
+  return length;
+}
+
+static ReliablePublisher publisher(write_packet);
+static uint64_t empty_messages = 0;
+
+/*
+ * The buffer pool of LiveStream, the references are what count() of each AsyncWebSocketMessageBuffer would return
+ * A client queue holds one message at a time here, it is full until the message is sent
+ */
+#define SOAK_STREAM_CLIENTS 4
+
+static uint8_t stream_buffers[STREAM_BUFFER_COUNT][STREAM_FRAME_SIZE];
+static uint32_t stream_references[STREAM_BUFFER_COUNT];
+static int client_buffers[SOAK_STREAM_CLIENTS];
+static uint64_t pool_exhausted = 0;
+static PubackParser parser;
+
+static bool log_sink(const char *text) {
+  bytes_written += strlen(text);
+  return true;
+}
+
+static bool command_interval(const uint8_t *payload, unsigned int length) {
+  uint32_t seconds;
+  return payload_to_uint(payload, length, &seconds);
+}
+
+static bool command_sample(const uint8_t *payload, unsigned int length) {
+  return true;
+}
+
+static const CommandRoute routes[] = {
+    {identity.topic(TOPIC_COMMAND_INTERVAL), command_interval},
+    {identity.topic(TOPIC_COMMAND_SAMPLE), command_sample},
+};
+
+static uint32_t random_state = 1;
+
+static uint32_t next_random() {
+  uint32_t x = random_state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  random_state = x;
+  return x;
+}
+
+static centi_t sensor(centi_t base) {
+  centi_t sample = static_cast<centi_t>(base + static_cast<int32_t>(next_random() % 200) - 100);
+  // A spike now and then so the hampel stage replaces samples
+  if (next_random() % 50 == 0) {
+    sample = static_cast<centi_t>(sample + 2000);
+  }
+  return sample;
+}
+
+/*
+ * One pass of the reading branch of the loop and the work done around it
+ */
+static void run_cycle(const Limits *limits) {
+  now_ms += 15000;
+  if (cycle % 240 == 0) {
+    sample_clock.sync(1700000000000ULL + now_ms);
+  }
+
+  reading raw_avian = {sensor(2600), sensor(5500)};
+  reading raw_reptilian = {sensor(2900), sensor(4200)};
+  sampleStamp stamp = sample_clock.stamp();
+  application_reading.set_stamp(&stamp);
+  application_reading.set_raw_reading(&raw_avian, &raw_reptilian);
+  reading avian;
+  reading reptilian;
+  avian.temperature = filter.filter(AVIAN_TEMPERATURE, raw_avian.temperature);
+  avian.humidity = filter.filter(AVIAN_HUMIDITY, raw_avian.humidity);
+  reptilian.temperature = filter.filter(REPTILE_TEMPERATURE, raw_reptilian.temperature);
+  reptilian.humidity = filter.filter(REPTILE_HUMIDITY, raw_reptilian.humidity);
+  application_reading.set_reading(&avian, &reptilian);
+  stats.record_reading(&avian, &reptilian);
+  enclosureLevels levels = application_reading.analyze(limits);
+
+  char payload[READING_JSON_SIZE];
+  if (application_reading.stringify_reading(payload, sizeof(payload)) == 0) {
+    empty_messages++;
+  }
+  publisher.publish(identity.topic(TOPIC_READINGS), payload, static_cast<uint32_t>(now_ms));
+  application_reading.reset();
+
+  // The PUBACK arrives through the parser like it does through AckSniffingClient
+  if (ack_waiting) {
+    for (uint8_t i = 0; i < sizeof(pending_ack); i++) {
+      uint16_t packet_id;
+      if (parser.feed(pending_ack[i], &packet_id)) {
+        publisher.acknowledge(packet_id);
+      }
+    }
+    ack_waiting = false;
+  }
+  publisher.poll(static_cast<uint32_t>(now_ms));
+
+  // The network task sends most of the queued messages between two readings
+  for (uint32_t client = 0; client < SOAK_STREAM_CLIENTS; client++) {
+    if (client_buffers[client] >= 0 && next_random() % 10 != 0) {
+      stream_references[client_buffers[client]]--;
+      client_buffers[client] = -1;
+    }
+  }
+  char frame[STREAM_FRAME_SIZE];
+  size_t frame_length = format_stream_frame(frame, sizeof(frame), STREAM_READING, payload);
+  int buffer = free_stream_buffer(stream_references, STREAM_BUFFER_COUNT);
+  if (buffer < 0) {
+    pool_exhausted++;
+  } else {
+    fill_stream_buffer(stream_buffers[buffer], STREAM_FRAME_SIZE, frame, frame_length);
+  }
+  stream_policy.count_frame();
+  for (uint32_t client = 0; client < SOAK_STREAM_CLIENTS; client++) {
+    streamAction action = stream_policy.admit(client, STREAM_READING, buffer < 0 || client_buffers[client] >= 0);
+    if (action == STREAM_SEND) {
+      stream_references[buffer]++;
+      client_buffers[client] = buffer;
+    } else if (action == STREAM_CLOSE) {
+      // The browser reconnects, its queue went with the old connection
+      if (client_buffers[client] >= 0) {
+        stream_references[client_buffers[client]]--;
+        client_buffers[client] = -1;
+      }
+      stream_policy.add(client);
+    }
+  }
+  char alarm[96];
+  format_alarm(alarm, sizeof(alarm), levels.avian == LEVEL_CRITICAL, levels);
+
+  const char *command = cycle % 2 == 0 ? "15" : "now";
+  dispatch_command(routes, sizeof(routes) / sizeof(routes[0]), cycle % 2 == 0 ? identity.topic(TOPIC_COMMAND_INTERVAL) : identity.topic(TOPIC_COMMAND_SAMPLE),
+                   reinterpret_cast<const uint8_t *>(command), strlen(command));
+  stats.record_command(static_cast<uint32_t>(next_random() % 500));
+  stats.record_loop(static_cast<uint32_t>(next_random() % 2000));
+
+  if (cycle % 100 == 0) {
+    uint32_t rejected[FILTER_CHANNELS];
+    for (uint8_t i = 0; i < FILTER_CHANNELS; i++) {
+      rejected[i] = filter.rejected_samples(static_cast<filterChannel>(i));
+    }
+    publisherCounters counters = publisher.get_counters();
+    stats.record_publishes(counters.retransmitted, counters.dropped, counters.expired);
+    stats.record_log_drops(log_dropped());
+    char json[STATS_JSON_SIZE];
+    if (stats.stringify_stats(json, sizeof(json), static_cast<uint32_t>(now_ms / 1000), 15, rejected) == 0) {
+      empty_messages++;
+    }
+  }
+
+  if (cycle % 50000 == 0) {
+    LOG_WARN("Soak cycle %llu, %llu bytes written", static_cast<unsigned long long>(cycle), static_cast<unsigned long long>(bytes_written));
+    log_drain();
+    log_publish(log_sink);
+  }
+}
+
+int main(int argc, char **argv) {
+  uint64_t cycles = 2000000;
+  uint64_t warmup = 1000;
+  for (int i = 1; i < argc; i += 2) {
+    if (i + 1 >= argc) {
+      fprintf(stderr, "usage: soak [--cycles N] [--warmup N]\n");
+      return 1;
+    }
+    if (strcmp(argv[i], "--cycles") == 0) {
+      cycles = strtoull(argv[i + 1], NULL, 10);
+    } else if (strcmp(argv[i], "--warmup") == 0) {
+      warmup = strtoull(argv[i + 1], NULL, 10);
+    } else {
+      fprintf(stderr, "usage: soak [--cycles N] [--warmup N]\n");
+      return 1;
+    }
+  }
+
+  identity.begin(0x0000c0ffee02ULL, "soak");
+  sample_clock.begin(0x50a4);
+  log_begin(true);
+  FilterConfig config = filter.get_config();
+  config.median = true;
+  config.ewma = true;
+  filter.set_config(&config);
+  for (uint32_t client = 0; client < SOAK_STREAM_CLIENTS; client++) {
+    stream_policy.add(client);
+    client_buffers[client] = -1;
+  }
+  Limits limits;
+  const centi_t temperature[4] = {2000, 2400, 3000, 3500};
+  const centi_t humidity[4] = {3000, 4000, 6000, 7000};
+  memcpy(limits.avian_temp_limits, temperature, sizeof(temperature));
+  memcpy(limits.reptile_temp_limits, temperature, sizeof(temperature));
+  memcpy(limits.avian_humid_limits, humidity, sizeof(humidity));
+  memcpy(limits.reptile_humid_limits, humidity, sizeof(humidity));
+
+  printf("soak: %llu cycles, %llu of warm-up\n", static_cast<unsigned long long>(cycles), static_cast<unsigned long long>(warmup));
+  // Output is flushed here so the stdout buffer is not allocated while counting
+  fflush(stdout);
+
+  uint64_t warmup_allocations = 0;
+  counting.store(true);
+  for (cycle = 0; cycle < cycles; cycle++) {
+    if (cycle == warmup) {
+      warmup_allocations = allocations.exchange(0);
+      first_size.store(0);
+    }
+    run_cycle(&limits);
+  }
+  counting.store(false);
+
+  uint64_t steady_allocations = cycles > warmup ? allocations.load() : 0;
+  publisherCounters counters = publisher.get_counters();
+  printf("warm-up allocations: %llu\n", static_cast<unsigned long long>(warmup_allocations));
+  printf("steady state allocations: %llu\n", static_cast<unsigned long long>(steady_allocations));
+  printf("published %lu, acknowledged %lu, %llu bytes written\n", static_cast<unsigned long>(counters.sent),
+         static_cast<unsigned long>(counters.acknowledged), static_cast<unsigned long long>(bytes_written));
+  streamCounters stream = stream_policy.get_counters();
+  printf("live stream: %lu frames, %lu deliveries, %lu drops, %llu with no free buffer\n", static_cast<unsigned long>(stream.frames),
+         static_cast<unsigned long>(stream.deliveries), static_cast<unsigned long>(stream.drops), static_cast<unsigned long long>(pool_exhausted));
+  if (empty_messages != 0) {
+    printf("FAILED: %llu messages serialized to nothing\n", static_cast<unsigned long long>(empty_messages));
+    return 1;
+  }
+  if (steady_allocations != 0) {
+    printf("FAILED: first allocation after warm-up was %llu bytes in cycle %llu\n", static_cast<unsigned long long>(first_size.load()),
+           static_cast<unsigned long long>(first_cycle.load()));
+    return 1;
+  }
+  return 0;
+}
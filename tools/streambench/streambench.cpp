@@ -0,0 +1,215 @@
+/*
+ * Live stream fan-out benchmark
+ * Measures the cost of pushing one reading to 1 to 32 clients, first with one shared buffer as LiveStream does
+ * and then with the reading serialized again for every client.
+ * The clients have bounded queues like AsyncWebSocket and every fourth one drains slowly, so the drop policy is exercised.
+ *
+ * Build and run with: pio run -e streambench && .pio/build/streambench/program --events 20000
+ */
+#include <ReadingController.h>
+#include <StreamPolicy.h>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+/*
+ * Messages an AsyncWebSocket client can have queued on the ESP32
+ */
+#define CLIENT_QUEUE_SIZE 32
+
+static_assert(STREAM_MAX_CLIENTS >= 32, "build the benchmark with -DSTREAM_MAX_CLIENTS=32");
+
+/*
+ * A frame shared by the queues of all the clients, like AsyncWebSocketMessageBuffer
+ */
+struct SharedFrame {
+  uint32_t references;
+  size_t length;
+  char data[STREAM_FRAME_SIZE];
+};
+
+/*
+ * A frame owned by one client queue
+ */
+struct OwnedFrame {
+  size_t length;
+  char data[STREAM_FRAME_SIZE];
+};
+
+template <typename Frame>
+struct MockClient {
+  Frame *queue[CLIENT_QUEUE_SIZE];
+  uint32_t head = 0;
+  uint32_t count = 0;
+  uint32_t drain_every; // the client takes one message every drain_every events
+  bool closed = false;
+  uint64_t bytes = 0;
+};
+
+static void release(SharedFrame *frame) {
+  if (--frame->references == 0) {
+    delete frame;
+  }
+}
+
+static void release(OwnedFrame *frame) {
+  delete frame;
+}
+
+template <typename Frame>
+static void drain(MockClient<Frame> *client, uint32_t event) {
+  if (client->count == 0 || event % client->drain_every != 0) {
+    return;
+  }
+  Frame *frame = client->queue[client->head];
+  client->bytes += frame->length;
+  release(frame);
+  client->head = (client->head + 1) % CLIENT_QUEUE_SIZE;
+  client->count--;
+}
+
+template <typename Frame>
+static void push(MockClient<Frame> *client, Frame *frame) {
+  client->queue[(client->head + client->count) % CLIENT_QUEUE_SIZE] = frame;
+  client->count++;
+}
+
+struct Result {
+  double ns_per_event;
+  streamCounters counters;
+};
+
+/*
+ * A reading that changes a little every event so the serializer does real work
+ */
+static void next_reading(ApplicationReading *application_reading, uint32_t event) {
+  reading avian = {static_cast<centi_t>(2500 + event % 300), static_cast<centi_t>(5000 + event % 700)};
+  reading reptilian = {static_cast<centi_t>(2800 + event % 250), static_cast<centi_t>(4500 + event % 500)};
+  application_reading->set_reading(&avian, &reptilian);
+}
+
+template <typename Frame>
+static std::vector<MockClient<Frame>> make_clients(uint32_t count) {
+  std::vector<MockClient<Frame>> clients(count);
+  for (uint32_t i = 0; i < count; i++) {
+    clients[i].drain_every = i % 4 == 3 ? 3 : 1;
+  }
+  return clients;
+}
+
+/*
+ * The reading is serialized and framed once and every client queue takes a reference to it
+ */
+static Result run_shared(uint32_t client_count, uint32_t events) {
+  ApplicationReading application_reading;
+  StreamPolicy policy;
+  std::vector<MockClient<SharedFrame>> clients = make_clients<SharedFrame>(client_count);
+  for (uint32_t i = 0; i < client_count; i++) {
+    policy.add(i);
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t event = 0; event < events; event++) {
+    next_reading(&application_reading, event);
+    char json[READING_JSON_SIZE];
+    application_reading.stringify_reading(json, sizeof(json));
+    SharedFrame *frame = new SharedFrame;
+    frame->references = 1;
+    frame->length = format_stream_frame(frame->data, sizeof(frame->data), STREAM_READING, json);
+    policy.count_frame();
+    for (uint32_t i = 0; i < client_count; i++) {
+      MockClient<SharedFrame> *client = &clients[i];
+      if (client->closed) {
+        continue;
+      }
+      streamAction action = policy.admit(i, STREAM_READING, client->count == CLIENT_QUEUE_SIZE);
+      if (action == STREAM_SEND) {
+        frame->references++;
+        push(client, frame);
+      } else if (action == STREAM_CLOSE) {
+        client->closed = true;
+      }
+      drain(client, event);
+    }
+    release(frame);
+  }
+  double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  for (uint32_t i = 0; i < client_count; i++) {
+    while (clients[i].count > 0) {
+      drain(&clients[i], 0);
+    }
+  }
+  return Result{elapsed * 1e9 / events, policy.get_counters()};
+}
+
+/*
+ * The reading is serialized and framed again for every client, this is what sending a String per client costs
+ */
+static Result run_per_client(uint32_t client_count, uint32_t events) {
+  ApplicationReading application_reading;
+  StreamPolicy policy;
+  std::vector<MockClient<OwnedFrame>> clients = make_clients<OwnedFrame>(client_count);
+  for (uint32_t i = 0; i < client_count; i++) {
+    policy.add(i);
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t event = 0; event < events; event++) {
+    next_reading(&application_reading, event);
+    policy.count_frame();
+    for (uint32_t i = 0; i < client_count; i++) {
+      MockClient<OwnedFrame> *client = &clients[i];
+      if (client->closed) {
+        continue;
+      }
+      streamAction action = policy.admit(i, STREAM_READING, client->count == CLIENT_QUEUE_SIZE);
+      if (action == STREAM_SEND) {
+        char json[READING_JSON_SIZE];
+        application_reading.stringify_reading(json, sizeof(json));
+        OwnedFrame *frame = new OwnedFrame;
+        frame->length = format_stream_frame(frame->data, sizeof(frame->data), STREAM_READING, json);
+        push(client, frame);
+      } else if (action == STREAM_CLOSE) {
+        client->closed = true;
+      }
+      drain(client, event);
+    }
+  }
+  double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  for (uint32_t i = 0; i < client_count; i++) {
+    while (clients[i].count > 0) {
+      drain(&clients[i], 0);
+    }
+  }
+  return Result{elapsed * 1e9 / events, policy.get_counters()};
+}
+
+int main(int argc, char **argv) {
+  uint32_t events = 20000;
+  for (int i = 1; i < argc; i += 2) {
+    if (i + 1 >= argc || strcmp(argv[i], "--events") != 0) {
+      fprintf(stderr, "usage: streambench [--events N]\n");
+      return 1;
+    }
+    events = strtoul(argv[i + 1], NULL, 10);
+  }
+  if (events == 0) {
+    fprintf(stderr, "usage: streambench [--events N]\n");
+    return 1;
+  }
+
+  printf("%lu readings per run, every fourth client drains at a third of the rate\n", static_cast<unsigned long>(events));
+  printf("%7s %14s %16s %10s %8s %8s\n", "clients", "shared ns/ev", "per-client ns/ev", "delivered", "dropped", "closed");
+  for (uint32_t clients = 1; clients <= 32; clients *= 2) {
+    Result shared = run_shared(clients, events);
+    Result per_client = run_per_client(clients, events);
+    printf("%7lu %14.0f %16.0f %10lu %8lu %8lu\n", static_cast<unsigned long>(clients), shared.ns_per_event, per_client.ns_per_event,
+           static_cast<unsigned long>(shared.counters.deliveries), static_cast<unsigned long>(shared.counters.drops),
+           static_cast<unsigned long>(shared.counters.closed));
+  }
+  return 0;
+}